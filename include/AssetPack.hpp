@@ -0,0 +1,288 @@
+#ifndef ASSETPACK_HPP
+#define ASSETPACK_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // Keeps Windows.h's min/max macros away from std::min/std::max
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//A single file holding every asset, memory mapped read only.
+//Layout: a 32 byte header, the index (one entry per asset, sorted by the hash of its normalized path), a block with the
+//paths themselves (to rule out hash collisions) and then the asset blobs back to back, each 16 byte aligned.
+//Asset paths are normalized (forward slashes, lower case, relative to the game directory) so "Assets\\Textures\\A.png"
+//and "assets/textures/a.png" are the same asset on every platform.
+
+struct AssetPackHeader {
+	char magic[4]; // "TGPK"
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t pathsOffset;
+	uint64_t dataOffset;
+};
+
+struct AssetPackEntry {
+	uint64_t hash;
+	uint64_t offset; // From the start of the file
+	uint64_t size;
+	uint32_t pathOffset; // From the start of the paths block
+	uint32_t pathLength;
+};
+
+class AssetPack {
+public:
+	AssetPack() {}
+
+	~AssetPack() {
+		unmount();
+	}
+
+	AssetPack(const AssetPack&) = delete;
+	AssetPack& operator=(const AssetPack&) = delete;
+
+	// Maps a pack into memory. Nothing is read up front, pages are loaded by the OS as assets are used.
+	bool mount(const std::string& packPath) {
+		unmount();
+
+#ifdef _WIN32
+		m_file = CreateFileA(packPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			m_file = NULL;
+			return false;
+		}
+		LARGE_INTEGER size;
+		GetFileSizeEx(m_file, &size);
+		m_size = (size_t)size.QuadPart;
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping != NULL) {
+			m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+#else
+		int fd = open(packPath.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			m_size = (size_t)info.st_size;
+			void* mapped = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			m_data = (mapped == MAP_FAILED) ? nullptr : (const uint8_t*)mapped;
+		}
+		close(fd); // The mapping keeps the file alive
+#endif
+		if (m_data == nullptr) {
+			std::printf("Failed to memory map the asset pack: %s\n", packPath.c_str());
+			unmount();
+			return false;
+		}
+
+		AssetPackHeader header;
+		if (m_size < sizeof(header)) {
+			std::printf("%s is too small to be an asset pack\n", packPath.c_str());
+			unmount();
+			return false;
+		}
+		std::memcpy(&header, m_data, sizeof(header));
+		if (std::memcmp(header.magic, "TGPK", 4) != 0 || header.version != packVersion
+			|| sizeof(header) + (uint64_t)header.entryCount * sizeof(AssetPackEntry) > m_size || header.pathsOffset > m_size || header.dataOffset > m_size) {
+			std::printf("%s is not an asset pack this version can read\n", packPath.c_str());
+			unmount();
+			return false;
+		}
+
+		//Checked once here so find() can hand out pointers without looking at the file size again.
+		const AssetPackEntry* entries = (const AssetPackEntry*)(m_data + sizeof(header));
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			const AssetPackEntry& e = entries[i];
+			if (e.offset > m_size || e.size > m_size - e.offset || e.pathOffset > m_size - header.pathsOffset
+				|| e.pathLength > m_size - header.pathsOffset - e.pathOffset) {
+				std::printf("%s is damaged, entry %u points past the end of the file\n", packPath.c_str(), i);
+				unmount();
+				return false;
+			}
+		}
+
+		m_entries = entries;
+		m_entryCount = header.entryCount;
+		m_paths = (const char*)(m_data + header.pathsOffset);
+		return true;
+	}
+
+	void unmount() {
+#ifdef _WIN32
+		if (m_data) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file) CloseHandle(m_file);
+		m_mapping = NULL;
+		m_file = NULL;
+#else
+		if (m_data) munmap((void*)m_data, m_size);
+#endif
+		m_data = nullptr;
+		m_size = 0;
+		m_entries = nullptr;
+		m_entryCount = 0;
+	}
+
+	bool isMounted() const {
+		return m_data != nullptr;
+	}
+
+	// Finds an asset by (normalized) path. The returned memory lives as long as the pack stays mounted.
+	bool find(const std::string& normalizedPath, const void** data, size_t* size) const {
+		if (!isMounted()) return false;
+
+		uint64_t hash = hashPath(normalizedPath);
+		const AssetPackEntry* end = m_entries + m_entryCount;
+		const AssetPackEntry* it = std::lower_bound(m_entries, end, hash, [](const AssetPackEntry& e, uint64_t h) { return e.hash < h; });
+		for (; it != end && it->hash == hash; it++) {
+			if (it->pathLength == normalizedPath.size() && std::memcmp(m_paths + it->pathOffset, normalizedPath.data(), it->pathLength) == 0) {
+				*data = m_data + it->offset;
+				*size = (size_t)it->size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Forward slashes, no "./", lower case.
+	static std::string normalizePath(const std::string& path) {
+		std::string out;
+		out.reserve(path.size());
+		for (char c : path) {
+			if (c == '\\') c = '/';
+			if (c == '/' && !out.empty() && out.back() == '/') continue;
+			out.push_back((char)std::tolower((unsigned char)c));
+		}
+		while (out.compare(0, 2, "./") == 0) {
+			out.erase(0, 2);
+		}
+		return out;
+	}
+
+	// 64 bit FNV-1a.
+	static uint64_t hashPath(const std::string& normalizedPath) {
+		return hashBytes(normalizedPath.data(), normalizedPath.size());
+	}
+
+	static uint64_t hashBytes(const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Packs every file under rootDir/Assets into packPath. Paths are stored relative to rootDir, eg. "assets/fonts/roboto-light.ttf".
+	static bool build(const std::string& rootDir, const std::string& packPath) {
+		namespace fs = std::filesystem;
+
+		struct Source {
+			std::string path;
+			fs::path file;
+			uint64_t hash;
+		};
+		std::vector<Source> sources;
+
+		std::error_code ec;
+		for (const auto& item : fs::recursive_directory_iterator(fs::path(rootDir) / "Assets", ec)) {
+			if (!item.is_regular_file()) continue;
+			std::string rel = normalizePath(fs::relative(item.path(), rootDir).generic_string());
+			sources.push_back({ rel, item.path(), hashPath(rel) });
+		}
+		if (ec) {
+			std::printf("Failed to read the assets under %s: %s\n", rootDir.c_str(), ec.message().c_str());
+			return false;
+		}
+		std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.hash != b.hash ? a.hash < b.hash : a.path < b.path; });
+
+		AssetPackHeader header = {};
+		std::memcpy(header.magic, "TGPK", 4);
+		header.version = packVersion;
+		header.entryCount = (uint32_t)sources.size();
+		header.pathsOffset = sizeof(header) + sources.size() * sizeof(AssetPackEntry);
+
+		std::vector<AssetPackEntry> entries(sources.size());
+		std::string paths;
+		for (size_t i = 0; i < sources.size(); i++) {
+			entries[i].hash = sources[i].hash;
+			entries[i].pathOffset = (uint32_t)paths.size();
+			entries[i].pathLength = (uint32_t)sources[i].path.size();
+			paths += sources[i].path;
+		}
+		header.dataOffset = align16(header.pathsOffset + paths.size());
+
+		uint64_t offset = header.dataOffset;
+		for (size_t i = 0; i < sources.size(); i++) {
+			entries[i].offset = offset;
+			entries[i].size = fs::file_size(sources[i].file, ec);
+			offset = align16(offset + entries[i].size);
+		}
+
+		std::ofstream out(packPath, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			std::printf("Failed to open %s for writing\n", packPath.c_str());
+			return false;
+		}
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(AssetPackEntry)));
+		out.write(paths.data(), (std::streamsize)paths.size());
+
+		std::vector<char> buffer;
+		for (size_t i = 0; i < sources.size(); i++) {
+			out.seekp((std::streamoff)entries[i].offset);
+			std::ifstream in(sources[i].file, std::ios::binary);
+			buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			if (buffer.size() != entries[i].size) {
+				std::printf("%s changed while packing\n", sources[i].path.c_str());
+				return false;
+			}
+			out.write(buffer.data(), (std::streamsize)buffer.size());
+		}
+		//Pad the last blob so the file is as long as the index says.
+		out.seekp(0, std::ios::end);
+		while ((uint64_t)out.tellp() < offset) out.put(0);
+
+		std::printf("Packed %zu assets into %s\n", sources.size(), packPath.c_str());
+		return (bool)out;
+	}
+
+	static constexpr uint32_t packVersion = 1;
+
+private:
+	static uint64_t align16(uint64_t v) {
+		return (v + 15) & ~(uint64_t)15;
+	}
+
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	const AssetPackEntry* m_entries = nullptr;
+	uint32_t m_entryCount = 0;
+	const char* m_paths = nullptr;
+
+#ifdef _WIN32
+	HANDLE m_file = NULL;
+	HANDLE m_mapping = NULL;
+#endif
+};
+
+#endif
@@ -0,0 +1,565 @@
+#ifndef AUDIOMIXER_HPP
+#define AUDIOMIXER_HPP
+
+#include "SDL.h"
+
+#include "FileSystem.hpp"
+#include "SpscRing.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+//Software mixer running in the SDL audio callback.
+//Sound effects are decoded up front into float stereo at the device rate. Music is streamed: update() (game thread)
+//reads the WAV a chunk at a time, converts it and pushes the samples into a ring the callback plays from.
+//The game thread only talks to the callback through a lock-free command ring, and the callback never locks or
+//allocates: voices, rings and the scratch buffer are all sized when the mixer is made.
+//Open it with the "dummy" driver to run headless (the callback still runs, on a timer), or call mix() directly.
+
+struct SoundClip {
+	std::vector<float> samples; // Interleaved stereo at the mixer's rate
+	size_t frames = 0;
+};
+
+struct AudioStats {
+	double callbackMs = 0; // CPU time of the last callback
+	double peakCallbackMs = 0;
+	double load = 0; // Last callback's CPU time over the time its buffer plays for
+	uint64_t underruns = 0; // Callbacks that ran out of music to play
+	uint64_t droppedCommands = 0; // Commands lost to a full ring or with no free voice
+	int activeVoices = 0;
+};
+
+class AudioMixer {
+public:
+	static constexpr int maxVoices = 32;
+	static constexpr int channels = 2;
+	static constexpr int blockFrames = 512; // Frames mixed at a time
+
+	AudioMixer() : m_commands(256), m_music(1 << 17) {
+		m_scratch.resize(blockFrames * channels);
+		m_spec.freq = 48000;
+		m_spec.format = AUDIO_F32SYS;
+		m_spec.channels = channels;
+		m_spec.samples = blockFrames;
+	}
+
+	~AudioMixer() {
+		close();
+		closeMusic();
+	}
+
+	AudioMixer(const AudioMixer&) = delete;
+	AudioMixer& operator=(const AudioMixer&) = delete;
+
+	// Opens the output device and starts mixing. driver picks the SDL audio driver (eg. "dummy"), nullptr for the default.
+	// Sounds loaded before this are converted for 48kHz, which is what's asked of the device.
+	bool open(const char* driver = nullptr) {
+		if (driver != nullptr) {
+			SDL_SetHint(SDL_HINT_AUDIODRIVER, driver);
+		}
+		if (!SDL_WasInit(SDL_INIT_AUDIO)) {
+			if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+				std::printf("Failed to initialise audio: %s\n", SDL_GetError());
+				return false;
+			}
+		}
+		else if (driver != nullptr && SDL_AudioInit(driver) != 0) {
+			std::printf("Failed to start the %s audio driver: %s\n", driver, SDL_GetError());
+			return false;
+		}
+
+		SDL_AudioSpec want = m_spec;
+		want.callback = &AudioMixer::callback;
+		want.userdata = this;
+		//No changes allowed, SDL converts if the hardware wants something else so the callback always gets float stereo.
+		m_device = SDL_OpenAudioDevice(NULL, 0, &want, &m_spec, 0);
+		if (m_device == 0) {
+			std::printf("Failed to open an audio device: %s\n", SDL_GetError());
+			return false;
+		}
+		SDL_PauseAudioDevice(m_device, 0);
+		return true;
+	}
+
+	void close() {
+		if (m_device != 0) {
+			SDL_CloseAudioDevice(m_device); // Waits for the callback to finish
+			m_device = 0;
+		}
+	}
+
+	bool isOpen() const {
+		return m_device != 0;
+	}
+
+	// Decodes a WAV into a clip. Returns the sound ID for play(), or -1.
+	int loadSound(const std::string& path) {
+		SDL_RWops* file = FileSystem::openAsset(path);
+		SDL_AudioSpec wav;
+		Uint8* data = nullptr;
+		Uint32 length = 0;
+		if (file == nullptr || SDL_LoadWAV_RW(file, 1, &wav, &data, &length) == nullptr) {
+			std::printf("Unable to load sound: %s\n", path.c_str());
+			return -1;
+		}
+
+		SDL_AudioCVT cvt;
+		if (SDL_BuildAudioCVT(&cvt, wav.format, wav.channels, wav.freq, AUDIO_F32SYS, channels, m_spec.freq) < 0) {
+			std::printf("Can't convert sound %s: %s\n", path.c_str(), SDL_GetError());
+			SDL_FreeWAV(data);
+			return -1;
+		}
+		std::vector<Uint8> converted((size_t)length * std::max(cvt.len_mult, 1));
+		std::memcpy(converted.data(), data, length);
+		SDL_FreeWAV(data);
+		cvt.buf = converted.data();
+		cvt.len = (int)length;
+		if (cvt.needed && SDL_ConvertAudio(&cvt) != 0) {
+			std::printf("Can't convert sound %s: %s\n", path.c_str(), SDL_GetError());
+			return -1;
+		}
+
+		std::unique_ptr<SoundClip> clip(new SoundClip());
+		size_t bytes = cvt.needed ? (size_t)cvt.len_cvt : (size_t)length;
+		clip->frames = bytes / (sizeof(float) * channels);
+		clip->samples.resize(clip->frames * channels);
+		std::memcpy(clip->samples.data(), converted.data(), clip->frames * channels * sizeof(float));
+		m_clips.push_back(std::move(clip));
+		return (int)m_clips.size() - 1;
+	}
+
+	// Starts a sound. pan goes from -1 (left) to 1 (right). Returns a voice handle for stop() and setVoice(), or -1.
+	int play(int soundID, float volume = 1.0f, float pan = 0.0f, bool loop = false) {
+		if (soundID < 0 || soundID >= (int)m_clips.size()) return -1;
+		AudioCommand command = { AUDIO_PLAY, m_nextHandle, m_clips[soundID].get() };
+		panGains(volume, pan, command.gainL, command.gainR);
+		command.loop = loop;
+		if (!send(command)) return -1;
+		return m_nextHandle++;
+	}
+
+	// Plays a sound at a world position, panned and faded by where it is relative to the listener.
+	int playAt(int soundID, SDL_FPoint worldPos, float volume = 1.0f, bool loop = false) {
+		float pan;
+		volume *= attenuation(worldPos, pan);
+		return play(soundID, volume, pan, loop);
+	}
+
+	void setVoice(int handle, float volume, float pan) {
+		AudioCommand command = { AUDIO_SET_VOICE, handle };
+		panGains(volume, pan, command.gainL, command.gainR);
+		send(command);
+	}
+
+	// For looping sounds that move (or a listener that does).
+	void moveVoice(int handle, SDL_FPoint worldPos, float volume = 1.0f) {
+		float pan;
+		volume *= attenuation(worldPos, pan);
+		setVoice(handle, volume, pan);
+	}
+
+	void stop(int handle) {
+		send({ AUDIO_STOP, handle });
+	}
+
+	void stopAll() {
+		send({ AUDIO_STOP_ALL });
+	}
+
+	void setMasterVolume(float volume) {
+		AudioCommand command = { AUDIO_MASTER_VOLUME };
+		command.gainL = command.gainR = volume;
+		send(command);
+	}
+
+	// Where the ears are (eg. the player), in world pixels.
+	void setListener(SDL_FPoint pos) {
+		m_listener = pos;
+	}
+
+	// Streams a 16 bit PCM WAV, replacing whatever music is playing.
+	bool playMusic(const std::string& path, bool loop = true) {
+		stopMusic();
+
+		m_musicFile = FileSystem::openAsset(path);
+		if (m_musicFile == nullptr || !findWavData(m_musicFile)) {
+			std::printf("Unable to stream music: %s\n", path.c_str());
+			closeMusic();
+			return false;
+		}
+		m_musicStream = SDL_NewAudioStream(AUDIO_S16LSB, m_musicChannels, m_musicRate, AUDIO_F32SYS, channels, m_spec.freq);
+		if (m_musicStream == nullptr) {
+			std::printf("Can't convert music %s: %s\n", path.c_str(), SDL_GetError());
+			closeMusic();
+			return false;
+		}
+		m_musicLoop = loop;
+		m_musicRead = 0;
+		m_musicFlushed = false;
+		m_musicRaw.resize(4096 * m_musicFrameBytes);
+		m_musicConverted.resize(8192 * channels);
+
+		send({ AUDIO_MUSIC_PLAY });
+		m_musicStarted = true;
+		update(); // Fill the ring before the callback gets to it
+		return true;
+	}
+
+	void stopMusic() {
+		if (!m_musicStarted) return;
+		m_musicStarted = false;
+		closeMusic();
+		//Everything written so far is thrown away by the callback, music written after this belongs to the next track.
+		AudioCommand command = { AUDIO_MUSIC_STOP };
+		command.position = m_music.getWriteCount();
+		send(command);
+	}
+
+	void setMusicVolume(float volume) {
+		AudioCommand command = { AUDIO_MUSIC_VOLUME };
+		command.gainL = command.gainR = volume;
+		send(command);
+	}
+
+	// Game thread, once a frame: tops up the music ring.
+	void update() {
+		while (m_musicStream != nullptr && m_music.writeAvailable() >= 1024) {
+			int available = SDL_AudioStreamAvailable(m_musicStream);
+			if (available <= 0) {
+				if (feedMusic()) continue;
+				if (!m_musicFlushed) {
+					SDL_AudioStreamFlush(m_musicStream); // Lets the resampler hand over its last few frames
+					m_musicFlushed = true;
+					continue;
+				}
+				//Played out, the callback stops once the ring runs dry.
+				closeMusic();
+				send({ AUDIO_MUSIC_END });
+				return;
+			}
+
+			size_t room = std::min(m_music.writeAvailable(), m_musicConverted.size());
+			int got = SDL_AudioStreamGet(m_musicStream, m_musicConverted.data(), (int)std::min((size_t)available, room * sizeof(float)));
+			if (got <= 0) break;
+			m_music.write(m_musicConverted.data(), (size_t)got / sizeof(float));
+		}
+	}
+
+	AudioStats getStats() const {
+		AudioStats stats;
+		double tickMs = 1000.0 / (double)SDL_GetPerformanceFrequency();
+		stats.callbackMs = m_lastTicks.load() * tickMs;
+		stats.peakCallbackMs = m_peakTicks.load() * tickMs;
+		stats.load = stats.callbackMs / (m_lastFrames.load() * 1000.0 / m_spec.freq + 1e-9);
+		stats.underruns = m_underruns.load();
+		stats.droppedCommands = m_droppedCommands + m_voicesFull.load();
+		stats.activeVoices = m_activeVoices.load();
+		return stats;
+	}
+
+	// The callback's side: writes frames of float stereo into out. Only ever call it from one thread at a time, and
+	// not while the device is open.
+	void mix(float* out, int frames) {
+		Uint64 start = SDL_GetPerformanceCounter();
+		processCommands();
+
+		int done = 0;
+		while (done < frames) {
+			int n = std::min(frames - done, blockFrames);
+			mixBlock(out + done * channels, n);
+			done += n;
+		}
+
+		Uint64 ticks = SDL_GetPerformanceCounter() - start;
+		m_lastTicks = ticks;
+		m_lastFrames = frames;
+		if (ticks > m_peakTicks.load()) m_peakTicks = ticks;
+	}
+
+	float hearingRange = 480.0f; // World pixels before a positioned sound fades out completely
+
+private:
+	enum AudioCommandType {
+		AUDIO_PLAY,
+		AUDIO_STOP,
+		AUDIO_STOP_ALL,
+		AUDIO_SET_VOICE,
+		AUDIO_MASTER_VOLUME,
+		AUDIO_MUSIC_PLAY,
+		AUDIO_MUSIC_STOP,
+		AUDIO_MUSIC_END,
+		AUDIO_MUSIC_VOLUME
+	};
+
+	struct AudioCommand {
+		AudioCommandType type;
+		int handle = -1;
+		const SoundClip* clip = nullptr;
+		float gainL = 1.0f, gainR = 1.0f;
+		bool loop = false;
+		size_t position = 0; // AUDIO_MUSIC_STOP: music ring write count at the stop
+	};
+
+	struct Voice {
+		const SoundClip* clip = nullptr; // nullptr when free
+		int handle = -1;
+		size_t pos = 0; // Frame
+		float gainL = 0, gainR = 0; // Ramped towards the targets over a block, so changes don't click
+		float targetL = 0, targetR = 0;
+		bool loop = false;
+		bool stopping = false; // Fading out over a block before it's freed
+	};
+
+	static void callback(void* userdata, Uint8* stream, int length) {
+		((AudioMixer*)userdata)->mix((float*)stream, length / (int)(sizeof(float) * channels));
+	}
+
+	bool send(const AudioCommand& command) {
+		if (!m_commands.push(command)) {
+			m_droppedCommands++;
+			return false;
+		}
+		return true;
+	}
+
+	// Equal power panning.
+	static void panGains(float volume, float pan, float& left, float& right) {
+		float angle = (std::min(std::max(pan, -1.0f), 1.0f) + 1.0f) * 0.25f * 3.14159265f;
+		left = volume * std::cos(angle);
+		right = volume * std::sin(angle);
+	}
+
+	float attenuation(SDL_FPoint worldPos, float& pan) const {
+		float dx = worldPos.x - m_listener.x, dy = worldPos.y - m_listener.y;
+		float distance = std::sqrt(dx * dx + dy * dy);
+		pan = std::min(std::max(dx / (hearingRange * 0.5f), -1.0f), 1.0f);
+		return std::max(0.0f, 1.0f - distance / hearingRange);
+	}
+
+	//Callback thread from here down (plus the music helpers, which are game thread only).
+
+	void processCommands() {
+		AudioCommand command;
+		while (m_commands.pop(command)) {
+			switch (command.type) {
+			case AUDIO_PLAY: {
+				Voice* voice = nullptr;
+				for (Voice& v : m_voices) {
+					if (v.clip == nullptr) { voice = &v; break; }
+				}
+				if (voice == nullptr) {
+					m_voicesFull++;
+					break;
+				}
+				voice->clip = command.clip;
+				voice->handle = command.handle;
+				voice->pos = 0;
+				voice->gainL = voice->targetL = command.gainL; // Starts at full level, a sound's attack is part of the sound
+				voice->gainR = voice->targetR = command.gainR;
+				voice->loop = command.loop;
+				voice->stopping = false;
+				break;
+			}
+			case AUDIO_STOP:
+			case AUDIO_SET_VOICE:
+				for (Voice& v : m_voices) {
+					if (v.clip == nullptr || v.handle != command.handle) continue;
+					if (command.type == AUDIO_STOP) {
+						v.targetL = v.targetR = 0.0f;
+						v.stopping = true;
+					}
+					else {
+						v.targetL = command.gainL;
+						v.targetR = command.gainR;
+					}
+				}
+				break;
+			case AUDIO_STOP_ALL:
+				for (Voice& v : m_voices) {
+					v.targetL = v.targetR = 0.0f;
+					v.stopping = true;
+				}
+				break;
+			case AUDIO_MASTER_VOLUME:
+				m_masterVolume = command.gainL;
+				break;
+			case AUDIO_MUSIC_PLAY:
+				m_musicPlaying = true;
+				m_musicEnding = false;
+				break;
+			case AUDIO_MUSIC_STOP:
+				//Already past it when the old track ran into the next one's samples before this arrived, nothing left to drop then.
+				if (command.position > m_music.getReadCount()) {
+					m_music.skip(command.position - m_music.getReadCount());
+				}
+				m_musicPlaying = false;
+				break;
+			case AUDIO_MUSIC_END:
+				m_musicEnding = true;
+				break;
+			case AUDIO_MUSIC_VOLUME:
+				m_musicVolume = command.gainL;
+				break;
+			}
+		}
+	}
+
+	void mixBlock(float* out, int frames) {
+		std::memset(out, 0, sizeof(float) * frames * channels);
+
+		if (m_musicPlaying) {
+			size_t wanted = (size_t)frames * channels;
+			size_t got = m_music.read(m_scratch.data(), wanted);
+			got -= got % channels;
+			for (size_t i = 0; i < got; i++) {
+				out[i] = m_scratch[i] * m_musicVolume;
+			}
+			if (got < wanted) {
+				if (m_musicEnding) m_musicPlaying = false;
+				else m_underruns++;
+			}
+		}
+
+		int active = 0;
+		float ramp = 1.0f / frames;
+		for (Voice& v : m_voices) {
+			if (v.clip == nullptr) continue;
+			active++;
+
+			float stepL = (v.targetL - v.gainL) * ramp, stepR = (v.targetR - v.gainR) * ramp;
+			const float* samples = v.clip->samples.data();
+			int i = 0;
+			while (i < frames && v.clip != nullptr) {
+				size_t count = std::min((size_t)(frames - i), v.clip->frames - v.pos);
+				const float* in = samples + v.pos * channels;
+				float* o = out + i * channels;
+				for (size_t f = 0; f < count; f++) {
+					v.gainL += stepL;
+					v.gainR += stepR;
+					o[f * 2] += in[f * 2] * v.gainL;
+					o[f * 2 + 1] += in[f * 2 + 1] * v.gainR;
+				}
+				i += (int)count;
+				v.pos += count;
+				if (v.pos >= v.clip->frames) {
+					if (v.loop && v.clip->frames > 0) v.pos = 0;
+					else v.clip = nullptr;
+				}
+			}
+			v.gainL = v.targetL;
+			v.gainR = v.targetR;
+			if (v.stopping) v.clip = nullptr; // Faded to silence over this block
+		}
+		m_activeVoices = active;
+
+		for (int i = 0; i < frames * channels; i++) {
+			out[i] = std::min(std::max(out[i] * m_masterVolume, -1.0f), 1.0f);
+		}
+	}
+
+	// Reads the fmt and data chunk headers, leaving the file at the start of the samples.
+	bool findWavData(SDL_RWops* file) {
+		char riff[12];
+		if (SDL_RWread(file, riff, 1, 12) != 12 || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+			return false;
+		}
+		bool haveFormat = false;
+		uint8_t chunk[8];
+		while (SDL_RWread(file, chunk, 1, 8) == 8) {
+			uint32_t size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+			if (std::memcmp(chunk, "fmt ", 4) == 0) {
+				uint8_t fmt[16];
+				if (size < 16 || SDL_RWread(file, fmt, 1, 16) != 16) return false;
+				int format = fmt[0] | (fmt[1] << 8);
+				m_musicChannels = fmt[2] | (fmt[3] << 8);
+				m_musicRate = (int)(fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24));
+				int bits = fmt[14] | (fmt[15] << 8);
+				if (format != 1 || bits != 16 || m_musicChannels < 1 || m_musicChannels > 2) {
+					std::printf("Only 16 bit PCM mono or stereo music can be streamed\n");
+					return false;
+				}
+				m_musicFrameBytes = 2 * m_musicChannels;
+				SDL_RWseek(file, (size - 16) + (size & 1), RW_SEEK_CUR);
+				haveFormat = true;
+			}
+			else if (std::memcmp(chunk, "data", 4) == 0) {
+				if (!haveFormat) return false;
+				m_musicDataStart = SDL_RWtell(file);
+				m_musicDataSize = size - size % m_musicFrameBytes;
+				return true;
+			}
+			else {
+				SDL_RWseek(file, size + (size & 1), RW_SEEK_CUR);
+			}
+		}
+		return false;
+	}
+
+	// Puts the next chunk of the file into the converter. False at the end of a track that doesn't loop.
+	bool feedMusic() {
+		if (m_musicRead >= m_musicDataSize) {
+			if (!m_musicLoop || m_musicDataSize == 0) return false;
+			SDL_RWseek(m_musicFile, m_musicDataStart, RW_SEEK_SET);
+			m_musicRead = 0;
+		}
+		size_t bytes = (size_t)std::min<Sint64>((Sint64)m_musicRaw.size(), m_musicDataSize - m_musicRead);
+		size_t got = SDL_RWread(m_musicFile, m_musicRaw.data(), 1, bytes);
+		if (got == 0) {
+			m_musicRead = m_musicDataSize; // Shorter than its header said
+			return m_musicLoop && feedMusic();
+		}
+		m_musicRead += got;
+		return SDL_AudioStreamPut(m_musicStream, m_musicRaw.data(), (int)got) == 0;
+	}
+
+	void closeMusic() {
+		if (m_musicStream) SDL_FreeAudioStream(m_musicStream);
+		if (m_musicFile) SDL_RWclose(m_musicFile);
+		m_musicStream = nullptr;
+		m_musicFile = nullptr;
+	}
+
+	SDL_AudioDeviceID m_device = 0;
+	SDL_AudioSpec m_spec = {};
+
+	//Game thread.
+	std::vector<std::unique_ptr<SoundClip>> m_clips;
+	int m_nextHandle = 0;
+	SDL_FPoint m_listener = { 0, 0 };
+	uint64_t m_droppedCommands = 0;
+
+	SDL_RWops* m_musicFile = nullptr;
+	SDL_AudioStream* m_musicStream = nullptr;
+	Sint64 m_musicDataStart = 0, m_musicDataSize = 0, m_musicRead = 0;
+	int m_musicChannels = 2, m_musicRate = 44100, m_musicFrameBytes = 4;
+	bool m_musicStarted = false; // Until stopMusic(), even once a track has played out
+	bool m_musicLoop = true, m_musicFlushed = false;
+	std::vector<Uint8> m_musicRaw;
+	std::vector<float> m_musicConverted;
+
+	//Shared, lock-free.
+	SpscRing<AudioCommand> m_commands;
+	SpscRing<float> m_music; // Interleaved stereo, about 1.4s at 48kHz
+
+	//Callback thread.
+	Voice m_voices[maxVoices];
+	std::vector<float> m_scratch;
+	float m_masterVolume = 1.0f, m_musicVolume = 0.6f;
+	bool m_musicPlaying = false, m_musicEnding = false;
+
+	//Written by the callback, read by getStats().
+	std::atomic<uint64_t> m_lastTicks{ 0 }, m_peakTicks{ 0 };
+	std::atomic<int> m_lastFrames{ blockFrames };
+	std::atomic<uint64_t> m_underruns{ 0 }, m_voicesFull{ 0 };
+	std::atomic<int> m_activeVoices{ 0 };
+};
+
+#endif
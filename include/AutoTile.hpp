@@ -0,0 +1,256 @@
+#ifndef AUTOTILE_HPP
+#define AUTOTILE_HPP
+
+#include "mapReader.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+//Neighbour bits of the 8-way blob mask, clockwise from north.
+enum AutoTileNeighbour : uint8_t {
+	AT_N = 1 << 0,
+	AT_NE = 1 << 1,
+	AT_E = 1 << 2,
+	AT_SE = 1 << 3,
+	AT_S = 1 << 4,
+	AT_SW = 1 << 5,
+	AT_W = 1 << 6,
+	AT_NW = 1 << 7
+};
+
+//Maps a neighbour bitmask to a subTexture ID in a TextureAtlas.
+//The lookup is indexed by the raw 8-bit mask and pre-filled through the corner reduction, so resolving a tile is a single table read.
+class AutoTileRules {
+public:
+	AutoTileRules(std::string atlasName = "", int defaultID = 0) : atlasName(atlasName) {
+		m_lookup.fill(defaultID);
+	}
+
+	// Binds a reduced mask (corners only set when both touching edges are set) to a textureID.
+	void addRule(uint8_t mask, int textureID) {
+		for (int raw = 0; raw < 256; raw++) {
+			if (reduceMask((uint8_t)raw) == mask) {
+				m_lookup[raw] = textureID;
+			}
+		}
+	}
+
+	// Binds every raw mask with the given cardinal (N/E/S/W) bits to a textureID, ignoring corners.
+	void addCardinalRule(uint8_t cardinalMask, int textureID) {
+		const uint8_t cardinals = AT_N | AT_E | AT_S | AT_W;
+		for (int raw = 0; raw < 256; raw++) {
+			if ((raw & cardinals) == cardinalMask) {
+				m_lookup[raw] = textureID;
+			}
+		}
+	}
+
+	int resolve(uint8_t rawMask) const {
+		return m_lookup[rawMask];
+	}
+
+	// A corner neighbour only matters when both edges next to it are connected (the 47 tile blob rule).
+	static uint8_t reduceMask(uint8_t raw) {
+		uint8_t mask = raw & (AT_N | AT_E | AT_S | AT_W);
+		if ((raw & AT_NE) && (raw & AT_N) && (raw & AT_E)) mask |= AT_NE;
+		if ((raw & AT_SE) && (raw & AT_S) && (raw & AT_E)) mask |= AT_SE;
+		if ((raw & AT_SW) && (raw & AT_S) && (raw & AT_W)) mask |= AT_SW;
+		if ((raw & AT_NW) && (raw & AT_N) && (raw & AT_W)) mask |= AT_NW;
+		return mask;
+	}
+
+	// Rules for a 3x3 edge set laid out like Grass_Tiles_1 (see grass_cheatsheet.png), where topLeftID is the
+	// subTexture ID of the top left corner and atlasColumns is the number of subTextures per atlas row.
+	// Strips and single tiles have no art in these sets so they fall back to the middle tile.
+	static AutoTileRules edgeSet3x3(std::string atlasName, int topLeftID, int atlasColumns) {
+		int row0 = topLeftID, row1 = topLeftID + atlasColumns, row2 = topLeftID + atlasColumns * 2;
+		AutoTileRules rules(atlasName, row1 + 1);
+
+		rules.addCardinalRule(AT_E | AT_S, row0);					//Top left
+		rules.addCardinalRule(AT_E | AT_S | AT_W, row0 + 1);		//Top
+		rules.addCardinalRule(AT_S | AT_W, row0 + 2);				//Top right
+		rules.addCardinalRule(AT_N | AT_E | AT_S, row1);			//Left
+		rules.addCardinalRule(AT_N | AT_E | AT_S | AT_W, row1 + 1);	//Middle
+		rules.addCardinalRule(AT_N | AT_S | AT_W, row1 + 2);		//Right
+		rules.addCardinalRule(AT_N | AT_E, row2);					//Bottom left
+		rules.addCardinalRule(AT_N | AT_E | AT_W, row2 + 1);		//Bottom
+		rules.addCardinalRule(AT_N | AT_W, row2 + 2);				//Bottom right
+		return rules;
+	}
+
+public:
+	std::string atlasName; // The TextureAtlas the resolved IDs refer to.
+
+private:
+	std::array<int, 256> m_lookup;
+};
+
+//Resolves plain terrain tiles (eg. grass(x,y)) into textureAtlas subTextures from their neighbours, so maps only need to store terrain types.
+//Terrains are kept in a byte grid so the full pass over the map, and the 3x3 repair after an edit, never touch a string.
+class AutoTiler {
+public:
+	// Registers a terrain name to be auto tiled with the given rules. Must be called before resolve().
+	void addTerrain(std::string terrainName, AutoTileRules rules) {
+		if (m_terrainIDs.count(terrainName)) {
+			std::printf("The terrain %s is already auto tiled\n", terrainName.c_str());
+			return;
+		}
+		if (m_rules.size() >= 255) {
+			std::printf("Too many auto tiled terrains, %s was not added\n", terrainName.c_str());
+			return;
+		}
+		m_rules.push_back(rules);
+		m_terrainNames.push_back(terrainName);
+		m_terrainIDs[terrainName] = (uint8_t)m_rules.size(); // 0 is reserved for "no terrain"
+	}
+
+	// Builds the terrain grid from a freshly loaded map and resolves every plain terrain tile in one pass.
+	// Resolved tiles keep their terrain name, so a map restored from a save or journal can be resolved again.
+	void resolve(Map& map) {
+		m_mapSize = map.getMapSize();
+		m_tileSize = map.getTileSize();
+		m_terrain.assign((size_t)m_mapSize.x * m_mapSize.y, 0);
+
+		//Tiles usually come in long runs of the same terrain, so only hit the hash map when the name changes.
+		const std::string* lastName = nullptr;
+		uint8_t lastID = 0;
+		for (int i = 0; i < (int)m_terrain.size(); i++) {
+			int tileIndex = map.tileGrid[i];
+			if (tileIndex < 0) continue;
+
+			const Tile& tile = map.tileMap[tileIndex];
+			if (lastName == nullptr || tile.textureName != *lastName) {
+				auto it = m_terrainIDs.find(tile.textureName);
+				lastID = (it != m_terrainIDs.end()) ? it->second : 0;
+				lastName = &tile.textureName;
+			}
+			m_terrain[i] = lastID;
+		}
+
+		for (int y = 0; y < m_mapSize.y; y++) {
+			for (int x = 0; x < m_mapSize.x; x++) {
+				resolveTile(map, x, y);
+			}
+		}
+	}
+
+	// Changes the terrain at grid pos (x, y) and re-resolves only the 3x3 neighbourhood around it.
+	void setTerrain(Map& map, int x, int y, const std::string& terrainName) {
+		int tileIndex = map.getGroundTile(x, y);
+		if (tileIndex < 0) {
+			std::printf("No ground tile at (%d, %d) to change\n", x, y);
+			return;
+		}
+
+		auto it = m_terrainIDs.find(terrainName);
+		m_terrain[y * m_mapSize.x + x] = (it != m_terrainIDs.end()) ? it->second : 0;
+
+		//A painted tile is always a plain terrain tile, any previous resolve or explicit atlas texture no longer applies.
+		Tile tile = map.tileMap[tileIndex];
+		tile.textureName = terrainName;
+		tile.usingTextureAtlas = false;
+		tile.autoTiled = false;
+		map.setGroundTile(x, y, tile);
+
+		for (int ny = y - 1; ny <= y + 1; ny++) {
+			for (int nx = x - 1; nx <= x + 1; nx++) {
+				if (nx < 0 || ny < 0 || nx >= m_mapSize.x || ny >= m_mapSize.y) continue;
+				resolveTile(map, nx, ny);
+				map.markEdited(nx, ny);
+			}
+		}
+	}
+
+	// Re-reads the terrain of every changed cell (eg. after Map::hotReload() replaced their tiles) and re-resolves the
+	// 3x3 neighbourhood around each. All the terrains are read before anything is resolved, as resolving rewrites tiles.
+	void refresh(Map& map, const std::vector<TileChange>& changes) {
+		for (const TileChange& change : changes) {
+			int x = change.cell.x, y = change.cell.y;
+			if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) continue;
+
+			int tileIndex = map.getGroundTile(x, y);
+			uint8_t terrain = 0;
+			if (tileIndex >= 0) {
+				auto it = m_terrainIDs.find(map.tileMap[tileIndex].textureName);
+				terrain = (it != m_terrainIDs.end()) ? it->second : 0;
+			}
+			m_terrain[y * m_mapSize.x + x] = terrain;
+		}
+
+		for (const TileChange& change : changes) {
+			for (int ny = change.cell.y - 1; ny <= change.cell.y + 1; ny++) {
+				for (int nx = change.cell.x - 1; nx <= change.cell.x + 1; nx++) {
+					if (nx < 0 || ny < 0 || nx >= m_mapSize.x || ny >= m_mapSize.y) continue;
+					resolveTile(map, nx, ny);
+					map.markEdited(nx, ny);
+				}
+			}
+		}
+	}
+
+	// The atlas a tile is drawn from. Auto tiled tiles are named after their terrain, their atlas comes from its rules.
+	const std::string& getAtlasName(const Tile& tile) const {
+		if (!tile.autoTiled || m_tileSize.x <= 0 || m_tileSize.y <= 0) return tile.textureName;
+		int x = tile.pos.x / m_tileSize.x, y = tile.pos.y / m_tileSize.y;
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return tile.textureName;
+		uint8_t id = m_terrain[y * m_mapSize.x + x];
+		return id ? m_rules[id - 1].atlasName : tile.textureName;
+	}
+
+	// Returns the terrain name at grid pos (x, y), or an empty string for a terrain that isn't auto tiled.
+	const std::string& getTerrain(int x, int y) const {
+		static const std::string none;
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return none;
+		uint8_t id = m_terrain[y * m_mapSize.x + x];
+		return id ? m_terrainNames[id - 1] : none;
+	}
+
+private:
+	//Out of bounds cells count as connected so the map border doesn't get an edge drawn around it.
+	bool sameTerrain(int x, int y, uint8_t terrain) const {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) {
+			return true;
+		}
+		return m_terrain[y * m_mapSize.x + x] == terrain;
+	}
+
+	void resolveTile(Map& map, int x, int y) {
+		uint8_t terrain = m_terrain[y * m_mapSize.x + x];
+		if (terrain == 0) return;
+
+		int tileIndex = map.tileGrid[y * m_mapSize.x + x];
+		Tile& tile = map.tileMap[tileIndex];
+
+		//Tiles the map gave an explicit subTexture keep it, they only count as neighbours.
+		if (tile.usingTextureAtlas && !tile.autoTiled) return;
+
+		uint8_t mask = 0;
+		if (sameTerrain(x, y - 1, terrain)) mask |= AT_N;
+		if (sameTerrain(x + 1, y - 1, terrain)) mask |= AT_NE;
+		if (sameTerrain(x + 1, y, terrain)) mask |= AT_E;
+		if (sameTerrain(x + 1, y + 1, terrain)) mask |= AT_SE;
+		if (sameTerrain(x, y + 1, terrain)) mask |= AT_S;
+		if (sameTerrain(x - 1, y + 1, terrain)) mask |= AT_SW;
+		if (sameTerrain(x - 1, y, terrain)) mask |= AT_W;
+		if (sameTerrain(x - 1, y - 1, terrain)) mask |= AT_NW;
+
+		//The name stays the terrain's so saves, the journal and the map writer keep the terrain, see getAtlasName().
+		tile.textureID = m_rules[terrain - 1].resolve(mask);
+		tile.usingTextureAtlas = true;
+		tile.autoTiled = true;
+	}
+
+private:
+	std::vector<AutoTileRules> m_rules;
+	std::vector<std::string> m_terrainNames;
+	std::unordered_map<std::string, uint8_t> m_terrainIDs;
+
+	std::vector<uint8_t> m_terrain; // Terrain ID per grid cell, 0 if the cell isn't auto tiled.
+	SDL_Point m_mapSize = { 0, 0 };
+	SDL_Point m_tileSize = { 0, 0 };
+};
+
+#endif
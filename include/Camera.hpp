@@ -0,0 +1,71 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include "SDL.h"
+
+#include <cmath>
+#include <algorithm>
+
+//Maps world pixels to screen pixels. pos is the world position at the top left of the view, zoom is screen pixels per
+//world pixel (below 1 is zoomed out).
+class Camera {
+public:
+	Camera() {}
+	Camera(SDL_Point viewSize) : viewSize(viewSize) {}
+
+	void centreOn(SDL_FPoint worldPos) {
+		pos.x = worldPos.x - viewSize.x * 0.5f / zoom;
+		pos.y = worldPos.y - viewSize.y * 0.5f / zoom;
+	}
+
+	SDL_FPoint getCentre() const {
+		return { pos.x + viewSize.x * 0.5f / zoom, pos.y + viewSize.y * 0.5f / zoom };
+	}
+
+	// Changes the zoom, keeping the centre of the view where it is.
+	void setZoom(float newZoom) {
+		SDL_FPoint centre = getCentre();
+		zoom = std::min(std::max(newZoom, minZoom), maxZoom);
+		centreOn(centre);
+	}
+
+	SDL_FPoint worldToScreen(SDL_FPoint world) const {
+		return { (world.x - pos.x) * zoom, (world.y - pos.y) * zoom };
+	}
+
+	SDL_FPoint screenToWorld(SDL_FPoint screen) const {
+		return { screen.x / zoom + pos.x, screen.y / zoom + pos.y };
+	}
+
+	SDL_FRect worldToScreen(const SDL_FRect& world) const {
+		return { (world.x - pos.x) * zoom, (world.y - pos.y) * zoom, world.w * zoom, world.h * zoom };
+	}
+
+	// Whole pixel version for tiles. Both edges are rounded, so neighbouring tiles meet without gaps at any zoom.
+	SDL_Rect worldToScreenRect(const SDL_FRect& world) const {
+		int x0 = (int)std::floor((world.x - pos.x) * zoom + 0.5f);
+		int y0 = (int)std::floor((world.y - pos.y) * zoom + 0.5f);
+		int x1 = (int)std::floor((world.x + world.w - pos.x) * zoom + 0.5f);
+		int y1 = (int)std::floor((world.y + world.h - pos.y) * zoom + 0.5f);
+		return { x0, y0, x1 - x0, y1 - y0 };
+	}
+
+	// The part of the world in view.
+	SDL_FRect getViewRect() const {
+		return { pos.x, pos.y, viewSize.x / zoom, viewSize.y / zoom };
+	}
+
+	bool isVisible(const SDL_FRect& world) const {
+		SDL_FRect view = getViewRect();
+		return world.x < view.x + view.w && world.x + world.w > view.x && world.y < view.y + view.h && world.y + world.h > view.y;
+	}
+
+	SDL_FPoint pos = { 0, 0 };
+	float zoom = 1.0f;
+	SDL_Point viewSize = { 800, 600 }; // Screen pixels
+
+	static constexpr float minZoom = 1.0f / 16.0f;
+	static constexpr float maxZoom = 2.0f;
+};
+
+#endif
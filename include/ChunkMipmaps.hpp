@@ -0,0 +1,334 @@
+#ifndef CHUNKMIPMAPS_HPP
+#define CHUNKMIPMAPS_HPP
+
+#include "SDL.h"
+
+#include "mapReader.hpp"
+#include "Camera.hpp"
+#include "MemoryTracker.hpp"
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+//Pre-rendered, downscaled images of the map's ground for zoomed out views.
+//A chunk is drawn at full size into a scratch target and halved into mip levels 1 (1/2 size) to levelCount
+//(1/2^levelCount). A zoomed out view draws one texture per chunk from the level matching the zoom instead of a copy per
+//tile. Level textures are only created for chunks that get drawn at that level, and the least recently drawn ones are
+//destroyed once they take more than maxResidentBytes, so big maps only hold what's been in view lately.
+//Every chunk also has a small rect in the minimap: the coarsest level laid out like the map, downscaled to fit in
+//maxMinimapSide. It stands in for chunks whose level textures aren't built yet, and when it isn't downscaled it's what
+//the furthest zoom level draws in a single copy.
+//Chunks are rebuilt when their Map::getChunkRevision() changes, so an edit only redraws that chunk's levels.
+//Only ground tiles are baked; entities overlap chunk borders and are few enough to draw on their own.
+
+class ChunkMipmaps {
+public:
+	using TileDrawer = std::function<void(const Tile& tile, const SDL_Rect& dest)>;
+
+	static constexpr int maxLevels = 8;
+	static constexpr int maxMinimapSide = 1024;
+
+	ChunkMipmaps(SDL_Renderer* renderer, const Map& map, TileDrawer drawTile, int levelCount = 4)
+		: renderer(renderer), m_map(map), m_drawTile(drawTile), m_levelCount(std::min(std::max(levelCount, 1), maxLevels)) {
+		m_chunkCount = map.getChunkCount();
+		SDL_Point tileSize = map.getTileSize();
+		m_chunkPixels = { Map::chunkSize * tileSize.x, Map::chunkSize * tileSize.y };
+		m_chunks.resize((size_t)m_chunkCount.x * m_chunkCount.y);
+		if (renderer == nullptr || m_chunks.empty()) return;
+
+		//One set of level sized scratch targets is shared by every chunk, for halving through levels it doesn't keep.
+		m_scratch = createTarget(m_chunkPixels.x, m_chunkPixels.y);
+		for (int level = 1; level <= m_levelCount; level++) {
+			m_scratchLevels.push_back(createTarget(levelSize(level).x, levelSize(level).y));
+		}
+
+		SDL_Point coarsest = levelSize(m_levelCount);
+		int64_t fullW = (int64_t)coarsest.x * m_chunkCount.x, fullH = (int64_t)coarsest.y * m_chunkCount.y;
+		double fit = std::min(1.0, (double)maxMinimapSide / (double)std::max(fullW, fullH));
+		m_minimapSize = { std::max((int)(fullW * fit), 1), std::max((int)(fullH * fit), 1) };
+		m_minimapFullSize = fit >= 1.0;
+		m_minimap = createTarget(m_minimapSize.x, m_minimapSize.y);
+	}
+
+	~ChunkMipmaps() {
+		for (Chunk& chunk : m_chunks) {
+			for (SDL_Texture* tex : chunk.levels) {
+				MemoryTracker::destroyTexture(tex);
+			}
+		}
+		for (SDL_Texture* tex : m_scratchLevels) {
+			MemoryTracker::destroyTexture(tex);
+		}
+		MemoryTracker::destroyTexture(m_scratch);
+		MemoryTracker::destroyTexture(m_minimap);
+	}
+
+	ChunkMipmaps(const ChunkMipmaps&) = delete;
+	ChunkMipmaps& operator=(const ChunkMipmaps&) = delete;
+
+	// Rebuilds up to maxChunks out of date chunks (-1 for all of them) and returns how many were rebuilt.
+	int update(int maxChunks = -1) {
+		if (!isReady()) return 0;
+
+		int rebuilt = 0;
+		for (int cy = 0; cy < m_chunkCount.y; cy++) {
+			for (int cx = 0; cx < m_chunkCount.x; cx++) {
+				if (maxChunks >= 0 && rebuilt >= maxChunks) return rebuilt;
+				if (isCurrent(cx, cy)) continue;
+				buildChunk(cx, cy);
+				rebuilt++;
+			}
+		}
+		return rebuilt;
+	}
+
+	// Marks every chunk out of date, eg. after the render targets were lost (Window::renderTargetsReset).
+	void invalidateAll() {
+		for (Chunk& chunk : m_chunks) {
+			chunk.built = false;
+		}
+	}
+
+	// The mip level to draw at a zoom: the smallest images that still have at least one texel per screen pixel.
+	// 0 means the view is close enough that the tiles should be drawn one by one.
+	int levelForZoom(float zoom) const {
+		int level = 0;
+		while (level < m_levelCount && zoom <= 1.0f / (float)(2 << level)) {
+			level++;
+		}
+		return level;
+	}
+
+	// Draws the ground in view at a mip level (1 to getLevelCount()), modulated by tint.
+	// Up to maxBuildsPerDraw chunks get their level texture made here, the rest show their part of the minimap meanwhile.
+	void draw(const Camera& camera, int level, SDL_Color tint) {
+		if (!isReady() || level < 1) return;
+		level = std::min(level, m_levelCount);
+		m_frame++;
+
+		if (level == m_levelCount && m_minimapFullSize) {
+			//The coarsest level is already one image for the whole map.
+			SDL_FRect world = { 0, 0, (float)m_chunkPixels.x * m_chunkCount.x, (float)m_chunkPixels.y * m_chunkCount.y };
+			SDL_Rect dest = camera.worldToScreenRect(world);
+			SDL_SetTextureColorMod(m_minimap, tint.r, tint.g, tint.b);
+			SDL_RenderCopy(renderer, m_minimap, NULL, &dest);
+			return;
+		}
+
+		SDL_FRect view = camera.getViewRect();
+		int x0 = std::max(0, (int)std::floor(view.x / m_chunkPixels.x));
+		int y0 = std::max(0, (int)std::floor(view.y / m_chunkPixels.y));
+		int x1 = std::min(m_chunkCount.x - 1, (int)std::floor((view.x + view.w) / m_chunkPixels.x));
+		int y1 = std::min(m_chunkCount.y - 1, (int)std::floor((view.y + view.h) / m_chunkPixels.y));
+		int builds = 0;
+		SDL_SetTextureColorMod(m_minimap, tint.r, tint.g, tint.b);
+		for (int cy = y0; cy <= y1; cy++) {
+			for (int cx = x0; cx <= x1; cx++) {
+				Chunk& chunk = m_chunks[cy * m_chunkCount.x + cx];
+				SDL_Texture*& tex = chunk.levels[level - 1];
+				if (tex == nullptr && builds < maxBuildsPerDraw) {
+					tex = makeResident(levelSize(level));
+					if (tex != nullptr) {
+						buildChunk(cx, cy);
+						builds++;
+					}
+				}
+				chunk.lastUsed = m_frame;
+
+				SDL_FRect world = { (float)cx * m_chunkPixels.x, (float)cy * m_chunkPixels.y, (float)m_chunkPixels.x, (float)m_chunkPixels.y };
+				SDL_Rect dest = camera.worldToScreenRect(world);
+				if (tex != nullptr) {
+					SDL_SetTextureColorMod(tex, tint.r, tint.g, tint.b);
+					SDL_RenderCopy(renderer, tex, NULL, &dest);
+				}
+				else {
+					SDL_Rect src = minimapRect(cx, cy);
+					if (src.w > 0 && src.h > 0) SDL_RenderCopy(renderer, m_minimap, &src, &dest);
+				}
+			}
+		}
+	}
+
+	// Draws the whole map into dest (keeping its aspect ratio) with an outline around what the camera sees.
+	void drawMinimap(const SDL_Rect& dest, const Camera* camera = nullptr) {
+		if (m_minimap == nullptr) return;
+
+		float worldW = (float)m_chunkPixels.x * m_chunkCount.x, worldH = (float)m_chunkPixels.y * m_chunkCount.y;
+		float scale = std::min(dest.w / worldW, dest.h / worldH);
+		SDL_Rect mapRect = { dest.x, dest.y, (int)(worldW * scale), (int)(worldH * scale) };
+
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+		SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+		SDL_RenderFillRect(renderer, &mapRect);
+		SDL_SetTextureColorMod(m_minimap, 255, 255, 255);
+		SDL_RenderCopy(renderer, m_minimap, NULL, &mapRect);
+
+		if (camera != nullptr) {
+			SDL_FRect view = camera->getViewRect();
+			SDL_Rect viewRect = { mapRect.x + (int)(view.x * scale), mapRect.y + (int)(view.y * scale), std::max(1, (int)(view.w * scale)), std::max(1, (int)(view.h * scale)) };
+			SDL_RenderSetClipRect(renderer, &mapRect);
+			SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+			SDL_RenderDrawRect(renderer, &viewRect);
+			SDL_RenderSetClipRect(renderer, NULL);
+		}
+	}
+
+	// Bytes held by chunk level textures right now (not counting the scratch targets and the minimap).
+	size_t getResidentBytes() const {
+		return m_residentBytes;
+	}
+
+	int getLevelCount() const {
+		return m_levelCount;
+	}
+
+	SDL_Renderer* renderer;
+	size_t maxResidentBytes = (size_t)32 << 20;
+	int maxBuildsPerDraw = 8;
+
+private:
+	struct Chunk {
+		SDL_Texture* levels[maxLevels] = {}; // levels[0] is mip level 1, nullptr until the chunk is drawn at that level
+		uint64_t lastUsed = 0; // m_frame of the last draw that used it
+		uint32_t revision = 0;
+		bool built = false; // Its minimap rect and every level it has are up to date with revision
+	};
+
+	bool isReady() const {
+		return m_scratch != nullptr && m_minimap != nullptr && (int)m_scratchLevels.size() == m_levelCount;
+	}
+
+	bool isCurrent(int cx, int cy) const {
+		const Chunk& chunk = m_chunks[cy * m_chunkCount.x + cx];
+		return chunk.built && chunk.revision == m_map.getChunkRevision(cx, cy);
+	}
+
+	SDL_Point levelSize(int level) const {
+		return { std::max(m_chunkPixels.x >> level, 1), std::max(m_chunkPixels.y >> level, 1) };
+	}
+
+	// The chunk's part of the minimap. Can be empty when the map is squeezed into fewer pixels than it has chunks.
+	SDL_Rect minimapRect(int cx, int cy) const {
+		int x0 = (int)((int64_t)cx * m_minimapSize.x / m_chunkCount.x), x1 = (int)((int64_t)(cx + 1) * m_minimapSize.x / m_chunkCount.x);
+		int y0 = (int)((int64_t)cy * m_minimapSize.y / m_chunkCount.y), y1 = (int)((int64_t)(cy + 1) * m_minimapSize.y / m_chunkCount.y);
+		return { x0, y0, x1 - x0, y1 - y0 };
+	}
+
+	// A new level texture of size, after destroying the least recently drawn ones to stay under maxResidentBytes.
+	// Textures drawn this frame are never destroyed, so nullptr if there's no room left without them.
+	SDL_Texture* makeResident(SDL_Point size) {
+		size_t bytes = (size_t)size.x * size.y * 4;
+		while (m_residentBytes + bytes > maxResidentBytes) {
+			int oldest = -1;
+			for (int i = 0; i < (int)m_resident.size(); i++) {
+				const Chunk& chunk = m_chunks[m_resident[i]];
+				if (chunk.lastUsed < m_frame && (oldest == -1 || chunk.lastUsed < m_chunks[m_resident[oldest]].lastUsed)) oldest = i;
+			}
+			if (oldest == -1) return nullptr;
+			evict(m_resident[oldest]);
+			m_resident[oldest] = m_resident.back();
+			m_resident.pop_back();
+		}
+
+		SDL_Texture* tex = createTarget(size.x, size.y);
+		if (tex == nullptr) return nullptr;
+		m_residentBytes += bytes;
+		return tex;
+	}
+
+	// Destroys every level texture of a chunk. The caller takes it off m_resident.
+	void evict(int index) {
+		for (int level = 1; level <= m_levelCount; level++) {
+			SDL_Texture*& tex = m_chunks[index].levels[level - 1];
+			if (tex == nullptr) continue;
+			m_residentBytes -= (size_t)levelSize(level).x * levelSize(level).y * 4;
+			MemoryTracker::destroyTexture(tex);
+			tex = nullptr;
+		}
+	}
+
+	SDL_Texture* createTarget(int w, int h) {
+		SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w, h);
+		if (tex == nullptr) {
+			std::printf("Failed to create a %dx%d chunk render target: %s\n", w, h, SDL_GetError());
+			return nullptr;
+		}
+		SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+		SDL_SetTextureScaleMode(tex, SDL_ScaleModeLinear); // Averages the texels when it's shrunk into the next level
+		MemoryTracker::trackTexture(tex);
+		return tex;
+	}
+
+	// Copies src over the whole of dst, alpha included.
+	void copyInto(SDL_Texture* dst, SDL_Texture* src, const SDL_Rect* dstRect) {
+		SDL_SetRenderTarget(renderer, dst);
+		SDL_SetTextureBlendMode(src, SDL_BLENDMODE_NONE);
+		SDL_SetTextureColorMod(src, 255, 255, 255);
+		SDL_RenderCopy(renderer, src, NULL, dstRect);
+		SDL_SetTextureBlendMode(src, SDL_BLENDMODE_BLEND);
+	}
+
+	void buildChunk(int cx, int cy) {
+		int index = cy * m_chunkCount.x + cx;
+		Chunk& chunk = m_chunks[index];
+		SDL_Texture* previousTarget = SDL_GetRenderTarget(renderer);
+
+		//Full size into the scratch target.
+		SDL_SetRenderTarget(renderer, m_scratch);
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+		SDL_RenderClear(renderer);
+		SDL_Point tileSize = m_map.getTileSize();
+		for (int y = 0; y < Map::chunkSize; y++) {
+			for (int x = 0; x < Map::chunkSize; x++) {
+				int tileIndex = m_map.getGroundTile(cx * Map::chunkSize + x, cy * Map::chunkSize + y);
+				if (tileIndex < 0) continue;
+				SDL_Rect dest = { x * tileSize.x, y * tileSize.y, tileSize.x, tileSize.y };
+				m_drawTile(m_map.tileMap[tileIndex], dest);
+			}
+		}
+
+		//Each level is the one above it at half size, into the chunk's own texture if it keeps that level.
+		bool resident = false;
+		SDL_Texture* source = m_scratch;
+		for (int level = 1; level <= m_levelCount; level++) {
+			SDL_Texture* target = chunk.levels[level - 1];
+			resident |= target != nullptr;
+			if (target == nullptr) target = m_scratchLevels[level - 1];
+			copyInto(target, source, NULL);
+			source = target;
+		}
+
+		SDL_Rect rect = minimapRect(cx, cy);
+		if (rect.w > 0 && rect.h > 0) {
+			copyInto(m_minimap, source, &rect);
+		}
+
+		SDL_SetRenderTarget(renderer, previousTarget);
+		chunk.built = true;
+		chunk.revision = m_map.getChunkRevision(cx, cy);
+		if (resident && std::find(m_resident.begin(), m_resident.end(), index) == m_resident.end()) {
+			m_resident.push_back(index);
+		}
+	}
+
+	const Map& m_map;
+	TileDrawer m_drawTile;
+	int m_levelCount;
+
+	SDL_Point m_chunkCount = { 0, 0 };
+	SDL_Point m_chunkPixels = { 0, 0 }; // Size of a chunk at full size
+	std::vector<Chunk> m_chunks;
+	std::vector<int> m_resident; // Chunks holding at least one level texture
+	size_t m_residentBytes = 0;
+	uint64_t m_frame = 0; // Counts draw() calls
+
+	SDL_Texture* m_scratch = nullptr;
+	std::vector<SDL_Texture*> m_scratchLevels; // m_scratchLevels[0] is mip level 1
+	SDL_Texture* m_minimap = nullptr; // Coarsest level of every chunk, laid out like the map and scaled to fit maxMinimapSide
+	SDL_Point m_minimapSize = { 0, 0 };
+	bool m_minimapFullSize = false; // Every chunk got its coarsest level at full size
+};
+
+#endif
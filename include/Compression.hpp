@@ -0,0 +1,144 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+//LZ4 block format compression (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+//Greedy single hash table matcher. It doesn't compress as tightly as the reference library, but the output is
+//standard LZ4 and decompression (the part that runs every launch) is a straight copy loop.
+class LZ4Block {
+public:
+	static std::vector<uint8_t> compress(const uint8_t* src, size_t srcSize) {
+		std::vector<uint8_t> out;
+		out.reserve(srcSize + srcSize / 255 + 16);
+
+		size_t anchor = 0;
+		if (srcSize > minInputForMatch) {
+			std::vector<int64_t> table((size_t)1 << hashBits, -1);
+			size_t matchLimit = srcSize - lastLiterals; // Matches must leave the last 5 bytes as literals
+			size_t searchLimit = srcSize - mfLimit; // and can't start in the last 12
+
+			size_t i = 0;
+			while (i < searchLimit) {
+				uint32_t sequence = read32(src + i);
+				uint32_t h = hash(sequence);
+				int64_t ref = table[h];
+				table[h] = (int64_t)i;
+
+				if (ref < 0 || i - (size_t)ref > maxOffset || read32(src + ref) != sequence) {
+					i++;
+					continue;
+				}
+
+				size_t matchLength = minMatch;
+				while (i + matchLength < matchLimit && src[ref + matchLength] == src[i + matchLength]) {
+					matchLength++;
+				}
+
+				writeSequence(out, src + anchor, i - anchor, (uint16_t)(i - (size_t)ref), matchLength);
+				i += matchLength;
+				anchor = i;
+			}
+		}
+
+		//The block always ends with a literal only sequence.
+		size_t literals = srcSize - anchor;
+		out.push_back((uint8_t)((literals >= 15 ? 15 : literals) << 4));
+		writeLength(out, literals);
+		out.insert(out.end(), src + anchor, src + srcSize);
+		return out;
+	}
+
+	// Decompresses a block into exactly dstSize bytes. Returns false on malformed input rather than overrunning either buffer.
+	static bool decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+		size_t ip = 0, op = 0;
+		while (ip < srcSize) {
+			uint8_t token = src[ip++];
+
+			size_t literals = token >> 4;
+			if (literals == 15 && !readLength(src, srcSize, ip, literals)) return false;
+			if (literals > srcSize - ip || literals > dstSize - op) return false;
+			std::memcpy(dst + op, src + ip, literals);
+			ip += literals;
+			op += literals;
+
+			if (ip == srcSize) break; // Last sequence has no match
+
+			if (srcSize - ip < 2) return false;
+			size_t offset = src[ip] | (src[ip + 1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > op) return false;
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !readLength(src, srcSize, ip, matchLength)) return false;
+			matchLength += minMatch;
+			if (matchLength > dstSize - op) return false;
+
+			uint8_t* out = dst + op;
+			const uint8_t* match = out - offset;
+			if (offset >= matchLength) {
+				std::memcpy(out, match, matchLength);
+			}
+			else {
+				//Overlapping copy repeats the last offset bytes, it has to go forwards a byte at a time.
+				for (size_t n = 0; n < matchLength; n++) out[n] = match[n];
+			}
+			op += matchLength;
+		}
+		return op == dstSize;
+	}
+
+private:
+	static constexpr size_t minMatch = 4;
+	static constexpr size_t lastLiterals = 5;
+	static constexpr size_t mfLimit = 12;
+	static constexpr size_t minInputForMatch = 13;
+	static constexpr size_t maxOffset = 65535;
+	static constexpr int hashBits = 16;
+
+	static uint32_t read32(const uint8_t* p) {
+		uint32_t v;
+		std::memcpy(&v, p, 4);
+		return v;
+	}
+
+	static uint32_t hash(uint32_t sequence) {
+		return (sequence * 2654435761u) >> (32 - hashBits);
+	}
+
+	// Lengths of 15 or more spill into extra bytes of 255 with the remainder last.
+	static void writeLength(std::vector<uint8_t>& out, size_t length) {
+		if (length < 15) return;
+		length -= 15;
+		while (length >= 255) {
+			out.push_back(255);
+			length -= 255;
+		}
+		out.push_back((uint8_t)length);
+	}
+
+	static bool readLength(const uint8_t* src, size_t srcSize, size_t& ip, size_t& length) {
+		uint8_t b;
+		do {
+			if (ip >= srcSize) return false;
+			b = src[ip++];
+			length += b;
+		} while (b == 255);
+		return true;
+	}
+
+	static void writeSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, uint16_t offset, size_t matchLength) {
+		size_t matchCode = matchLength - minMatch;
+		out.push_back((uint8_t)(((literalCount >= 15 ? 15 : literalCount) << 4) | (matchCode >= 15 ? 15 : matchCode)));
+		writeLength(out, literalCount);
+		out.insert(out.end(), literals, literals + literalCount);
+		out.push_back((uint8_t)offset);
+		out.push_back((uint8_t)(offset >> 8));
+		writeLength(out, matchCode);
+	}
+};
+
+#endif
@@ -0,0 +1,684 @@
+#ifndef EDITJOURNAL_HPP
+#define EDITJOURNAL_HPP
+
+#include "mapReader.hpp"
+#include "MemoryTracker.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+//Tile edits made in game go into an append-only journal file next to the map, one record per stroke, undo or redo.
+//Every record carries the cells it touched with what they were before and after, so replaying a run of records in order
+//always ends in the same map whatever it started from. That's what lets a MapCompactor fold the journal into the map file
+//in the background: the journal is set aside (rotated) when the map is copied, and only thrown away once the new map file
+//is in place. Dying at any point just means some records get replayed onto a map that already has them.
+
+enum JournalCellFlags : uint8_t {
+	JOURNAL_PRESENT = 1,
+	JOURNAL_ATLAS = 2,
+	JOURNAL_AUTOTILED = 4
+};
+
+//A ground cell's contents without the string, the name is an index into the journal's name table.
+struct JournalCell {
+	int32_t textureID = 0;
+	uint16_t name = 0;
+	uint8_t flags = 0; // JournalCellFlags, 0 for an empty cell
+};
+
+struct CellEdit {
+	int32_t x, y;
+	JournalCell before, after;
+};
+
+class EditJournal {
+public:
+	EditJournal(std::string path) : m_path(path) {}
+
+	~EditJournal() {
+		m_file.close();
+	}
+
+	EditJournal(const EditJournal&) = delete;
+	EditJournal& operator=(const EditJournal&) = delete;
+
+	// Applies whatever the journal (and a journal set aside by an unfinished compaction) holds to map, then opens it for
+	// appending. The cells it changed are added to changes. Returns how many records were replayed.
+	int replay(Map& map, std::vector<TileChange>& changes) {
+		int records = replayFile(rotatedPath(), map, changes) + replayFile(m_path, map, changes);
+		openForAppend();
+		return records;
+	}
+
+	// Strokes group cell edits into one undo step. Cells set outside a stroke get one of their own.
+	void beginStroke() {
+		if (m_stroking) return;
+		m_stroking = true;
+		m_stroke.clear();
+		m_strokeCells.clear();
+	}
+
+	// Sets the ground tile at grid pos (x, y), or clears it if tile is null, remembering what it was the first time a
+	// stroke touches it.
+	void set(Map& map, int x, int y, const Tile* tile, std::vector<TileChange>& changes) {
+		SDL_Point mapSize = map.getMapSize();
+		if (x < 0 || y < 0 || x >= mapSize.x || y >= mapSize.y) return;
+
+		bool single = !m_stroking;
+		if (single) beginStroke();
+		if (m_strokeCells.emplace(y * mapSize.x + x, m_stroke.size()).second) {
+			m_stroke.push_back({ x, y, capture(map, x, y), JournalCell() });
+		}
+
+		bool hadGround = map.getGroundTile(x, y) >= 0;
+		if (tile != nullptr) {
+			map.setGroundTile(x, y, *tile);
+		}
+		else {
+			map.clearGroundTile(x, y);
+		}
+		changes.push_back({ { x, y }, hadGround, tile != nullptr });
+		if (single) endStroke(map);
+	}
+
+	// Takes the state every touched cell ended up in (eg. after auto tiling) and appends the stroke to the journal.
+	// Cells that ended up as they started are dropped, a stroke that changed nothing isn't recorded at all.
+	void endStroke(const Map& map) {
+		if (!m_stroking) return;
+		m_stroking = false;
+
+		std::vector<CellEdit> edits;
+		edits.reserve(m_stroke.size());
+		for (CellEdit& edit : m_stroke) {
+			edit.after = capture(map, edit.x, edit.y);
+			if (!sameCell(edit.before, edit.after)) edits.push_back(edit);
+		}
+		m_stroke.clear();
+		m_strokeCells.clear();
+		if (edits.empty()) return;
+
+		append(RECORD_STROKE, edits);
+		pushStroke(std::move(edits));
+	}
+
+	bool isStroking() const {
+		return m_stroking;
+	}
+
+	bool canUndo() const {
+		return m_applied > 0;
+	}
+
+	bool canRedo() const {
+		return m_applied < m_strokes.size();
+	}
+
+	bool undo(Map& map, std::vector<TileChange>& changes) {
+		if (m_stroking) endStroke(map);
+		if (!canUndo()) return false;
+		const std::vector<CellEdit>& edits = m_strokes[--m_applied];
+		applyEdits(map, edits, false, changes);
+		append(RECORD_UNDO, edits);
+		return true;
+	}
+
+	bool redo(Map& map, std::vector<TileChange>& changes) {
+		if (m_stroking) endStroke(map);
+		if (!canRedo()) return false;
+		const std::vector<CellEdit>& edits = m_strokes[m_applied++];
+		applyEdits(map, edits, true, changes);
+		append(RECORD_REDO, edits);
+		return true;
+	}
+
+	// Sets the journal written so far aside for a compaction and starts a new one. If an earlier compaction never
+	// finished, its records are kept in front of these.
+	bool rotate() {
+		m_file.close();
+		std::error_code ec;
+		std::string rotated = rotatedPath();
+		if (std::filesystem::exists(rotated, ec)) {
+			std::ifstream in(m_path, std::ios::binary);
+			std::ofstream out(rotated, std::ios::binary | std::ios::app);
+			if (in && out) {
+				in.seekg(journalHeaderSize);
+				out << in.rdbuf();
+			}
+			if (!out) {
+				std::printf("Failed to set the journal %s aside\n", m_path.c_str());
+				openForAppend();
+				return false;
+			}
+		}
+		else if (std::filesystem::exists(m_path, ec)) {
+			std::filesystem::rename(m_path, rotated, ec);
+			if (ec) {
+				std::printf("Failed to set the journal %s aside: %s\n", m_path.c_str(), ec.message().c_str());
+				openForAppend();
+				return false;
+			}
+		}
+		std::filesystem::remove(m_path, ec);
+		m_fileBytes = 0;
+		openForAppend();
+		return true;
+	}
+
+	// The map file now holds everything in the journal that was set aside, so it can go.
+	void dropRotated() {
+		std::error_code ec;
+		std::filesystem::remove(rotatedPath(), ec);
+	}
+
+	// Strokes that can be undone or redone.
+	size_t getStrokeCount() const {
+		return m_strokes.size();
+	}
+
+	// Bytes in the journal since it was last rotated.
+	uint64_t getFileSize() const {
+		return m_fileBytes;
+	}
+
+	const std::vector<std::string>& getNames() const {
+		return m_names;
+	}
+
+	// The cell at grid pos (x, y) as the journal stores it.
+	JournalCell capture(const Map& map, int x, int y) {
+		JournalCell cell;
+		int index = map.getGroundTile(x, y);
+		if (index < 0) return cell;
+		const Tile& tile = map.tileMap[index];
+		cell.textureID = tile.textureID;
+		cell.name = nameID(tile.textureName);
+		cell.flags = (uint8_t)(JOURNAL_PRESENT | (tile.usingTextureAtlas ? JOURNAL_ATLAS : 0) | (tile.autoTiled ? JOURNAL_AUTOTILED : 0));
+		return cell;
+	}
+
+	size_t maxUndo = 256; // Strokes kept for undo, the oldest are forgotten first
+
+private:
+	enum RecordType : uint8_t {
+		RECORD_STROKE = 1,
+		RECORD_UNDO = 2, // Carries the stroke it undoes, applied backwards
+		RECORD_REDO = 3
+	};
+
+	static constexpr uint32_t journalMagic = 0x4A454754; // "TGEJ"
+	static constexpr uint32_t journalVersion = 1;
+	static constexpr size_t journalHeaderSize = 8;
+
+	std::string rotatedPath() const {
+		return m_path + ".old";
+	}
+
+	uint16_t nameID(const std::string& name) {
+		//Cells mostly come in long runs of the same tile, so only hit the hash map when the name changes.
+		if (m_lastName < m_names.size() && m_names[m_lastName] == name) return m_lastName;
+		auto it = m_nameIDs.find(name);
+		if (it == m_nameIDs.end()) {
+			it = m_nameIDs.emplace(name, (uint16_t)m_names.size()).first;
+			m_names.push_back(name);
+		}
+		m_lastName = it->second;
+		return m_lastName;
+	}
+
+	static bool sameCell(const JournalCell& a, const JournalCell& b) {
+		if (a.flags != b.flags) return false;
+		if (!(a.flags & JOURNAL_PRESENT)) return true;
+		return a.name == b.name && a.textureID == b.textureID;
+	}
+
+	void pushStroke(std::vector<CellEdit>&& edits) {
+		//A new stroke after an undo drops whatever could have been redone.
+		m_strokes.resize(m_applied);
+		m_strokes.push_back(std::move(edits));
+		while (m_strokes.size() > maxUndo) m_strokes.pop_front();
+		m_applied = m_strokes.size();
+		trackMemory();
+	}
+
+	void applyEdits(Map& map, const std::vector<CellEdit>& edits, bool forwards, std::vector<TileChange>& changes) {
+		for (size_t i = 0; i < edits.size(); i++) {
+			const CellEdit& edit = forwards ? edits[i] : edits[edits.size() - 1 - i];
+			const JournalCell& cell = forwards ? edit.after : edit.before;
+			bool hadGround = map.getGroundTile(edit.x, edit.y) >= 0;
+			if (cell.flags & JOURNAL_PRESENT) {
+				Tile tile;
+				tile.textureName = m_names[cell.name];
+				tile.textureID = cell.textureID;
+				tile.usingTextureAtlas = (cell.flags & JOURNAL_ATLAS) != 0;
+				tile.autoTiled = (cell.flags & JOURNAL_AUTOTILED) != 0;
+				map.setGroundTile(edit.x, edit.y, tile);
+			}
+			else {
+				map.clearGroundTile(edit.x, edit.y);
+			}
+			changes.push_back({ { edit.x, edit.y }, hadGround, (cell.flags & JOURNAL_PRESENT) != 0 });
+		}
+	}
+
+	void trackMemory() {
+		int64_t bytes = MemoryTracker::vectorHeap(m_names);
+		for (const std::vector<CellEdit>& stroke : m_strokes) {
+			bytes += MemoryTracker::vectorHeap(stroke);
+		}
+		m_memory.set(bytes);
+	}
+
+	void openForAppend() {
+		std::error_code ec;
+		bool fresh = !std::filesystem::exists(m_path, ec) || std::filesystem::file_size(m_path, ec) < journalHeaderSize;
+		m_file.open(m_path, std::ios::binary | (fresh ? std::ios::trunc : std::ios::app));
+		if (!m_file) {
+			std::printf("Failed to open the edit journal %s, edits won't be kept\n", m_path.c_str());
+			return;
+		}
+		if (fresh) {
+			std::vector<uint8_t> header;
+			putU32(header, journalMagic);
+			putU32(header, journalVersion);
+			m_file.write((const char*)header.data(), (std::streamsize)header.size());
+			m_file.flush();
+			m_fileBytes = 0;
+		}
+		else {
+			m_fileBytes = std::filesystem::file_size(m_path, ec) - journalHeaderSize;
+		}
+	}
+
+	//Record layout: u32 payload size, u32 checksum of the payload, then the payload: u8 type, the names the record uses
+	//(u16 count, then u16 length + bytes each) and u32 cell count, then per cell i32 x, i32 y and before and after as
+	//u16 name (into the record's own names), i32 textureID, u8 flags. Little endian throughout.
+	void append(RecordType type, const std::vector<CellEdit>& edits) {
+		if (!m_file.is_open()) return;
+
+		std::vector<uint16_t> recordNames(m_names.size(), 0xFFFF);
+		std::vector<uint16_t> used;
+		auto recordName = [&](const JournalCell& cell) {
+			if (!(cell.flags & JOURNAL_PRESENT)) return (uint16_t)0;
+			if (recordNames[cell.name] == 0xFFFF) {
+				recordNames[cell.name] = (uint16_t)used.size();
+				used.push_back(cell.name);
+			}
+			return recordNames[cell.name];
+		};
+		for (const CellEdit& edit : edits) {
+			recordName(edit.before);
+			recordName(edit.after);
+		}
+
+		std::vector<uint8_t> payload;
+		payload.reserve(16 + edits.size() * 22);
+		payload.push_back(type);
+		putU16(payload, (uint16_t)used.size());
+		for (uint16_t name : used) {
+			putU16(payload, (uint16_t)m_names[name].size());
+			payload.insert(payload.end(), m_names[name].begin(), m_names[name].end());
+		}
+		putU32(payload, (uint32_t)edits.size());
+		auto putCell = [&](const JournalCell& cell) {
+			putU16(payload, recordName(cell));
+			putU32(payload, (uint32_t)cell.textureID);
+			payload.push_back(cell.flags);
+		};
+		for (const CellEdit& edit : edits) {
+			putU32(payload, (uint32_t)edit.x);
+			putU32(payload, (uint32_t)edit.y);
+			putCell(edit.before);
+			putCell(edit.after);
+		}
+
+		std::vector<uint8_t> header;
+		putU32(header, (uint32_t)payload.size());
+		putU32(header, (uint32_t)AssetPack::hashBytes(payload.data(), payload.size()));
+		m_file.write((const char*)header.data(), (std::streamsize)header.size());
+		m_file.write((const char*)payload.data(), (std::streamsize)payload.size());
+		m_file.flush();
+		if (!m_file) {
+			std::printf("Failed to write to the edit journal %s\n", m_path.c_str());
+			m_file.close();
+			return;
+		}
+		m_fileBytes += header.size() + payload.size();
+	}
+
+	int replayFile(const std::string& path, Map& map, std::vector<TileChange>& changes) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) return 0;
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+
+		size_t at = 0;
+		if (data.size() < journalHeaderSize || getU32(data, at) != journalMagic || getU32(data, at) != journalVersion) {
+			std::printf("%s is not an edit journal this version can read, ignoring it\n", path.c_str());
+			return 0;
+		}
+
+		int records = 0;
+		while (at < data.size()) {
+			size_t start = at;
+			bool ok = at + 8 <= data.size();
+			uint32_t size = ok ? getU32(data, at) : 0;
+			uint32_t checksum = ok ? getU32(data, at) : 0;
+			ok = ok && at + size <= data.size() && (uint32_t)AssetPack::hashBytes(data.data() + at, size) == checksum;
+			if (ok) ok = replayRecord(data.data() + at, size, map, changes);
+			if (!ok) {
+				//Most likely the game died mid write. Cut it off so new records don't end up behind the garbage.
+				std::printf("The edit journal %s is damaged after %d records, dropping the rest\n", path.c_str(), records);
+				std::error_code ec;
+				std::filesystem::resize_file(path, start, ec);
+				break;
+			}
+			at += size;
+			records++;
+		}
+		return records;
+	}
+
+	bool replayRecord(const uint8_t* payload, size_t size, Map& map, std::vector<TileChange>& changes) {
+		std::vector<uint8_t> data(payload, payload + size);
+		size_t at = 0;
+		bool ok = true;
+		auto need = [&](size_t n) { if (at + n > data.size()) ok = false; return ok; };
+
+		if (!need(3)) return false;
+		uint8_t type = data[at++];
+		uint16_t nameCount = getU16(data, at);
+		std::vector<uint16_t> names;
+		for (uint16_t i = 0; i < nameCount && need(2); i++) {
+			uint16_t length = getU16(data, at);
+			if (!need(length)) break;
+			names.push_back(nameID(std::string((const char*)data.data() + at, length)));
+			at += length;
+		}
+		if (!need(4)) return false;
+		uint32_t count = getU32(data, at);
+		if (!need((size_t)count * 22)) return false;
+
+		std::vector<CellEdit> edits(count);
+		auto getCell = [&](JournalCell& cell) {
+			uint16_t name = getU16(data, at);
+			cell.textureID = (int32_t)getU32(data, at);
+			cell.flags = data[at++];
+			if (cell.flags & JOURNAL_PRESENT) {
+				if (name >= names.size()) ok = false;
+				else cell.name = names[name];
+			}
+		};
+		for (CellEdit& edit : edits) {
+			edit.x = (int32_t)getU32(data, at);
+			edit.y = (int32_t)getU32(data, at);
+			getCell(edit.before);
+			getCell(edit.after);
+		}
+		if (!ok || type < RECORD_STROKE || type > RECORD_REDO) return false;
+
+		//Undo and redo records carry their cells, so they apply even if the stroke they refer to was compacted away.
+		applyEdits(map, edits, type != RECORD_UNDO, changes);
+		if (type == RECORD_STROKE) {
+			pushStroke(std::move(edits));
+		}
+		else if (type == RECORD_UNDO && canUndo()) {
+			m_applied--;
+		}
+		else if (type == RECORD_REDO && canRedo()) {
+			m_applied++;
+		}
+		return true;
+	}
+
+	static void putU16(std::vector<uint8_t>& out, uint16_t v) { out.push_back((uint8_t)v); out.push_back((uint8_t)(v >> 8)); }
+	static void putU32(std::vector<uint8_t>& out, uint32_t v) { putU16(out, (uint16_t)v); putU16(out, (uint16_t)(v >> 16)); }
+	static uint16_t getU16(const std::vector<uint8_t>& in, size_t& at) { uint16_t v = (uint16_t)(in[at] | (in[at + 1] << 8)); at += 2; return v; }
+	static uint32_t getU32(const std::vector<uint8_t>& in, size_t& at) { uint32_t lo = getU16(in, at); return lo | ((uint32_t)getU16(in, at) << 16); }
+
+	std::string m_path;
+	std::ofstream m_file;
+	uint64_t m_fileBytes = 0;
+
+	std::vector<std::string> m_names;
+	std::unordered_map<std::string, uint16_t> m_nameIDs;
+	uint16_t m_lastName = 0xFFFF;
+
+	std::deque<std::vector<CellEdit>> m_strokes;
+	size_t m_applied = 0; // Strokes currently applied, the ones past it can be redone
+	bool m_stroking = false;
+	std::vector<CellEdit> m_stroke;
+	std::unordered_map<int, size_t> m_strokeCells; // Grid index -> index in m_stroke
+
+	TrackedBytes m_memory{ MEM_MAP_TILES };
+};
+
+//The ground grid and entities of a map, copied out so a MapCompactor can write them on its own thread.
+struct MapFileSnapshot {
+	std::string path;
+	SDL_Point mapSize = { 0, 0 };
+	SDL_Point tileSize = { 0, 0 };
+	std::vector<std::string> names;
+	std::vector<JournalCell> cells; // mapSize.x * mapSize.y, row major
+	std::vector<std::string> entityLines; // Already in the map format, there are only ever a few
+};
+
+//Writes a map back out in the text map format on a worker thread, then drops the journal records it now holds.
+//The game thread only copies the grid into a MapFileSnapshot, a few rows a frame inside copyBudgetMs so big maps don't
+//hitch. The journal is set aside before the first row is copied, so edits made while the copy runs land in the new
+//journal and get replayed over the file if it doesn't already have them. The file is written one grid row per line, into
+//a temp file that replaces the map once it's complete, and the map's hot reload is re-based on it so it doesn't reload itself.
+class MapCompactor {
+public:
+	MapCompactor(std::string mapPath) : m_path(mapPath) {
+		m_worker = std::thread(&MapCompactor::workerLoop, this);
+	}
+
+	~MapCompactor() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_one();
+		m_worker.join();
+	}
+
+	MapCompactor(const MapCompactor&) = delete;
+	MapCompactor& operator=(const MapCompactor&) = delete;
+
+	// Sets the journal aside and starts copying map over the next update() calls. False if a compaction is still running.
+	// spriteSize gives the size written for atlas entities.
+	bool start(const Map& map, EditJournal& journal, std::function<SDL_Point(const Tile&)> spriteSize) {
+		if (m_state.load() != STATE_IDLE) return false;
+
+		//Edits from here on go into a fresh journal, the old one is only dropped once the new map file is in place.
+		if (!journal.rotate()) return false;
+
+		m_copy = MapFileSnapshot();
+		m_copy.path = m_path;
+		m_copy.mapSize = map.getMapSize();
+		m_copy.tileSize = map.getTileSize();
+		m_copy.cells.reserve((size_t)m_copy.mapSize.x * m_copy.mapSize.y); // Only reserved, the pages get touched row by row
+		m_copyRow = 0;
+		m_copyChunk = 0;
+		m_spriteSize = spriteSize;
+		m_state = STATE_COPYING;
+		return true;
+	}
+
+	// Until update() has seen the result, so a finished write isn't hot reloaded before the rows are re-based on it.
+	bool isBusy() const {
+		return m_state.load() != STATE_IDLE;
+	}
+
+	// Call once a frame. Copies the next rows while a compaction is starting. True once the map file has been replaced,
+	// after which its own change should be ignored.
+	bool update(Map& map, EditJournal& journal) {
+		int state = m_state.load();
+		if (state == STATE_COPYING) {
+			copyRows(map, journal);
+			return false;
+		}
+		if (state == STATE_IDLE || state == STATE_WRITING) return false;
+
+		bool written = state == STATE_DONE;
+		if (written) {
+			journal.dropRotated();
+			map.rebaseRows(m_groundRows, m_entityRows);
+		}
+		m_groundRows.clear();
+		m_entityRows.clear();
+		m_state = STATE_IDLE;
+		return written;
+	}
+
+	double copyBudgetMs = 1.0; // Game thread time spent copying rows and entities per update()
+
+private:
+	enum State {
+		STATE_IDLE,
+		STATE_COPYING, // The game thread is copying rows into m_copy
+		STATE_WRITING,
+		STATE_DONE,
+		STATE_FAILED // The journal that was set aside is kept and folded into the next compaction
+	};
+
+	// Copies rows, then the entities chunk by chunk, until copyBudgetMs runs out (at least one row or chunk). Hands the
+	// copy to the worker once it's complete.
+	void copyRows(const Map& map, EditJournal& journal) {
+		Uint64 start = SDL_GetPerformanceCounter();
+		Uint64 budgetTicks = (Uint64)(copyBudgetMs * SDL_GetPerformanceFrequency() / 1000.0);
+		SDL_Point size = m_copy.mapSize;
+		while (m_copyRow < size.y) {
+			for (int x = 0; x < size.x; x++) {
+				m_copy.cells.push_back(journal.capture(map, x, m_copyRow));
+			}
+			m_copyRow++;
+			if (SDL_GetPerformanceCounter() - start >= budgetTicks) return;
+		}
+
+		SDL_Point chunks = map.getChunkCount();
+		while (m_copyChunk < chunks.x * chunks.y) {
+			for (int index : map.getChunkEntities(m_copyChunk % chunks.x, m_copyChunk / chunks.x)) {
+				const Tile& tile = map.tileMap[index];
+				int x = tile.pos.x / m_copy.tileSize.x, y = tile.pos.y / m_copy.tileSize.y;
+				if (tile.usingTextureAtlas) {
+					SDL_Point spriteSize = m_spriteSize ? m_spriteSize(tile) : m_copy.tileSize;
+					m_copy.entityLines.push_back("(entity): " + tile.textureName + "->(" + std::to_string(tile.textureID) + ")(" +
+						std::to_string(x) + "," + std::to_string(y) + "," + std::to_string(spriteSize.x) + "x" + std::to_string(spriteSize.y) + ")");
+				}
+				else {
+					m_copy.entityLines.push_back("(entity): \"" + tile.textureName + "\"(" + std::to_string(x) + "," + std::to_string(y) + ")?");
+				}
+			}
+			m_copyChunk++;
+			if (SDL_GetPerformanceCounter() - start >= budgetTicks) return;
+		}
+		m_copy.names = journal.getNames();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = std::move(m_copy);
+			m_copy = MapFileSnapshot();
+			m_state = STATE_WRITING;
+		}
+		m_wake.notify_one();
+	}
+
+	void workerLoop() {
+		while (true) {
+			MapFileSnapshot job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this] { return m_quit || m_state.load() == STATE_WRITING; });
+				if (m_state.load() != STATE_WRITING) return;
+				job = std::move(m_job);
+				m_job = MapFileSnapshot();
+			}
+			m_state = writeMap(job) ? STATE_DONE : STATE_FAILED;
+		}
+	}
+
+	bool writeMap(const MapFileSnapshot& snapshot) {
+		std::string tempPath = snapshot.path + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				std::printf("Failed to open %s for writing the map\n", tempPath.c_str());
+				return false;
+			}
+			out << "# All lines begining with # will be ignored.\n#Map For TownGame, written by the tile editor\n\n";
+			out << "Tile Size: " << snapshot.tileSize.x << "x" << snapshot.tileSize.y << "\n";
+
+			//Auto tiled cells go back as the plain terrain tile they were painted as, so they get their edges again on load.
+			std::string line;
+			m_groundRows.assign(snapshot.mapSize.y, 0);
+			for (int y = 0; y < snapshot.mapSize.y; y++) {
+				line.clear();
+				for (int x = 0; x < snapshot.mapSize.x; x++) {
+					const JournalCell& cell = snapshot.cells[(size_t)y * snapshot.mapSize.x + x];
+					if (!(cell.flags & JOURNAL_PRESENT)) continue;
+					if (!line.empty()) line += ", ";
+					line += snapshot.names[cell.name];
+					if ((cell.flags & JOURNAL_ATLAS) && !(cell.flags & JOURNAL_AUTOTILED)) {
+						line += "->(" + std::to_string(cell.textureID) + ")(" + std::to_string(x) + "," + std::to_string(y) + ")";
+					}
+					else {
+						line += "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
+					}
+				}
+				if (line.empty()) continue;
+				out << line << "\n";
+				m_groundRows[y] = AssetPack::hashBytes(line.data(), line.size());
+			}
+			for (const std::string& entity : snapshot.entityLines) {
+				out << entity << "\n";
+				m_entityRows.push_back(AssetPack::hashBytes(entity.data(), entity.size()));
+			}
+			if (!out) {
+				std::printf("Failed to write the map %s\n", tempPath.c_str());
+				return false;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, snapshot.path, ec);
+		if (ec) {
+			std::printf("Failed to replace the map %s: %s\n", snapshot.path.c_str(), ec.message().c_str());
+			return false;
+		}
+		return true;
+	}
+
+	std::string m_path;
+
+	//Only touched by the game thread while copying.
+	MapFileSnapshot m_copy;
+	int m_copyRow = 0;
+	int m_copyChunk = 0; // Entities are gathered a chunk at a time once the rows are done
+	std::function<SDL_Point(const Tile&)> m_spriteSize;
+
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	MapFileSnapshot m_job;
+	std::atomic<int> m_state{ STATE_IDLE };
+	bool m_quit = false;
+
+	//Hashes of the lines written, handed to Map::rebaseRows(). Only touched by the worker while writing.
+	std::vector<uint64_t> m_groundRows; // Per grid row, 0 for rows left out
+	std::vector<uint64_t> m_entityRows;
+};
+
+#endif
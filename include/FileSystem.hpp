@@ -6,7 +6,13 @@
 #include <iostream>
 #include <unordered_map>
 
+#include "SDL.h"
+#include "AssetPack.hpp"
+
 #ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // Keeps Windows.h's min/max macros away from std::min/std::max
+#endif
 #include <Windows.h>
 #else
 #include <unistd.h>
@@ -50,8 +56,14 @@ public:
         // Use filesystem library to handle paths
         std::filesystem::path fsPath(path);
         fsPath = fsPath.parent_path();
-        m_paths.insert_or_assign("execPath", path);
+        m_paths.insert_or_assign("execPath", fsPath.string());
 #endif
+
+        // Serve assets from the pack next to the executable when there is one, loose files otherwise.
+        std::string packPath = joinToExecDir("Assets.pack");
+        if (!mountedPack().isMounted() && std::filesystem::exists(packPath)) {
+            mountPack(packPath);
+        }
     }
 
     // Getter for the executable path  
@@ -95,17 +107,77 @@ public:
     // Join two paths and return the resulting string (execPath and relative file)
     std::string joinPaths(const std::string& basePath, const std::string& filePath) {
         std::filesystem::path fullPath(basePath);
-        fullPath /= filePath;
+        fullPath /= nativePath(filePath);
         return fullPath.string();
     }
 
     std::string joinToExecDir(const std::string& filePath) {
         std::filesystem::path fullPath(m_paths["execPath"]);
-        fullPath /= filePath;
+        fullPath /= nativePath(filePath);
         return fullPath.string();
     }
 
+    // Asset paths are written Windows style ("Assets\\Maps\\default.map"), this swaps the separators everywhere else.
+    static std::string nativePath(std::string path) {
+#ifndef _WIN32
+        for (char& c : path) {
+            if (c == '\\') c = '/';
+        }
+#endif
+        return path;
+    }
+
+    // Mounts an asset pack. Assets under the executable's directory are looked up in it before the loose files.
+    bool mountPack(const std::string& packPath) {
+        if (!mountedPack().mount(packPath)) {
+            return false;
+        }
+        packRoot() = AssetPack::normalizePath(getExecPath()) + "/";
+        return true;
+    }
+
+    // Opens an asset by path (absolute, or relative to the working directory). If the mounted pack has it, the
+    // returned SDL_RWops is a read only view of the mapped pack with nothing copied, otherwise it opens the loose file.
+    static SDL_RWops* openAsset(const std::string& path) {
+        const void* data;
+        size_t size;
+        if (findPackedAsset(path, &data, &size)) {
+            return SDL_RWFromConstMem(data, (int)size);
+        }
+
+        SDL_RWops* file = SDL_RWFromFile(nativePath(path).c_str(), "rb");
+        if (file == NULL) {
+            std::printf("Unable to open asset: %s\n", path.c_str());
+        }
+        return file;
+    }
+
+    // Points data at an asset's bytes inside the mounted pack. False if no pack is mounted or the asset isn't in it.
+    static bool findPackedAsset(const std::string& path, const void** data, size_t* size) {
+        if (!mountedPack().isMounted()) {
+            return false;
+        }
+
+        std::string key = AssetPack::normalizePath(path);
+        const std::string& root = packRoot();
+        if (key.compare(0, root.size(), root) == 0) {
+            key.erase(0, root.size());
+        }
+        return mountedPack().find(key, data, size);
+    }
+
 private:
+    // One pack for the whole game, shared by every FileSystem and the asset loaders.
+    static AssetPack& mountedPack() {
+        static AssetPack pack;
+        return pack;
+    }
+
+    static std::string& packRoot() {
+        static std::string root;
+        return root;
+    }
+
     std::string m_execPath;   // Stores the executable path (without the exec name)
     std::unordered_map<std::string, std::string> m_paths;
 };
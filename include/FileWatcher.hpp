@@ -0,0 +1,139 @@
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+#include <string>
+#include <filesystem>
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//Tells when a file has been written, without blocking. Call hasChanged() once a frame.
+//Linux uses inotify and Windows a change notification on the file's directory. The directory is watched rather than the
+//file because most editors save by writing a new file and renaming it over the old one. Anywhere else falls back to
+//checking the modification time twice a second.
+
+class FileWatcher {
+public:
+	FileWatcher() {}
+
+	~FileWatcher() {
+		stop();
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	bool watch(const std::string& filePath) {
+		stop();
+
+		std::filesystem::path path(filePath);
+		std::error_code ec;
+		if (!std::filesystem::exists(path, ec)) {
+			std::printf("Can't watch %s, it doesn't exist\n", filePath.c_str());
+			return false;
+		}
+		m_path = path;
+		m_lastWrite = std::filesystem::last_write_time(path, ec);
+		std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+
+#ifdef _WIN32
+		m_handle = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (m_handle == INVALID_HANDLE_VALUE) {
+			m_handle = NULL;
+			std::printf("Failed to watch %s for changes\n", directory.c_str());
+			return false;
+		}
+#elif defined(__linux__)
+		m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_fd < 0 || inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			std::printf("Failed to watch %s for changes\n", directory.c_str());
+			stop();
+			return false;
+		}
+#endif
+		m_watching = true;
+		return true;
+	}
+
+	void stop() {
+#ifdef _WIN32
+		if (m_handle) FindCloseChangeNotification(m_handle);
+		m_handle = NULL;
+#elif defined(__linux__)
+		if (m_fd >= 0) close(m_fd);
+		m_fd = -1;
+#endif
+		m_watching = false;
+	}
+
+	bool isWatching() const {
+		return m_watching;
+	}
+
+	// True once after the file has been written. Several writes between calls come out as one change.
+	bool hasChanged() {
+		if (!m_watching) return false;
+
+		bool changed = false;
+#ifdef _WIN32
+		//The notification only says something in the directory changed, the write time says if it was this file.
+		while (WaitForSingleObject(m_handle, 0) == WAIT_OBJECT_0) {
+			changed = true;
+			FindNextChangeNotification(m_handle);
+		}
+		if (changed) changed = writeTimeChanged();
+#elif defined(__linux__)
+		alignas(inotify_event) char buffer[4096];
+		std::string fileName = m_path.filename().string();
+		ssize_t length;
+		while ((length = read(m_fd, buffer, sizeof(buffer))) > 0) {
+			for (ssize_t at = 0; at < length;) {
+				const inotify_event* event = (const inotify_event*)(buffer + at);
+				if (event->len > 0 && fileName == event->name) {
+					changed = true;
+				}
+				at += sizeof(inotify_event) + event->len;
+			}
+		}
+#else
+		auto now = std::chrono::steady_clock::now();
+		if (now - m_lastPoll >= std::chrono::milliseconds(500)) {
+			m_lastPoll = now;
+			changed = writeTimeChanged();
+		}
+#endif
+		return changed;
+	}
+
+private:
+	bool writeTimeChanged() {
+		std::error_code ec;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(m_path, ec);
+		if (ec || time == m_lastWrite) return false;
+		m_lastWrite = time;
+		return true;
+	}
+
+	std::filesystem::path m_path;
+	std::filesystem::file_time_type m_lastWrite;
+	bool m_watching = false;
+
+#ifdef _WIN32
+	HANDLE m_handle = NULL;
+#elif defined(__linux__)
+	int m_fd = -1;
+#else
+	std::chrono::steady_clock::time_point m_lastPoll;
+#endif
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include "SDL.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+//Per frame input recording and playback.
+//A recording holds, for every frame, the frame delta, the mouse state and the scancodes held down. Played back through
+//Window::update() it reproduces a session exactly, with no window and no real time, eg. for frame time regression runs.
+
+struct InputFrame {
+	double deltaTime = 0; // ms, like Window::deltaTime
+	SDL_Point mousePos = { 0, 0 };
+	Uint32 mouseButtons = 0; // SDL_GetMouseState() button mask
+	std::vector<Uint16> keysDown; // Scancodes held this frame
+};
+
+class InputRecorder {
+public:
+	~InputRecorder() {
+		close();
+	}
+
+	bool open(const std::string& path) {
+		m_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!m_file.is_open()) {
+			std::printf("Failed to open %s for input recording\n", path.c_str());
+			return false;
+		}
+		m_file.write(fileMagic, 4);
+		writeU32(fileVersion);
+		return true;
+	}
+
+	bool isOpen() const {
+		return m_file.is_open();
+	}
+
+	void record(const InputFrame& frame) {
+		m_buffer.clear();
+		uint64_t dtBits;
+		std::memcpy(&dtBits, &frame.deltaTime, sizeof(dtBits));
+		put(dtBits, 8);
+		put((uint32_t)frame.mousePos.x, 4);
+		put((uint32_t)frame.mousePos.y, 4);
+		put(frame.mouseButtons, 4);
+		put(frame.keysDown.size(), 2);
+		for (Uint16 key : frame.keysDown) {
+			put(key, 2);
+		}
+		m_file.write((const char*)m_buffer.data(), (std::streamsize)m_buffer.size());
+	}
+
+	void close() {
+		if (m_file.is_open()) {
+			m_file.close();
+		}
+	}
+
+	static constexpr char fileMagic[4] = { 'T', 'G', 'I', 'R' };
+	static constexpr uint32_t fileVersion = 1;
+
+private:
+	//Little endian, so recordings move between machines.
+	void put(uint64_t value, int bytes) {
+		for (int i = 0; i < bytes; i++) {
+			m_buffer.push_back((uint8_t)(value >> (i * 8)));
+		}
+	}
+
+	void writeU32(uint32_t value) {
+		m_buffer.clear();
+		put(value, 4);
+		m_file.write((const char*)m_buffer.data(), 4);
+	}
+
+	std::ofstream m_file;
+	std::vector<uint8_t> m_buffer;
+};
+
+class InputReplay {
+public:
+	// Loads a whole recording into memory so playback never waits on the disk.
+	bool open(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			std::printf("Failed to open input recording %s\n", path.c_str());
+			return false;
+		}
+		m_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		m_at = 4; // Past the magic
+		m_frame = 0;
+
+		if (m_data.size() < 8 || std::memcmp(m_data.data(), InputRecorder::fileMagic, 4) != 0 || take(4) != InputRecorder::fileVersion) {
+			std::printf("%s is not an input recording this version can play\n", path.c_str());
+			m_data.clear();
+			return false;
+		}
+		m_open = true;
+		return true;
+	}
+
+	bool isOpen() const {
+		return m_open;
+	}
+
+	// Reads the next frame. Returns false once the recording is finished (or truncated).
+	bool next(InputFrame& frame) {
+		if (!m_open || m_at + 22 > m_data.size()) {
+			m_open = false;
+			return false;
+		}
+		uint64_t dtBits = take(8);
+		std::memcpy(&frame.deltaTime, &dtBits, sizeof(dtBits));
+		frame.mousePos.x = (int32_t)take(4);
+		frame.mousePos.y = (int32_t)take(4);
+		frame.mouseButtons = (Uint32)take(4);
+
+		size_t keyCount = (size_t)take(2);
+		if (m_at + keyCount * 2 > m_data.size()) {
+			m_open = false;
+			return false;
+		}
+		frame.keysDown.resize(keyCount);
+		for (size_t i = 0; i < keyCount; i++) {
+			frame.keysDown[i] = (Uint16)take(2);
+		}
+		m_frame++;
+		return true;
+	}
+
+	// True while there's another frame to read.
+	bool hasNext() const {
+		return m_open && m_at + 22 <= m_data.size();
+	}
+
+	size_t getFrameNumber() const {
+		return m_frame;
+	}
+
+private:
+	uint64_t take(int bytes) {
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; i++) {
+			value |= (uint64_t)m_data[m_at++] << (i * 8);
+		}
+		return value;
+	}
+
+	std::vector<uint8_t> m_data;
+	size_t m_at = 0;
+	size_t m_frame = 0;
+	bool m_open = false;
+};
+
+#endif
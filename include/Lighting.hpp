@@ -0,0 +1,226 @@
+#ifndef LIGHTING_HPP
+#define LIGHTING_HPP
+
+#include "mapReader.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+//Tile resolution light map.
+//Point lights flood fill outwards, losing one level per tile, and stop at opaque (entity) tiles. A light can never reach
+//further than its level, so moving one or changing a tile only re-lights the square of cells it could have touched.
+//The ambient (day/night) level is combined when the tint is read, so changing it never triggers a re-light.
+
+struct PointLight {
+	SDL_Point pos; // In tiles
+	int level;
+	bool alive;
+};
+
+class LightMap {
+public:
+	LightMap(const Map& map) {
+		m_mapSize = map.getMapSize();
+		m_level.assign((size_t)m_mapSize.x * m_mapSize.y, 0);
+		m_opaque.assign((size_t)m_mapSize.x * m_mapSize.y, 0);
+
+		SDL_Point tileSize = map.getTileSize();
+		for (const auto& tile : map.tileMap) {
+			if (tile.isEntity) {
+				int x = tile.pos.x / tileSize.x, y = tile.pos.y / tileSize.y;
+				if (x < m_mapSize.x && y < m_mapSize.y) {
+					m_opaque[y * m_mapSize.x + x] = 1;
+				}
+			}
+		}
+	}
+
+	// Adds a light at a tile position. level is clamped to maxLightLevel and is also how many tiles it reaches.
+	int addLight(SDL_Point tilePos, int level) {
+		level = std::min(std::max(level, 0), maxLightLevel);
+		int id;
+		if (!m_freeLights.empty()) {
+			id = m_freeLights.back();
+			m_freeLights.pop_back();
+			m_lights[id] = { tilePos, level, true };
+		}
+		else {
+			id = (int)m_lights.size();
+			m_lights.push_back({ tilePos, level, true });
+		}
+		markDirty(tilePos, level);
+		return id;
+	}
+
+	// Moves a light. Nothing is re-lit unless it actually changed tile.
+	void moveLight(int lightID, SDL_Point tilePos) {
+		if (!isLight(lightID)) return;
+		PointLight& light = m_lights[lightID];
+		if (light.pos.x == tilePos.x && light.pos.y == tilePos.y) return;
+
+		markDirty(light.pos, light.level);
+		light.pos = tilePos;
+		markDirty(light.pos, light.level);
+	}
+
+	void setLightLevel(int lightID, int level) {
+		if (!isLight(lightID)) return;
+		PointLight& light = m_lights[lightID];
+		level = std::min(std::max(level, 0), maxLightLevel);
+		if (light.level == level) return;
+
+		markDirty(light.pos, std::max(light.level, level));
+		light.level = level;
+	}
+
+	void removeLight(int lightID) {
+		if (!isLight(lightID)) return;
+		PointLight& light = m_lights[lightID];
+		markDirty(light.pos, light.level);
+		light.alive = false;
+		m_freeLights.push_back(lightID);
+	}
+
+	// False for IDs that were never handed out or whose light was removed.
+	bool isLight(int lightID) const {
+		return lightID >= 0 && lightID < (int)m_lights.size() && m_lights[lightID].alive;
+	}
+
+	// Marks a tile as blocking light (eg. an entity was placed on it) or not.
+	void setOpaque(int x, int y, bool opaque) {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return;
+		uint8_t& cell = m_opaque[y * m_mapSize.x + x];
+		if ((cell != 0) == opaque) return;
+		cell = opaque;
+		markDirty({ x, y }, maxLightLevel);
+	}
+
+	// Ambient light from 0 (night) to 1 (full day).
+	void setAmbient(float level) {
+		m_ambient = std::min(std::max(level, 0.0f), 1.0f);
+	}
+
+	// Re-lights whatever changed since the last call. Returns straight away on frames where nothing did.
+	void update() {
+		if (m_dirty.empty()) return;
+
+		for (const SDL_Rect& region : m_dirty) {
+			relight(region);
+		}
+		m_dirty.clear();
+	}
+
+	// The colour modulation for the tile at (x, y): the brighter of the ambient light and any point light, per channel.
+	SDL_Color getTint(int x, int y) const {
+		float light = 0.0f;
+		if (x >= 0 && y >= 0 && x < m_mapSize.x && y < m_mapSize.y) {
+			light = (float)m_level[y * m_mapSize.x + x] / maxLightLevel;
+		}
+		return {
+			(Uint8)std::max(ambientColour.r * m_ambient, lightColour.r * light),
+			(Uint8)std::max(ambientColour.g * m_ambient, lightColour.g * light),
+			(Uint8)std::max(ambientColour.b * m_ambient, lightColour.b * light),
+			255
+		};
+	}
+
+	int getLightLevel(int x, int y) const {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return 0;
+		return m_level[y * m_mapSize.x + x];
+	}
+
+	static constexpr int maxLightLevel = 15;
+
+	SDL_Color ambientColour = { 255, 255, 255, 255 }; // Full daylight. Scaled down by the ambient level.
+	SDL_Color lightColour = { 255, 214, 150, 255 }; // Torch light at full strength.
+
+private:
+	void markDirty(SDL_Point pos, int radius) {
+		SDL_Rect r = { pos.x - radius, pos.y - radius, radius * 2 + 1, radius * 2 + 1 };
+
+		//Clip to the map so an off map light doesn't queue work.
+		int x0 = std::max(r.x, 0), y0 = std::max(r.y, 0);
+		int x1 = std::min(r.x + r.w, m_mapSize.x), y1 = std::min(r.y + r.h, m_mapSize.y);
+		if (x0 >= x1 || y0 >= y1) return;
+		m_dirty.push_back({ x0, y0, x1 - x0, y1 - y0 });
+	}
+
+	static bool overlaps(const SDL_Rect& a, const SDL_Rect& b) {
+		return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+	}
+
+	// Clears a region and floods every light that can reach it back in. Lights are flooded in full (they're small)
+	// but only cells inside the region are written, so the rest of the map keeps its values.
+	void relight(const SDL_Rect& region) {
+		for (int y = region.y; y < region.y + region.h; y++) {
+			std::fill(m_level.begin() + y * m_mapSize.x + region.x, m_level.begin() + y * m_mapSize.x + region.x + region.w, 0);
+		}
+
+		for (const PointLight& light : m_lights) {
+			if (!light.alive || light.level == 0) continue;
+			SDL_Rect reach = { light.pos.x - light.level, light.pos.y - light.level, light.level * 2 + 1, light.level * 2 + 1 };
+			if (overlaps(reach, region)) {
+				propagate(light, region);
+			}
+		}
+	}
+
+	void propagate(const PointLight& light, const SDL_Rect& region) {
+		if (light.pos.x < 0 || light.pos.y < 0 || light.pos.x >= m_mapSize.x || light.pos.y >= m_mapSize.y) return;
+
+		//Scratch space is local to the light's reach and reused between calls.
+		int size = light.level * 2 + 1;
+		m_visited.assign((size_t)size * size, 0);
+		m_queue.clear();
+
+		auto write = [&](int x, int y, int level) {
+			if (x >= region.x && y >= region.y && x < region.x + region.w && y < region.y + region.h) {
+				uint8_t& cell = m_level[y * m_mapSize.x + x];
+				if (level > cell) cell = (uint8_t)level;
+			}
+		};
+
+		m_queue.push_back({ light.pos.x, light.pos.y, light.level });
+		m_visited[light.level * size + light.level] = 1;
+		write(light.pos.x, light.pos.y, light.level);
+
+		const SDL_Point dirs[4] = { {0,-1}, {1,0}, {0,1}, {-1,0} };
+		for (size_t i = 0; i < m_queue.size(); i++) {
+			LightNode node = m_queue[i];
+			//Opaque tiles are lit themselves but cast a shadow behind them (the light's own tile always emits).
+			if (node.level <= 1 || (i > 0 && m_opaque[node.y * m_mapSize.x + node.x])) continue;
+
+			for (const SDL_Point& d : dirs) {
+				int nx = node.x + d.x, ny = node.y + d.y;
+				if (nx < 0 || ny < 0 || nx >= m_mapSize.x || ny >= m_mapSize.y) continue;
+
+				int local = (ny - light.pos.y + light.level) * size + (nx - light.pos.x + light.level);
+				if (m_visited[local]) continue;
+				m_visited[local] = 1;
+
+				write(nx, ny, node.level - 1);
+				m_queue.push_back({ nx, ny, node.level - 1 });
+			}
+		}
+	}
+
+	struct LightNode {
+		int x, y, level;
+	};
+
+private:
+	SDL_Point m_mapSize;
+	std::vector<uint8_t> m_level; // Point light level per tile, 0 - maxLightLevel
+	std::vector<uint8_t> m_opaque;
+	float m_ambient = 1.0f;
+
+	std::vector<PointLight> m_lights;
+	std::vector<int> m_freeLights;
+	std::vector<SDL_Rect> m_dirty;
+
+	std::vector<uint8_t> m_visited;
+	std::vector<LightNode> m_queue;
+};
+
+#endif
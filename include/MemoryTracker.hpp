@@ -0,0 +1,221 @@
+#ifndef MEMORYTRACKER_HPP
+#define MEMORYTRACKER_HPP
+
+#include "SDL.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstdio>
+
+//Where the memory goes, by category.
+//Nothing here hooks the allocator: the systems that own the big containers report what they hold (an estimate of the
+//heap behind their vectors, strings and maps), and textures are sized from their format and dimensions. Every
+//category keeps a high-water mark and can have a budget, going over it prints a warning once until usage drops back.
+
+enum MemoryCategory {
+	MEM_MAP_TILES, // Map tiles, the tile grid and per chunk data
+	MEM_TEXTURE_VRAM, // Estimated from the texture format and size
+	MEM_ASSET_DATA, // CPU side asset data, eg. atlas sub texture tables and glyph caches
+	MEM_ANIMATION, // Animation sequences and their state
+	MEM_PARSE_BUFFERS, // Transient buffers while loading (file contents, decoded images...)
+	MEM_CATEGORY_COUNT
+};
+
+class MemoryTracker {
+public:
+	static void add(MemoryCategory category, int64_t bytes) {
+		Category& c = categories()[category];
+		int64_t now = c.bytes.fetch_add(bytes) + bytes;
+		int64_t high = c.highWater.load();
+		while (now > high && !c.highWater.compare_exchange_weak(high, now)) {}
+		checkBudget(category, now);
+	}
+
+	static void release(MemoryCategory category, int64_t bytes) {
+		add(category, -bytes);
+	}
+
+	static int64_t getUsage(MemoryCategory category) {
+		return categories()[category].bytes.load();
+	}
+
+	static int64_t getHighWater(MemoryCategory category) {
+		return categories()[category].highWater.load();
+	}
+
+	static int64_t getTotalUsage() {
+		int64_t total = 0;
+		for (int i = 0; i < MEM_CATEGORY_COUNT; i++) total += getUsage((MemoryCategory)i);
+		return total;
+	}
+
+	// 0 means no budget.
+	static void setBudget(MemoryCategory category, int64_t bytes) {
+		categories()[category].budget = bytes;
+		checkBudget(category, getUsage(category));
+	}
+
+	static int64_t getBudget(MemoryCategory category) {
+		return categories()[category].budget.load();
+	}
+
+	static bool isOverBudget(MemoryCategory category) {
+		int64_t budget = getBudget(category);
+		return budget > 0 && getUsage(category) > budget;
+	}
+
+	static const char* getName(MemoryCategory category) {
+		static const char* names[MEM_CATEGORY_COUNT] = { "map_tiles", "texture_vram", "asset_data", "animation", "parse_buffers" };
+		return names[category];
+	}
+
+	// Counts a texture's estimated VRAM until untrackTexture() (or destroyTexture()) is called with it.
+	static void trackTexture(SDL_Texture* texture) {
+		if (texture == nullptr) return;
+		Uint32 format;
+		int w, h;
+		if (SDL_QueryTexture(texture, &format, NULL, &w, &h) != 0) return;
+		int bytesPerPixel = SDL_BYTESPERPIXEL(format);
+		int64_t bytes = (int64_t)w * h * (bytesPerPixel > 0 ? bytesPerPixel : 4);
+
+		std::lock_guard<std::mutex> lock(textureMutex());
+		auto inserted = textures().emplace(texture, bytes);
+		if (inserted.second) add(MEM_TEXTURE_VRAM, bytes);
+	}
+
+	static void untrackTexture(SDL_Texture* texture) {
+		std::lock_guard<std::mutex> lock(textureMutex());
+		auto it = textures().find(texture);
+		if (it == textures().end()) return;
+		release(MEM_TEXTURE_VRAM, it->second);
+		textures().erase(it);
+	}
+
+	static void destroyTexture(SDL_Texture* texture) {
+		if (texture == nullptr) return;
+		untrackTexture(texture);
+		SDL_DestroyTexture(texture);
+	}
+
+	// {"total": .., "categories": {"map_tiles": {"bytes": .., "highWater": .., "budget": ..}, ...}}
+	static std::string toJSON() {
+		std::string json = "{\n\t\"total\": " + std::to_string(getTotalUsage()) + ",\n\t\"categories\": {\n";
+		for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+			MemoryCategory category = (MemoryCategory)i;
+			json += "\t\t\"" + std::string(getName(category)) + "\": { \"bytes\": " + std::to_string(getUsage(category))
+				+ ", \"highWater\": " + std::to_string(getHighWater(category)) + ", \"budget\": " + std::to_string(getBudget(category)) + " }";
+			json += (i + 1 < MEM_CATEGORY_COUNT) ? ",\n" : "\n";
+		}
+		json += "\t}\n}\n";
+		return json;
+	}
+
+	static bool writeJSON(const std::string& path) {
+		std::ofstream out(path, std::ios::trunc);
+		if (!out) {
+			std::printf("Failed to write the memory report to %s\n", path.c_str());
+			return false;
+		}
+		out << toJSON();
+		return true;
+	}
+
+	//Estimates of the heap behind standard containers, close enough to budget with.
+	static int64_t stringHeap(const std::string& s) {
+		static const size_t inlineCapacity = std::string().capacity(); // Short strings live inside the object
+		return s.capacity() > inlineCapacity ? (int64_t)s.capacity() + 1 : 0;
+	}
+
+	template <typename T>
+	static int64_t vectorHeap(const std::vector<T>& v) {
+		return (int64_t)(v.capacity() * sizeof(T));
+	}
+
+	template <typename K, typename V, typename H>
+	static int64_t mapHeap(const std::unordered_map<K, V, H>& m) {
+		//One node per element (the pair, a next pointer and the cached hash) plus the bucket array.
+		return (int64_t)(m.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void*)) + m.bucket_count() * sizeof(void*));
+	}
+
+private:
+	struct Category {
+		std::atomic<int64_t> bytes{ 0 };
+		std::atomic<int64_t> highWater{ 0 };
+		std::atomic<int64_t> budget{ 0 };
+		std::atomic<bool> warned{ false };
+	};
+
+	static Category* categories() {
+		static Category list[MEM_CATEGORY_COUNT];
+		return list;
+	}
+
+	static std::unordered_map<SDL_Texture*, int64_t>& textures() {
+		static std::unordered_map<SDL_Texture*, int64_t> sizes;
+		return sizes;
+	}
+
+	static std::mutex& textureMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static void checkBudget(MemoryCategory category, int64_t now) {
+		Category& c = categories()[category];
+		int64_t budget = c.budget.load();
+		if (budget > 0 && now > budget) {
+			if (!c.warned.exchange(true)) {
+				std::printf("Memory budget exceeded for %s: %.2f MB used of %.2f MB\n", getName(category), now / 1048576.0, budget / 1048576.0);
+			}
+		}
+		else {
+			c.warned = false;
+		}
+	}
+};
+
+//A block of bytes reported to a category for as long as the owner lives. Owners call set() whenever their size changes.
+class TrackedBytes {
+public:
+	TrackedBytes(MemoryCategory category, int64_t bytes = 0) : m_category(category) {
+		set(bytes);
+	}
+
+	~TrackedBytes() {
+		set(0);
+	}
+
+	TrackedBytes(const TrackedBytes& other) : m_category(other.m_category) {
+		set(other.m_bytes);
+	}
+
+	TrackedBytes& operator=(const TrackedBytes& other) {
+		if (this != &other) {
+			set(0);
+			m_category = other.m_category;
+			set(other.m_bytes);
+		}
+		return *this;
+	}
+
+	void set(int64_t bytes) {
+		if (bytes == m_bytes) return;
+		MemoryTracker::add(m_category, bytes - m_bytes);
+		m_bytes = bytes;
+	}
+
+	int64_t get() const {
+		return m_bytes;
+	}
+
+private:
+	MemoryCategory m_category;
+	int64_t m_bytes = 0;
+};
+
+#endif
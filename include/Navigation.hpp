@@ -0,0 +1,634 @@
+#ifndef NAVIGATION_HPP
+#define NAVIGATION_HPP
+
+#include "mapReader.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+
+//Hierarchical (HPA*) navigation over the tile grid.
+//The map is split into clusters matching Map::chunkSize. Walkable runs along each cluster border become entrance nodes,
+//and nodes inside a cluster are linked by their shortest local path cost. Long queries search that small abstract graph
+//and then refine each hop with an A* bounded to a single cluster. All positions are in tiles, not pixels.
+
+enum PathStatus {
+	PATH_PENDING,
+	PATH_FOUND,
+	PATH_FAILED,
+	PATH_UNKNOWN // No request with that ID (or its result was already taken)
+};
+
+//A direction field towards one goal, shared by every agent walking there. Built in slices by Navigation::update().
+class FlowField {
+public:
+	FlowField(SDL_Point goal, SDL_Point mapSize) : goal(goal), m_mapSize(mapSize) {
+		reset();
+	}
+
+	// Direction to step from (x, y) towards the goal. {0,0} at the goal, or if the cell hasn't been reached (yet).
+	SDL_Point getDirection(int x, int y) const {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return { 0, 0 };
+		int8_t d = m_dir[y * m_mapSize.x + x];
+		if (d < 0) return { 0, 0 };
+		return { s_dirs[d].x, s_dirs[d].y };
+	}
+
+	bool isComplete() const { return m_complete; }
+
+	SDL_Point goal;
+
+private:
+	friend class Navigation;
+
+	void reset() {
+		m_dist.assign((size_t)m_mapSize.x * m_mapSize.y, INT_MAX);
+		m_dir.assign((size_t)m_mapSize.x * m_mapSize.y, -1);
+		m_frontier.clear();
+		m_complete = false;
+
+		if (goal.x < 0 || goal.y < 0 || goal.x >= m_mapSize.x || goal.y >= m_mapSize.y) {
+			m_complete = true; // Nothing can reach it
+			return;
+		}
+		m_dist[goal.y * m_mapSize.x + goal.x] = 0;
+		m_frontier.push_back(goal.y * m_mapSize.x + goal.x);
+	}
+
+	static constexpr SDL_Point s_dirs[8] = { {0,-1}, {1,-1}, {1,0}, {1,1}, {0,1}, {-1,1}, {-1,0}, {-1,-1} };
+
+	std::vector<int> m_dist; // Steps to the goal, INT_MAX if unreached
+	std::vector<int8_t> m_dir; // Index into s_dirs, -1 if unreached
+	std::deque<int> m_frontier;
+	bool m_complete = false;
+	SDL_Point m_mapSize;
+};
+
+class Navigation {
+public:
+	// Builds the walkability grid and the abstract graph. A cell is walkable if it has a ground tile and no entity on it.
+	Navigation(const Map& map) {
+		m_mapSize = map.getMapSize();
+		m_clusterCount = map.getChunkCount();
+		m_walkable.assign((size_t)m_mapSize.x * m_mapSize.y, 0);
+
+		SDL_Point tileSize = map.getTileSize();
+		for (int i = 0; i < (int)m_walkable.size(); i++) {
+			m_walkable[i] = map.tileGrid[i] >= 0;
+		}
+		for (const auto& tile : map.tileMap) {
+			if (tile.isEntity) {
+				int x = tile.pos.x / tileSize.x, y = tile.pos.y / tileSize.y;
+				if (x < m_mapSize.x && y < m_mapSize.y) {
+					m_walkable[y * m_mapSize.x + x] = 0;
+				}
+			}
+		}
+
+		m_clusterNodes.resize((size_t)m_clusterCount.x * m_clusterCount.y);
+		m_borderNodes.resize(m_clusterNodes.size() * 2);
+		for (int c = 0; c < (int)m_clusterNodes.size(); c++) {
+			buildBorder(c, true);
+			buildBorder(c, false);
+		}
+		for (int c = 0; c < (int)m_clusterNodes.size(); c++) {
+			buildIntraEdges(c);
+		}
+	}
+
+	bool isWalkable(int x, int y) const {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return false;
+		return m_walkable[y * m_mapSize.x + x] != 0;
+	}
+
+	// Changes the walkability of a cell. The affected cluster is repaired at the start of the next update() or query,
+	// only cached paths through the repaired clusters are dropped. Flow fields restart and refill over the next updates.
+	void setWalkable(int x, int y, bool walkable) {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return;
+		uint8_t& cell = m_walkable[y * m_mapSize.x + x];
+		if ((cell != 0) == walkable) return;
+		cell = walkable;
+		m_dirtyClusters.insert(clusterOf(x, y));
+
+		for (auto& field : m_flowFields) {
+			field.second->reset();
+		}
+	}
+
+	// Synchronous query. Uses (and fills) the path cache. Returns false if there is no path.
+	bool findPath(SDL_Point start, SDL_Point goal, std::vector<SDL_Point>& outPath) {
+		repairDirtyClusters();
+		outPath.clear();
+		if (!isWalkable(start.x, start.y) || !isWalkable(goal.x, goal.y)) return false;
+
+		uint64_t key = cacheKey(start, goal);
+		auto cached = m_pathCache.find(key);
+		if (cached != m_pathCache.end()) {
+			outPath = cached->second;
+			return true;
+		}
+
+		bool found = false;
+		if (clusterOf(start.x, start.y) == clusterOf(goal.x, goal.y)) {
+			found = localAStar(start, goal, clusterBounds(clusterOf(start.x, start.y)), outPath);
+		}
+		if (!found) {
+			found = hierarchicalPath(start, goal, outPath);
+		}
+
+		if (found) {
+			if (m_pathCache.size() >= maxCachedPaths) {
+				m_pathCache.clear();
+			}
+			m_pathCache[key] = outPath;
+		}
+		return found;
+	}
+
+	// Queues a query to be solved inside the per frame budget of update(). Returns an ID for getPath().
+	int requestPath(SDL_Point start, SDL_Point goal) {
+		int id = m_nextRequestID++;
+		m_requests.push_back({ id, start, goal });
+		m_results[id] = { PATH_PENDING, {} };
+		return id;
+	}
+
+	// Polls a queued query. Once the result is FOUND or FAILED it is handed over and the ID is released.
+	PathStatus getPath(int requestID, std::vector<SDL_Point>& outPath) {
+		auto it = m_results.find(requestID);
+		if (it == m_results.end()) return PATH_UNKNOWN;
+
+		PathStatus status = it->second.status;
+		if (status != PATH_PENDING) {
+			outPath = std::move(it->second.path);
+			m_results.erase(it);
+		}
+		return status;
+	}
+
+	// Returns the shared flow field towards goal, creating it if needed. It is filled in over the next few update() calls.
+	// nullptr if the goal is off the map or can't be walked on.
+	FlowField* getFlowField(SDL_Point goal) {
+		if (!isWalkable(goal.x, goal.y)) return nullptr;
+		uint64_t key = cacheKey(goal, goal);
+		auto it = m_flowFields.find(key);
+		if (it != m_flowFields.end()) return it->second.get();
+
+		auto field = std::make_unique<FlowField>(goal, m_mapSize);
+		FlowField* ptr = field.get();
+		m_flowFields[key] = std::move(field);
+		return ptr;
+	}
+
+	// Drops a flow field no agent is using anymore.
+	void releaseFlowField(SDL_Point goal) {
+		m_flowFields.erase(cacheKey(goal, goal));
+	}
+
+	// Repairs changed clusters, then works through queued path requests and unfinished flow fields until budgetMs runs out.
+	// At least one request is always served so a tiny budget can't starve the queue.
+	void update(double budgetMs) {
+		Uint64 start = SDL_GetPerformanceCounter();
+		Uint64 budgetTicks = (Uint64)(budgetMs * SDL_GetPerformanceFrequency() / 1000.0);
+
+		repairDirtyClusters();
+
+		bool first = true;
+		while (!m_requests.empty()) {
+			if (!first && SDL_GetPerformanceCounter() - start >= budgetTicks) return;
+			first = false;
+
+			PathQuery query = m_requests.front();
+			m_requests.pop_front();
+
+			auto it = m_results.find(query.id);
+			if (it == m_results.end()) continue; // Abandoned
+
+			it->second.status = findPath(query.start, query.goal, it->second.path) ? PATH_FOUND : PATH_FAILED;
+		}
+
+		for (auto& field : m_flowFields) {
+			FlowField& flow = *field.second;
+			while (!flow.m_complete) {
+				if (SDL_GetPerformanceCounter() - start >= budgetTicks) return;
+				stepFlowField(flow, 1024);
+			}
+		}
+	}
+
+	size_t maxCachedPaths = 4096;
+
+private:
+	struct NavEdge {
+		int to;
+		int cost;
+	};
+
+	struct NavNode {
+		int cell; // y * mapWidth + x
+		int cluster;
+		int border; // The border that created this entrance
+		std::vector<NavEdge> edges;
+	};
+
+	struct PathQuery {
+		int id;
+		SDL_Point start, goal;
+	};
+
+	struct PathResult {
+		PathStatus status;
+		std::vector<SDL_Point> path;
+	};
+
+	//Straight and diagonal step costs, scaled so the octile heuristic stays in integers.
+	static constexpr int straightCost = 10;
+	static constexpr int diagonalCost = 14;
+
+	int clusterOf(int x, int y) const {
+		return (y / Map::chunkSize) * m_clusterCount.x + (x / Map::chunkSize);
+	}
+
+	SDL_Rect clusterBounds(int cluster) const {
+		int cx = cluster % m_clusterCount.x, cy = cluster / m_clusterCount.x;
+		SDL_Rect r = { cx * Map::chunkSize, cy * Map::chunkSize, Map::chunkSize, Map::chunkSize };
+		r.w = std::min(r.w, m_mapSize.x - r.x);
+		r.h = std::min(r.h, m_mapSize.y - r.y);
+		return r;
+	}
+
+	static uint64_t cacheKey(SDL_Point a, SDL_Point b) {
+		return ((uint64_t)(uint16_t)a.x << 48) | ((uint64_t)(uint16_t)a.y << 32) | ((uint64_t)(uint16_t)b.x << 16) | (uint64_t)(uint16_t)b.y;
+	}
+
+	static int octile(SDL_Point a, SDL_Point b) {
+		int dx = std::abs(a.x - b.x), dy = std::abs(a.y - b.y);
+		return straightCost * std::max(dx, dy) + (diagonalCost - straightCost) * std::min(dx, dy);
+	}
+
+	static bool inRect(const SDL_Rect& r, int x, int y) {
+		return x >= r.x && y >= r.y && x < r.x + r.w && y < r.y + r.h;
+	}
+
+	//Diagonal moves are only allowed when both side cells are open, so agents never clip an entity's corner.
+	bool canStep(int x, int y, int dx, int dy, const SDL_Rect& bounds) const {
+		int nx = x + dx, ny = y + dy;
+		if (!inRect(bounds, nx, ny) || !isWalkable(nx, ny)) return false;
+		if (dx != 0 && dy != 0) {
+			return isWalkable(x + dx, y) && isWalkable(x, y + dy);
+		}
+		return true;
+	}
+
+	// Dijkstra from a cell, limited to bounds. Fills cost (bounds-local, INT_MAX if unreached).
+	void localCosts(SDL_Point from, const SDL_Rect& bounds, std::vector<int>& cost) const {
+		cost.assign((size_t)bounds.w * bounds.h, INT_MAX);
+		typedef std::pair<int, int> Entry; // cost, local index
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+		int startIndex = (from.y - bounds.y) * bounds.w + (from.x - bounds.x);
+		cost[startIndex] = 0;
+		open.push({ 0, startIndex });
+
+		while (!open.empty()) {
+			Entry top = open.top();
+			open.pop();
+			if (top.first > cost[top.second]) continue;
+
+			int x = bounds.x + top.second % bounds.w, y = bounds.y + top.second / bounds.w;
+			for (int d = 0; d < 8; d++) {
+				int dx = FlowField::s_dirs[d].x, dy = FlowField::s_dirs[d].y;
+				if (!canStep(x, y, dx, dy, bounds)) continue;
+
+				int next = (y + dy - bounds.y) * bounds.w + (x + dx - bounds.x);
+				int nextCost = top.first + ((dx != 0 && dy != 0) ? diagonalCost : straightCost);
+				if (nextCost < cost[next]) {
+					cost[next] = nextCost;
+					open.push({ nextCost, next });
+				}
+			}
+		}
+	}
+
+	// A* between two cells without leaving bounds. Appends nothing and returns false if there's no path.
+	bool localAStar(SDL_Point start, SDL_Point goal, const SDL_Rect& bounds, std::vector<SDL_Point>& outPath) const {
+		std::vector<int> cost((size_t)bounds.w * bounds.h, INT_MAX);
+		std::vector<int> parent((size_t)bounds.w * bounds.h, -1);
+		typedef std::pair<int, int> Entry; // f, local index
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+		auto local = [&](int x, int y) { return (y - bounds.y) * bounds.w + (x - bounds.x); };
+		int startIndex = local(start.x, start.y), goalIndex = local(goal.x, goal.y);
+		cost[startIndex] = 0;
+		open.push({ octile(start, goal), startIndex });
+
+		while (!open.empty()) {
+			int current = open.top().second;
+			open.pop();
+			if (current == goalIndex) break;
+
+			int x = bounds.x + current % bounds.w, y = bounds.y + current / bounds.w;
+			for (int d = 0; d < 8; d++) {
+				int dx = FlowField::s_dirs[d].x, dy = FlowField::s_dirs[d].y;
+				if (!canStep(x, y, dx, dy, bounds)) continue;
+
+				int next = local(x + dx, y + dy);
+				int nextCost = cost[current] + ((dx != 0 && dy != 0) ? diagonalCost : straightCost);
+				if (nextCost < cost[next]) {
+					cost[next] = nextCost;
+					parent[next] = current;
+					open.push({ nextCost + octile({ x + dx, y + dy }, goal), next });
+				}
+			}
+		}
+
+		if (cost[goalIndex] == INT_MAX) return false;
+
+		size_t first = outPath.size();
+		for (int i = goalIndex; i != -1; i = parent[i]) {
+			outPath.push_back({ bounds.x + i % bounds.w, bounds.y + i / bounds.w });
+		}
+		std::reverse(outPath.begin() + first, outPath.end());
+		return true;
+	}
+
+	int addNode(int cell, int cluster, int border) {
+		int id;
+		if (!m_freeNodes.empty()) {
+			id = m_freeNodes.back();
+			m_freeNodes.pop_back();
+			m_nodes[id] = { cell, cluster, border, {} };
+		}
+		else {
+			id = (int)m_nodes.size();
+			m_nodes.push_back({ cell, cluster, border, {} });
+		}
+		m_clusterNodes[cluster].push_back(id);
+		m_borderNodes[border].push_back(id);
+		return id;
+	}
+
+	// The freed IDs get handed out again straight away, often in another cluster, so every edge into a removed node is
+	// dropped here. Those can only come from its own cluster or from its pair partner, which is on the same border.
+	void removeBorderNodes(int border) {
+		std::vector<int>& removed = m_borderNodes[border];
+		if (removed.empty()) return;
+
+		int clusters[2] = { -1, -1 };
+		for (int id : removed) {
+			int cluster = m_nodes[id].cluster;
+			auto& list = m_clusterNodes[cluster];
+			list.erase(std::remove(list.begin(), list.end(), id), list.end());
+			if (clusters[0] == -1 || clusters[0] == cluster) clusters[0] = cluster;
+			else clusters[1] = cluster;
+		}
+		for (int cluster : clusters) {
+			if (cluster == -1) continue;
+			for (int id : m_clusterNodes[cluster]) {
+				auto& edges = m_nodes[id].edges;
+				edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const NavEdge& e) {
+					return std::find(removed.begin(), removed.end(), e.to) != removed.end();
+				}), edges.end());
+			}
+		}
+
+		for (int id : removed) {
+			m_nodes[id].edges.clear();
+			m_freeNodes.push_back(id);
+		}
+		removed.clear();
+	}
+
+	// Finds the entrances on the east (or south) border of a cluster. Each run of cells that are open on both
+	// sides gets one entrance pair in its middle, long runs get one at each end so paths don't funnel through a single cell.
+	void buildBorder(int cluster, bool east) {
+		int border = cluster * 2 + (east ? 0 : 1);
+		removeBorderNodes(border);
+
+		SDL_Rect r = clusterBounds(cluster);
+		int cx = cluster % m_clusterCount.x, cy = cluster / m_clusterCount.x;
+		if (east && cx + 1 >= m_clusterCount.x) return;
+		if (!east && cy + 1 >= m_clusterCount.y) return;
+
+		int length = east ? r.h : r.w;
+		int neighbour = east ? cluster + 1 : cluster + m_clusterCount.x;
+
+		auto cellA = [&](int i) { return east ? SDL_Point{ r.x + r.w - 1, r.y + i } : SDL_Point{ r.x + i, r.y + r.h - 1 }; };
+		auto cellB = [&](int i) { return east ? SDL_Point{ r.x + r.w, r.y + i } : SDL_Point{ r.x + i, r.y + r.h }; };
+		auto open = [&](int i) { SDL_Point a = cellA(i), b = cellB(i); return isWalkable(a.x, a.y) && isWalkable(b.x, b.y); };
+
+		auto addPair = [&](int i) {
+			SDL_Point a = cellA(i), b = cellB(i);
+			int na = addNode(a.y * m_mapSize.x + a.x, cluster, border);
+			int nb = addNode(b.y * m_mapSize.x + b.x, neighbour, border);
+			m_nodes[na].edges.push_back({ nb, straightCost });
+			m_nodes[nb].edges.push_back({ na, straightCost });
+		};
+
+		int i = 0;
+		while (i < length) {
+			if (!open(i)) { i++; continue; }
+			int runStart = i;
+			while (i < length && open(i)) i++;
+			int runEnd = i - 1;
+
+			if (runEnd - runStart >= 6) {
+				addPair(runStart);
+				addPair(runEnd);
+			}
+			else {
+				addPair((runStart + runEnd) / 2);
+			}
+		}
+	}
+
+	// Links every entrance of a cluster to the others it can reach inside the cluster.
+	void buildIntraEdges(int cluster) {
+		SDL_Rect r = clusterBounds(cluster);
+		const auto& nodes = m_clusterNodes[cluster];
+
+		for (int id : nodes) {
+			auto& edges = m_nodes[id].edges;
+			edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const NavEdge& e) { return m_nodes[e.to].cluster == cluster; }), edges.end());
+		}
+
+		std::vector<int> cost;
+		for (int id : nodes) {
+			int cell = m_nodes[id].cell;
+			localCosts({ cell % m_mapSize.x, cell / m_mapSize.x }, r, cost);
+			for (int other : nodes) {
+				if (other == id) continue;
+				int oc = m_nodes[other].cell;
+				int c = cost[(oc / m_mapSize.x - r.y) * r.w + (oc % m_mapSize.x - r.x)];
+				if (c != INT_MAX) {
+					m_nodes[id].edges.push_back({ other, c });
+				}
+			}
+		}
+	}
+
+	// Rebuilds the borders around each changed cluster and the intra edges of every cluster that shares one of them.
+	void repairDirtyClusters() {
+		if (m_dirtyClusters.empty()) return;
+
+		std::unordered_set<int> touched;
+		for (int c : m_dirtyClusters) {
+			int cx = c % m_clusterCount.x, cy = c / m_clusterCount.x;
+			buildBorder(c, true);
+			buildBorder(c, false);
+			touched.insert(c);
+			if (cx > 0) { buildBorder(c - 1, true); touched.insert(c - 1); }
+			if (cy > 0) { buildBorder(c - m_clusterCount.x, false); touched.insert(c - m_clusterCount.x); }
+			if (cx + 1 < m_clusterCount.x) touched.insert(c + 1);
+			if (cy + 1 < m_clusterCount.y) touched.insert(c + m_clusterCount.x);
+		}
+		for (int c : touched) {
+			buildIntraEdges(c);
+		}
+
+		//Only cached paths that pass through a repaired cluster can be stale.
+		for (auto it = m_pathCache.begin(); it != m_pathCache.end();) {
+			bool stale = false;
+			for (const SDL_Point& p : it->second) {
+				if (touched.count(clusterOf(p.x, p.y))) { stale = true; break; }
+			}
+			it = stale ? m_pathCache.erase(it) : std::next(it);
+		}
+
+		m_dirtyClusters.clear();
+	}
+
+	// A* over the abstract graph with start and goal linked into their clusters, then refined hop by hop.
+	bool hierarchicalPath(SDL_Point start, SDL_Point goal, std::vector<SDL_Point>& outPath) {
+		int startCluster = clusterOf(start.x, start.y), goalCluster = clusterOf(goal.x, goal.y);
+		SDL_Rect startBounds = clusterBounds(startCluster), goalBounds = clusterBounds(goalCluster);
+
+		std::vector<int> startCost, goalCost;
+		localCosts(start, startBounds, startCost);
+		localCosts(goal, goalBounds, goalCost);
+
+		auto localCost = [&](const std::vector<int>& costs, const SDL_Rect& r, int cell) {
+			return costs[(cell / m_mapSize.x - r.y) * r.w + (cell % m_mapSize.x - r.x)];
+		};
+
+		//Node IDs past the end of m_nodes stand in for the goal, so the search can finish on a virtual edge.
+		const int goalNode = (int)m_nodes.size();
+		std::unordered_map<int, int> cost, parent;
+		typedef std::pair<int, int> Entry; // f, node
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+		auto nodePoint = [&](int id) { int cell = m_nodes[id].cell; return SDL_Point{ cell % m_mapSize.x, cell / m_mapSize.x }; };
+		auto relax = [&](int from, int to, int c) {
+			auto it = cost.find(to);
+			if (it != cost.end() && it->second <= c) return;
+			cost[to] = c;
+			parent[to] = from;
+			open.push({ c + (to == goalNode ? 0 : octile(nodePoint(to), goal)), to });
+		};
+
+		for (int id : m_clusterNodes[startCluster]) {
+			int c = localCost(startCost, startBounds, m_nodes[id].cell);
+			if (c != INT_MAX) relax(-1, id, c);
+		}
+
+		bool found = false;
+		while (!open.empty()) {
+			Entry top = open.top();
+			open.pop();
+			int node = top.second;
+			if (node == goalNode) { found = true; break; }
+
+			int nodeCost = cost[node];
+			if (top.first - octile(nodePoint(node), goal) > nodeCost) continue;
+
+			if (m_nodes[node].cluster == goalCluster) {
+				int c = localCost(goalCost, goalBounds, m_nodes[node].cell);
+				if (c != INT_MAX) relax(node, goalNode, nodeCost + c);
+			}
+			for (const NavEdge& e : m_nodes[node].edges) {
+				relax(node, e.to, nodeCost + e.cost);
+			}
+		}
+		if (!found) return false;
+
+		std::vector<SDL_Point> waypoints;
+		waypoints.push_back(goal);
+		for (int n = parent[goalNode]; n != -1; n = parent[n]) {
+			waypoints.push_back(nodePoint(n));
+		}
+		waypoints.push_back(start);
+		std::reverse(waypoints.begin(), waypoints.end());
+
+		//Refine: consecutive waypoints either share a cluster or sit either side of a border.
+		outPath.push_back(start);
+		for (size_t i = 1; i < waypoints.size(); i++) {
+			SDL_Point a = waypoints[i - 1], b = waypoints[i];
+			if (a.x == b.x && a.y == b.y) continue;
+
+			int ca = clusterOf(a.x, a.y);
+			if (ca != clusterOf(b.x, b.y)) {
+				outPath.push_back(b);
+				continue;
+			}
+			std::vector<SDL_Point> segment;
+			if (!localAStar(a, b, clusterBounds(ca), segment)) return false;
+			outPath.insert(outPath.end(), segment.begin() + 1, segment.end());
+		}
+		return true;
+	}
+
+	// Expands up to maxCells cells of a flow field's breadth first search.
+	void stepFlowField(FlowField& flow, int maxCells) {
+		SDL_Rect all = { 0, 0, m_mapSize.x, m_mapSize.y };
+		if (!isWalkable(flow.goal.x, flow.goal.y)) {
+			flow.m_frontier.clear();
+		}
+
+		for (int n = 0; n < maxCells && !flow.m_frontier.empty(); n++) {
+			int cell = flow.m_frontier.front();
+			flow.m_frontier.pop_front();
+			int x = cell % m_mapSize.x, y = cell / m_mapSize.x;
+
+			for (int d = 0; d < 8; d++) {
+				int dx = FlowField::s_dirs[d].x, dy = FlowField::s_dirs[d].y;
+				if (!canStep(x, y, dx, dy, all)) continue;
+
+				int next = (y + dy) * m_mapSize.x + (x + dx);
+				if (flow.m_dist[next] != INT_MAX) continue;
+
+				flow.m_dist[next] = flow.m_dist[cell] + 1;
+				flow.m_dir[next] = (int8_t)((d + 4) % 8); // Points back at the cell we came from
+				flow.m_frontier.push_back(next);
+			}
+		}
+		flow.m_complete = flow.m_frontier.empty();
+	}
+
+private:
+	SDL_Point m_mapSize;
+	SDL_Point m_clusterCount;
+	std::vector<uint8_t> m_walkable;
+
+	std::vector<NavNode> m_nodes;
+	std::vector<int> m_freeNodes;
+	std::vector<std::vector<int>> m_clusterNodes; // Node IDs per cluster
+	std::vector<std::vector<int>> m_borderNodes; // Node IDs per border, cluster * 2 (east) and cluster * 2 + 1 (south)
+	std::unordered_set<int> m_dirtyClusters;
+
+	std::unordered_map<uint64_t, std::vector<SDL_Point>> m_pathCache;
+	std::unordered_map<uint64_t, std::unique_ptr<FlowField>> m_flowFields;
+
+	std::deque<PathQuery> m_requests;
+	std::unordered_map<int, PathResult> m_results;
+	int m_nextRequestID = 1;
+};
+
+#endif
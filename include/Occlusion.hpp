@@ -0,0 +1,141 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include "SDL.h"
+
+#include "mapReader.hpp"
+#include "MemoryTracker.hpp"
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+//Which ground tiles are completely hidden under the opaque parts of entity sprites, so they can be skipped.
+//Worked out per chunk and cached. A chunk is rebuilt when it or one of its neighbours is edited (the map lists them in a
+//DirtyChunks), since an entity standing in the next chunk can reach over the border (sprites are assumed smaller than a
+//chunk). Only the entities listed in those 3x3 chunks are looked at.
+//A tile only counts as hidden if the sprite is also opaque for a pixel around it, so rounding at odd zoom levels can't
+//open a gap between the sprite and the tile edge.
+
+class GroundOcclusion {
+public:
+	// The world rect an entity's sprite is drawn over.
+	using SpriteBounds = std::function<SDL_Rect(const Tile& entity)>;
+	// Whether an entity's sprite is fully opaque over area, given in sprite pixels from its top left.
+	using OpaqueTest = std::function<bool(const Tile& entity, const SDL_Rect& area)>;
+
+	GroundOcclusion(const Map& map, SpriteBounds bounds, OpaqueTest isOpaque)
+		: m_map(map), m_bounds(bounds), m_isOpaque(isOpaque) {
+		m_mapSize = map.getMapSize();
+		m_chunkCount = map.getChunkCount();
+		m_hidden.assign((size_t)m_mapSize.x * m_mapSize.y, 0);
+		m_rebuild.assign((size_t)m_chunkCount.x * m_chunkCount.y, 1);
+		for (int i = 0; i < (int)m_rebuild.size(); i++) m_pending.push_back(i);
+		m_map.trackChunks(m_dirty);
+		m_memory.set(MemoryTracker::vectorHeap(m_hidden) + MemoryTracker::vectorHeap(m_rebuild) + MemoryTracker::vectorHeap(m_dirty.flagged));
+	}
+
+	~GroundOcclusion() {
+		m_map.untrackChunks(m_dirty);
+	}
+
+	GroundOcclusion(const GroundOcclusion&) = delete;
+	GroundOcclusion& operator=(const GroundOcclusion&) = delete;
+
+	// Rebuilds every chunk that's out of date. Returns how many were rebuilt.
+	int update() {
+		for (int chunk : m_dirty.chunks) {
+			int cx = chunk % m_chunkCount.x, cy = chunk / m_chunkCount.x;
+			for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, m_chunkCount.y - 1); ny++) {
+				for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, m_chunkCount.x - 1); nx++) {
+					int neighbour = ny * m_chunkCount.x + nx;
+					if (m_rebuild[neighbour]) continue;
+					m_rebuild[neighbour] = 1;
+					m_pending.push_back(neighbour);
+				}
+			}
+		}
+		m_dirty.clear();
+
+		int rebuilt = (int)m_pending.size();
+		for (int chunk : m_pending) {
+			buildChunk(chunk % m_chunkCount.x, chunk / m_chunkCount.x);
+			m_rebuild[chunk] = 0;
+		}
+		m_pending.clear();
+		return rebuilt;
+	}
+
+	bool isHidden(int x, int y) const {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return false;
+		return m_hidden[y * m_mapSize.x + x] != 0;
+	}
+
+	// Tiles hidden across the whole map.
+	int getHiddenCount() const {
+		return m_hiddenCount;
+	}
+
+private:
+
+	void buildChunk(int cx, int cy) {
+		SDL_Point tileSize = m_map.getTileSize();
+		int x0 = cx * Map::chunkSize, y0 = cy * Map::chunkSize;
+		int x1 = std::min(x0 + Map::chunkSize, m_mapSize.x), y1 = std::min(y0 + Map::chunkSize, m_mapSize.y);
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				uint8_t& hidden = m_hidden[y * m_mapSize.x + x];
+				m_hiddenCount -= hidden;
+				hidden = 0;
+			}
+		}
+
+		SDL_Rect chunkRect = { x0 * tileSize.x, y0 * tileSize.y, (x1 - x0) * tileSize.x, (y1 - y0) * tileSize.y };
+		for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, m_chunkCount.y - 1); ny++) {
+			for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, m_chunkCount.x - 1); nx++) {
+				for (int index : m_map.getChunkEntities(nx, ny)) {
+					hideUnder(m_map.tileMap[index], chunkRect, tileSize);
+				}
+			}
+		}
+	}
+
+	// Hides the tiles inside chunkRect that the entity's sprite fully covers.
+	void hideUnder(const Tile& tile, const SDL_Rect& chunkRect, SDL_Point tileSize) {
+		SDL_Rect sprite = m_bounds(tile);
+		SDL_Rect overlap;
+		if (!SDL_IntersectRect(&sprite, &chunkRect, &overlap)) return;
+
+		//Every tile fully inside the overlap, plus the pixel of margin.
+		int tx0 = (overlap.x + tileSize.x - 1) / tileSize.x, ty0 = (overlap.y + tileSize.y - 1) / tileSize.y;
+		int tx1 = (overlap.x + overlap.w) / tileSize.x, ty1 = (overlap.y + overlap.h) / tileSize.y;
+		for (int y = ty0; y < ty1; y++) {
+			for (int x = tx0; x < tx1; x++) {
+				uint8_t& hidden = m_hidden[y * m_mapSize.x + x];
+				if (hidden) continue;
+				SDL_Rect area = { x * tileSize.x - sprite.x - 1, y * tileSize.y - sprite.y - 1, tileSize.x + 2, tileSize.y + 2 };
+				if (m_isOpaque(tile, area)) {
+					hidden = 1;
+					m_hiddenCount++;
+				}
+			}
+		}
+	}
+
+	const Map& m_map;
+	SpriteBounds m_bounds;
+	OpaqueTest m_isOpaque;
+
+	SDL_Point m_mapSize;
+	SDL_Point m_chunkCount;
+	std::vector<uint8_t> m_hidden; // Per tile, row major
+	DirtyChunks m_dirty; // Chunks edited since the last update(), filled in by the map
+	std::vector<uint8_t> m_rebuild; // Per chunk, set while it's in m_pending
+	std::vector<int> m_pending;
+	int m_hiddenCount = 0;
+
+	TrackedBytes m_memory{ MEM_MAP_TILES };
+};
+
+#endif
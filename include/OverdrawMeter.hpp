@@ -0,0 +1,128 @@
+#ifndef OVERDRAWMETER_HPP
+#define OVERDRAWMETER_HPP
+
+#include "SDL.h"
+
+#include "MemoryTracker.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+//Debug counter of how many times each pixel of the view gets drawn in a frame.
+//Callers add() the screen rect of every copy they make. Each rect costs four writes into a difference grid; the per
+//pixel counts are only summed up when they're asked for, so leaving it enabled is cheap. drawHeatmap() colours the
+//view by count: blue once, green twice, yellow three times, red four or more.
+
+class OverdrawMeter {
+public:
+	OverdrawMeter(SDL_Renderer* renderer) : renderer(renderer) {}
+
+	~OverdrawMeter() {
+		MemoryTracker::destroyTexture(m_heatmap);
+	}
+
+	OverdrawMeter(const OverdrawMeter&) = delete;
+	OverdrawMeter& operator=(const OverdrawMeter&) = delete;
+
+	// Starts a frame's count over a view of viewSize pixels.
+	void begin(SDL_Point viewSize) {
+		if (!enabled) return;
+		if (viewSize.x != m_size.x || viewSize.y != m_size.y) {
+			m_size = viewSize;
+			m_counts.assign((size_t)(m_size.x + 1) * (m_size.y + 1), 0);
+			MemoryTracker::destroyTexture(m_heatmap);
+			m_heatmap = nullptr;
+		}
+		else {
+			std::fill(m_counts.begin(), m_counts.end(), 0);
+		}
+		m_drawnPixels = 0;
+		m_summed = false;
+	}
+
+	void add(const SDL_Rect& dest) {
+		if (!enabled || m_counts.empty()) return;
+		int x0 = std::max(dest.x, 0), y0 = std::max(dest.y, 0);
+		int x1 = std::min(dest.x + dest.w, m_size.x), y1 = std::min(dest.y + dest.h, m_size.y);
+		if (x0 >= x1 || y0 >= y1) return;
+
+		size_t stride = (size_t)m_size.x + 1;
+		m_counts[y0 * stride + x0]++;
+		m_counts[y0 * stride + x1]--;
+		m_counts[y1 * stride + x0]--;
+		m_counts[y1 * stride + x1]++;
+		m_drawnPixels += (int64_t)(x1 - x0) * (y1 - y0);
+	}
+
+	// Pixels drawn over the pixels in view, 1.0 means every pixel was drawn exactly once on average.
+	double getAverage() const {
+		if (m_size.x <= 0 || m_size.y <= 0) return 0.0;
+		return (double)m_drawnPixels / ((double)m_size.x * m_size.y);
+	}
+
+	int64_t getDrawnPixels() const {
+		return m_drawnPixels;
+	}
+
+	// Draws the counts over the view at the given opacity.
+	void drawHeatmap(Uint8 alpha = 160) {
+		if (!enabled || renderer == nullptr || m_counts.empty()) return;
+		sum();
+
+		if (m_heatmap == nullptr) {
+			m_heatmap = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, m_size.x, m_size.y);
+			if (m_heatmap == nullptr) {
+				std::printf("Failed to create the overdraw heatmap: %s\n", SDL_GetError());
+				enabled = false;
+				return;
+			}
+			SDL_SetTextureBlendMode(m_heatmap, SDL_BLENDMODE_BLEND);
+			MemoryTracker::trackTexture(m_heatmap);
+		}
+
+		static const Uint32 colours[5] = { 0x00000000, 0xFF2040FF, 0xFF20C040, 0xFFF0E020, 0xFFF02020 };
+		void* pixels;
+		int pitch;
+		if (SDL_LockTexture(m_heatmap, NULL, &pixels, &pitch) != 0) return;
+		size_t stride = (size_t)m_size.x + 1;
+		for (int y = 0; y < m_size.y; y++) {
+			Uint32* row = (Uint32*)((uint8_t*)pixels + (size_t)y * pitch);
+			const int32_t* counts = m_counts.data() + y * stride;
+			for (int x = 0; x < m_size.x; x++) {
+				row[x] = colours[std::min(std::max(counts[x], 0), 4)];
+			}
+		}
+		SDL_UnlockTexture(m_heatmap);
+		SDL_SetTextureAlphaMod(m_heatmap, alpha);
+		SDL_RenderCopy(renderer, m_heatmap, NULL, NULL);
+	}
+
+	SDL_Renderer* renderer;
+	bool enabled = false;
+
+private:
+	// Turns the difference grid into per pixel counts, in place.
+	void sum() {
+		if (m_summed) return;
+		size_t stride = (size_t)m_size.x + 1;
+		for (int y = 0; y <= m_size.y; y++) {
+			int32_t* row = m_counts.data() + y * stride;
+			for (int x = 1; x <= m_size.x; x++) row[x] += row[x - 1];
+			if (y > 0) {
+				const int32_t* above = row - stride;
+				for (int x = 0; x <= m_size.x; x++) row[x] += above[x];
+			}
+		}
+		m_summed = true;
+	}
+
+	SDL_Point m_size = { 0, 0 };
+	std::vector<int32_t> m_counts; // (m_size.x + 1) * (m_size.y + 1)
+	int64_t m_drawnPixels = 0;
+	bool m_summed = false;
+	SDL_Texture* m_heatmap = nullptr;
+};
+
+#endif
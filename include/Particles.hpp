@@ -0,0 +1,243 @@
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+#include "SDL.h"
+
+#include "Player.hpp"
+#include "Camera.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+//Pooled particles (falling needles, footstep dust, embers...).
+//Every particle type gets its own fixed size pool allocated up front, stored as one array per field so the update is a
+//plain loop over floats the compiler can vectorize. Dead particles are swapped with the last live one, so a frame never
+//allocates. Drawing builds quads for every pool and records each texture's quads as a single geometry command.
+
+struct ParticleType {
+	TextureAtlas* atlas = nullptr;
+	int textureID = 1; // Sub texture of atlas drawn for every particle
+
+	int capacity = 1024; // Emits past this are dropped
+
+	float lifeMin = 1.0f, lifeMax = 1.0f; // Seconds
+	SDL_FPoint velocityMin = { 0, 0 }, velocityMax = { 0, 0 }; // Pixels a second
+	SDL_FPoint acceleration = { 0, 0 }; // eg. gravity, pixels a second squared
+	float drag = 0.0f; // Fraction of the velocity lost per second
+	float spawnRadius = 0.0f; // Particles start anywhere in a square this far either side of the emit position
+
+	float startSize = 4.0f, endSize = 4.0f; // Pixels, lerped over the particle's life
+	SDL_Color startColour = { 255, 255, 255, 255 }, endColour = { 255, 255, 255, 0 };
+};
+
+class ParticlePool {
+public:
+	ParticlePool(const ParticleType& type) : type(type) {
+		size_t n = (size_t)std::max(type.capacity, 0);
+		m_x.resize(n); m_y.resize(n);
+		m_vx.resize(n); m_vy.resize(n);
+		m_age.resize(n); m_ageRate.resize(n);
+	}
+
+	// Spawns up to count particles around pos, returns how many fitted in the pool.
+	int emit(SDL_FPoint pos, int count, uint32_t& rng) {
+		int spawned = 0;
+		while (spawned < count && m_count < m_x.size()) {
+			size_t i = m_count++;
+			m_x[i] = pos.x + random(rng, -type.spawnRadius, type.spawnRadius);
+			m_y[i] = pos.y + random(rng, -type.spawnRadius, type.spawnRadius);
+			m_vx[i] = random(rng, type.velocityMin.x, type.velocityMax.x);
+			m_vy[i] = random(rng, type.velocityMin.y, type.velocityMax.y);
+			m_age[i] = 0.0f;
+			m_ageRate[i] = 1.0f / std::max(random(rng, type.lifeMin, type.lifeMax), 0.001f);
+			spawned++;
+		}
+		return spawned;
+	}
+
+	void update(float deltaSeconds) {
+		//Everything per particle is branch free so this loop vectorizes, the constants are worked out once outside it.
+		float ax = type.acceleration.x * deltaSeconds, ay = type.acceleration.y * deltaSeconds;
+		float damping = 1.0f / (1.0f + type.drag * deltaSeconds);
+		float* __restrict x = m_x.data();
+		float* __restrict y = m_y.data();
+		float* __restrict vx = m_vx.data();
+		float* __restrict vy = m_vy.data();
+		float* __restrict age = m_age.data();
+		const float* __restrict ageRate = m_ageRate.data();
+		size_t n = m_count;
+		for (size_t i = 0; i < n; i++) {
+			vx[i] = (vx[i] + ax) * damping;
+			vy[i] = (vy[i] + ay) * damping;
+			x[i] += vx[i] * deltaSeconds;
+			y[i] += vy[i] * deltaSeconds;
+			age[i] += ageRate[i] * deltaSeconds;
+		}
+
+		//Swap and pop the dead, the particle swapped in gets checked on the same index.
+		size_t i = 0;
+		while (i < n) {
+			if (age[i] >= 1.0f) {
+				n--;
+				x[i] = x[n]; y[i] = y[n];
+				vx[i] = vx[n]; vy[i] = vy[n];
+				age[i] = age[n]; m_ageRate[i] = m_ageRate[n];
+			}
+			else {
+				i++;
+			}
+		}
+		m_count = n;
+	}
+
+	// Writes a quad per live particle (in screen space, through camera) into out, which must have room for 4 * getCount() vertices.
+	// Returns the number of vertices written.
+	size_t buildQuads(SDL_Vertex* out, const Camera& camera) const {
+		if (type.atlas == nullptr || m_count == 0) return 0;
+
+		auto sub = type.atlas->subTextures.find(type.textureID);
+		if (sub == type.atlas->subTextures.end()) return 0;
+		SDL_Point cell = type.atlas->subTextureSize;
+		float u0 = (float)(sub->second.x * cell.x) / type.atlas->atlasSize.x;
+		float v0 = (float)(sub->second.y * cell.y) / type.atlas->atlasSize.y;
+		float u1 = u0 + (float)cell.x / type.atlas->atlasSize.x;
+		float v1 = v0 + (float)cell.y / type.atlas->atlasSize.y;
+
+		float zoom = camera.zoom;
+		float startHalf = type.startSize * 0.5f * zoom, halfRange = (type.endSize - type.startSize) * 0.5f * zoom;
+		const SDL_Color& c0 = type.startColour;
+		const SDL_Color& c1 = type.endColour;
+		for (size_t i = 0; i < m_count; i++) {
+			float t = m_age[i];
+			float half = startHalf + halfRange * t;
+			SDL_Color colour = {
+				(Uint8)(c0.r + (c1.r - c0.r) * t), (Uint8)(c0.g + (c1.g - c0.g) * t),
+				(Uint8)(c0.b + (c1.b - c0.b) * t), (Uint8)(c0.a + (c1.a - c0.a) * t)
+			};
+			float px = (m_x[i] - camera.pos.x) * zoom, py = (m_y[i] - camera.pos.y) * zoom;
+			SDL_Vertex* quad = out + i * 4;
+			quad[0] = { { px - half, py - half }, colour, { u0, v0 } };
+			quad[1] = { { px + half, py - half }, colour, { u1, v0 } };
+			quad[2] = { { px + half, py + half }, colour, { u1, v1 } };
+			quad[3] = { { px - half, py + half }, colour, { u0, v1 } };
+		}
+		return m_count * 4;
+	}
+
+	size_t getCount() const {
+		return m_count;
+	}
+
+	size_t getCapacity() const {
+		return m_x.size();
+	}
+
+	void clear() {
+		m_count = 0;
+	}
+
+	const ParticleType type;
+
+private:
+	// xorshift32, cheap and plenty random enough for particles.
+	static float random(uint32_t& rng, float min, float max) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return min + (max - min) * ((rng >> 8) * (1.0f / 16777216.0f));
+	}
+
+	std::vector<float> m_x, m_y;
+	std::vector<float> m_vx, m_vy;
+	std::vector<float> m_age; // 0 at spawn, dead at 1
+	std::vector<float> m_ageRate; // 1 / lifetime
+	size_t m_count = 0;
+};
+
+class ParticleSystem {
+public:
+	// Registers a particle type and allocates its pool. Returns the ID used with emit().
+	int addType(const std::string& name, const ParticleType& type) {
+		if (type.atlas == nullptr || type.atlas->atlas == nullptr) {
+			std::printf("Particle type %s has no texture atlas, it won't be drawn\n", name.c_str());
+		}
+		m_pools.emplace_back(type);
+		m_names.push_back(name);
+
+		//Pools are drawn grouped by texture so each texture is one draw call.
+		m_drawOrder.push_back(m_pools.size() - 1);
+		std::stable_sort(m_drawOrder.begin(), m_drawOrder.end(), [&](size_t a, size_t b) { return textureOf(a) < textureOf(b); });
+
+		//Sized for every pool being full, so drawing never has to grow anything.
+		size_t quads = 0;
+		for (const ParticlePool& pool : m_pools) quads += pool.getCapacity();
+		m_vertices.resize(quads * 4);
+		while (m_indices.size() < quads * 6) {
+			int base = (int)(m_indices.size() / 6) * 4;
+			m_indices.insert(m_indices.end(), { base, base + 1, base + 2, base + 2, base + 3, base });
+		}
+		return (int)m_pools.size() - 1;
+	}
+
+	// Returns the ID of a type by name, or -1.
+	int getType(const std::string& name) const {
+		for (size_t i = 0; i < m_names.size(); i++) {
+			if (m_names[i] == name) return (int)i;
+		}
+		return -1;
+	}
+
+	int emit(int typeID, SDL_FPoint pos, int count = 1) {
+		if (typeID < 0 || typeID >= (int)m_pools.size()) return 0;
+		return m_pools[typeID].emit(pos, count, m_rng);
+	}
+
+	// deltaTime is in ms, like Window::deltaTime.
+	void update(double deltaTime) {
+		float seconds = (float)(deltaTime / 1000.0);
+		for (ParticlePool& pool : m_pools) {
+			pool.update(seconds);
+		}
+	}
+
+	// Each texture's quads go into m_vertices one after the other, since they're only read when the queue is flushed.
+	void draw(RenderRecorder& out, const Camera& camera) {
+		size_t i = 0, start = 0;
+		while (i < m_drawOrder.size()) {
+			SDL_Texture* texture = textureOf(m_drawOrder[i]);
+			size_t vertexCount = 0;
+			for (; i < m_drawOrder.size() && textureOf(m_drawOrder[i]) == texture; i++) {
+				vertexCount += m_pools[m_drawOrder[i]].buildQuads(m_vertices.data() + start + vertexCount, camera);
+			}
+			//Only atlases with cells give quads, headless replays record them without a texture.
+			if (vertexCount > 0) {
+				out.geometry(LAYER_PARTICLES, 0, texture, m_vertices.data() + start, (int)vertexCount, m_indices.data(), (int)(vertexCount / 4 * 6));
+			}
+			start += vertexCount;
+		}
+	}
+
+	size_t getLiveCount() const {
+		size_t n = 0;
+		for (const ParticlePool& pool : m_pools) n += pool.getCount();
+		return n;
+	}
+
+private:
+	SDL_Texture* textureOf(size_t pool) const {
+		const TextureAtlas* atlas = m_pools[pool].type.atlas;
+		return atlas ? atlas->atlas : nullptr;
+	}
+
+	std::vector<ParticlePool> m_pools;
+	std::vector<std::string> m_names;
+	std::vector<size_t> m_drawOrder; // Pool indices sorted by texture
+
+	std::vector<SDL_Vertex> m_vertices; // Room for every pool being full
+	std::vector<int> m_indices;
+	uint32_t m_rng = 0x9E3779B9u;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef PIXELCANVAS_HPP
+#define PIXELCANVAS_HPP
+
+#include "SDL.h"
+
+#include "MemoryTracker.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+//A fixed low resolution render target for the world (eg. 400x300), scaled up to the window by a whole number so every
+//texel stays a crisp square, with black bars around whatever doesn't divide evenly.
+//Draw the world between begin() and end(), then the UI at the window's own resolution. Every tile and sprite fills
+//scale^2 fewer pixels than drawing at window size.
+
+class PixelCanvas {
+public:
+	PixelCanvas(SDL_Renderer* renderer, SDL_Point size) : renderer(renderer), m_size(size) {
+		if (renderer == nullptr) return;
+
+		m_target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, size.x, size.y);
+		if (m_target == nullptr) {
+			std::printf("Failed to create the %dx%d canvas, drawing at the window size instead: %s\n", size.x, size.y, SDL_GetError());
+			return;
+		}
+		SDL_SetTextureScaleMode(m_target, SDL_ScaleModeNearest);
+		MemoryTracker::trackTexture(m_target);
+	}
+
+	~PixelCanvas() {
+		MemoryTracker::destroyTexture(m_target);
+	}
+
+	PixelCanvas(const PixelCanvas&) = delete;
+	PixelCanvas& operator=(const PixelCanvas&) = delete;
+
+	// Works out where the canvas goes in a window of this size. Call it at start up and whenever Window::windowResized is set.
+	void fitTo(int windowWidth, int windowHeight) {
+		m_windowSize = { windowWidth, windowHeight };
+		int scaleX = windowWidth / m_size.x, scaleY = windowHeight / m_size.y;
+		m_scale = std::min(scaleX, scaleY);
+		if (m_scale >= 1) {
+			m_dest = { (windowWidth - m_size.x * m_scale) / 2, (windowHeight - m_size.y * m_scale) / 2, m_size.x * m_scale, m_size.y * m_scale };
+		}
+		else {
+			//Window smaller than the canvas, shrink it to fit rather than cut it off.
+			float fit = std::min((float)windowWidth / m_size.x, (float)windowHeight / m_size.y);
+			int w = (int)(m_size.x * fit), h = (int)(m_size.y * fit);
+			m_dest = { (windowWidth - w) / 2, (windowHeight - h) / 2, w, h };
+		}
+	}
+
+	// Starts drawing into the canvas. Returns false (and leaves the target alone) if it's disabled.
+	bool begin() {
+		if (!isActive()) return false;
+		SDL_SetRenderTarget(renderer, m_target);
+		return true;
+	}
+
+	// Goes back to drawing into the window and copies the canvas into it.
+	void end(SDL_Color barColour = { 0, 0, 0, 255 }) {
+		if (!isActive()) return;
+		SDL_SetRenderTarget(renderer, NULL);
+		SDL_SetRenderDrawColor(renderer, barColour.r, barColour.g, barColour.b, barColour.a);
+		SDL_RenderClear(renderer);
+		SDL_RenderCopy(renderer, m_target, NULL, &m_dest);
+	}
+
+	// The size the world is drawn at: the canvas when it's in use, otherwise the window.
+	SDL_Point getViewSize() const {
+		return isActive() ? m_size : m_windowSize;
+	}
+
+	// Maps a window position (eg. the mouse) onto the canvas.
+	SDL_Point windowToCanvas(SDL_Point pos) const {
+		if (!isActive() || m_dest.w <= 0 || m_dest.h <= 0) return pos;
+		return { (pos.x - m_dest.x) * m_size.x / m_dest.w, (pos.y - m_dest.y) * m_size.y / m_dest.h };
+	}
+
+	// Where the canvas lands in the window, eg. to line UI up with the world.
+	const SDL_Rect& getDestRect() const {
+		return m_dest;
+	}
+
+	int getScale() const {
+		return m_scale;
+	}
+
+	bool isActive() const {
+		return enabled && m_target != nullptr;
+	}
+
+	SDL_Renderer* renderer;
+	bool enabled = true; // Off draws straight to the window at full resolution
+
+private:
+	SDL_Point m_size;
+	SDL_Point m_windowSize = { 0, 0 };
+	SDL_Texture* m_target = nullptr;
+	SDL_Rect m_dest = { 0, 0, 0, 0 };
+	int m_scale = 1; // 0 when the window is smaller than the canvas
+};
+
+#endif
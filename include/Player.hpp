@@ -2,9 +2,16 @@
 #define PLAYER_HPP
 
 #include "window.hpp"
+#include "TextureCache.hpp"
+#include "Camera.hpp"
+#include "MemoryTracker.hpp"
+#include "RenderQueue.hpp"
 
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 #include <ctime>
 #include <fstream>
@@ -19,9 +26,20 @@ enum Direction {
 float Lerp(float start, float end, float t) {
 	return start + (end - start) * t;
 }
+// If alpha isn't null it gets the image's alpha channel, one byte per pixel (see TextureCache::copyAlpha).
+// Without a renderer (headless replays) only the size and alpha are read and nullptr is returned.
 template <typename T>
-SDL_Texture* loadTexture(SDL_Renderer* renderer, std::string texturePath, T *texW, T *texH) {
-	SDL_Surface* img = IMG_Load(texturePath.c_str());
+SDL_Texture* loadTexture(SDL_Renderer* renderer, std::string texturePath, T *texW, T *texH, std::vector<uint8_t>* alpha = nullptr) {
+	if (TextureCache::isEnabled() && renderer != nullptr) {
+		int w = 0, h = 0;
+		SDL_Texture* tex = TextureCache::load(renderer, texturePath, &w, &h, alpha);
+		*texW = (T)w; *texH = (T)h;
+		MemoryTracker::trackTexture(tex);
+		return tex;
+	}
+
+	SDL_RWops* file = FileSystem::openAsset(texturePath);
+	SDL_Surface* img = file ? IMG_Load_RW(file, 1) : nullptr;
 
 	if (img == nullptr) {
 		std::printf("Unable to load image from path: %s\n", texturePath.c_str());
@@ -30,7 +48,19 @@ SDL_Texture* loadTexture(SDL_Renderer* renderer, std::string texturePath, T *tex
 
 	//Get img data:
 	*texW = img->w; *texH = img->h;
-
+	if (alpha) {
+		SDL_Surface* converted = SDL_ConvertSurfaceFormat(img, TextureCache::cachedFormat, 0);
+		if (converted) {
+			SDL_LockSurface(converted);
+			TextureCache::copyAlpha(converted->pixels, converted->w, converted->h, converted->pitch, *alpha);
+			SDL_UnlockSurface(converted);
+			SDL_FreeSurface(converted);
+		}
+	}
+	if (renderer == nullptr) {
+		SDL_FreeSurface(img);
+		return nullptr;
+	}
 
 	SDL_Texture* tex = SDL_CreateTextureFromSurface(renderer, img);
 	if (tex == nullptr) {
@@ -38,6 +68,7 @@ SDL_Texture* loadTexture(SDL_Renderer* renderer, std::string texturePath, T *tex
 		return nullptr;
 	}
 	SDL_FreeSurface(img);
+	MemoryTracker::trackTexture(tex);
 	return tex;
 }
 
@@ -47,11 +78,15 @@ public:
 		: subTextureSize(subTextureSize)
 	{
 		// Load texture atlas.
-		atlas = loadTexture(renderer, pathToAtlas, &atlasSize.x, &atlasSize.y);
-		if (atlas == nullptr) {
+		std::vector<uint8_t> alpha;
+		//Headless there's no texture, but the size and alpha still give it the same cells as in the game.
+		atlas = loadTexture(renderer, pathToAtlas, &atlasSize.x, &atlasSize.y, &alpha);
+		if (atlas == nullptr && (renderer != nullptr || atlasSize.x <= 0)) {
 			std::cerr << "Failed to load texture atlas: " << pathToAtlas << std::endl;
 			return; // Quit function if texture is not loaded
 		}
+		trimCells(alpha);
+		buildOpacity(alpha);
 	}
 
 	// Adds a subTexture. The UV coords should be provided in texture space.
@@ -61,20 +96,19 @@ public:
 			return;
 		}
 		subTextures[textureID] = { U, V };
+		trackMemory();
 	}
 
 	// Use a subtexture by ID, and render it to the screen at the given position.
 	void useSubTexture(int textureID, SDL_Renderer* renderer, SDL_Point pos) {
-		if (subTextures.count(textureID)) {
-			// Calculate the coordinates for the subtexture in texture space.
-			render_intPos = {
-				subTextures[textureID].x * subTextureSize.x,
-				subTextures[textureID].y * subTextureSize.y,
-				subTextureSize.x,
-				subTextureSize.y
-			};
+		auto it = subTextures.find(textureID);
+		if (it != subTextures.end()) {
+			// Only the opaque part of the cell is copied, at its offset inside the cell.
+			SDL_Rect trim = getTrim(it->second);
+			if (trim.w <= 0 || trim.h <= 0) return;
+			render_intPos = { it->second.x * subTextureSize.x + trim.x, it->second.y * subTextureSize.y + trim.y, trim.w, trim.h };
 			// Position to render the subtexture on the screen.
-			render_Pos = { pos.x, pos.y, subTextureSize.x, subTextureSize.y };
+			render_Pos = { pos.x + trim.x, pos.y + trim.y, trim.w, trim.h };
 			// Render the subtexture
 			SDL_RenderCopy(renderer, atlas, &render_intPos, &render_Pos);
 		}
@@ -83,28 +117,153 @@ public:
 		}
 	}
 
+	// Same as useSubTexture, but modulates the subtexture by tint (eg. the light level of the tile it's drawn on).
+	void useSubTexture(int textureID, SDL_Renderer* renderer, SDL_Point pos, SDL_Color tint) {
+		SDL_SetTextureColorMod(atlas, tint.r, tint.g, tint.b);
+		useSubTexture(textureID, renderer, pos);
+	}
+
+	// Draws the subtexture stretched over dest (eg. a tile seen through a zoomed camera), modulated by tint.
+	// Returns false if there was nothing to draw, otherwise render_Pos is where it went.
+	bool useSubTexture(int textureID, SDL_Renderer* renderer, const SDL_Rect& dest, SDL_Color tint) {
+		if (!placeSubTexture(textureID, dest)) return false;
+		SDL_SetTextureColorMod(atlas, tint.r, tint.g, tint.b);
+		SDL_RenderCopy(renderer, atlas, &render_intPos, &render_Pos);
+		return true;
+	}
+
+	// Same as the dest overload of useSubTexture, but records the draw into a render queue at layer and depth.
+	bool queueSubTexture(int textureID, RenderRecorder& out, RenderLayer layer, uint32_t depth, const SDL_Rect& dest, SDL_Color tint) {
+		if (!placeSubTexture(textureID, dest)) return false;
+		out.copy(layer, depth, atlas, &render_intPos, render_Pos, tint);
+		return true;
+	}
+
 	// Automatically generate subtextures based on the atlas dimensions.
+	// IDs follow the cell order (left to right, top to bottom, from 1) whether or not a cell is empty, so the IDs in maps and
+	// autotile rules stay the same. Fully transparent cells just aren't registered.
 	void autoGenerateTextures(int stopAt = -1) {
-		int noOfTextures = 0;
+		int cellID = 0, noOfTextures = 0;
 		for (int y = 0; y < atlasSize.y / subTextureSize.y; y++) {
 			for (int x = 0; x < atlasSize.x / subTextureSize.x; x++) {
-				if (stopAt >= 0 && noOfTextures >= stopAt) {
+				if (stopAt >= 0 && cellID >= stopAt) {
+					trackMemory();
 					return; // Stop when we've reached the stopAt limit
 				}
+				cellID++;
+				SDL_Rect trim = getTrim({ x, y });
+				if (trim.w <= 0 || trim.h <= 0) continue;
 				noOfTextures++;
-				subTextures[noOfTextures] = { x, y };
+				subTextures[cellID] = { x, y };
 			}
 		}
 		std::cout << "Number of textures identified: " << noOfTextures << std::endl;
+		trackMemory();
+	}
+
+	// The opaque part of a cell, relative to the cell's top left. The whole cell if the atlas had no alpha to scan,
+	// zero sized if the cell is fully transparent.
+	SDL_Rect getTrim(SDL_Point cell) const {
+		int columns = subTextureSize.x > 0 ? atlasSize.x / subTextureSize.x : 0;
+		size_t index = (size_t)cell.y * columns + cell.x;
+		if (cell.x < 0 || cell.y < 0 || cell.x >= columns || index >= m_cellTrims.size()) {
+			return { 0, 0, subTextureSize.x, subTextureSize.y };
+		}
+		return m_cellTrims[index];
+	}
+
+	// True if every pixel of area (relative to the subtexture's top left) is fully opaque. False for areas reaching
+	// outside the cell, and for every area if the atlas had no alpha to scan.
+	bool isOpaque(int textureID, const SDL_Rect& area) const {
+		auto it = subTextures.find(textureID);
+		if (it == subTextures.end() || m_opaqueSums.empty()) return false;
+		if (area.w <= 0 || area.h <= 0 || area.x < 0 || area.y < 0 || area.x + area.w > subTextureSize.x || area.y + area.h > subTextureSize.y) return false;
+
+		int x0 = it->second.x * subTextureSize.x + area.x, y0 = it->second.y * subTextureSize.y + area.y;
+		int x1 = x0 + area.w, y1 = y0 + area.h;
+		size_t stride = (size_t)atlasSize.x + 1;
+		uint32_t opaque = m_opaqueSums[y1 * stride + x1] - m_opaqueSums[y0 * stride + x1] - m_opaqueSums[y1 * stride + x0] + m_opaqueSums[y0 * stride + x0];
+		return opaque == (uint32_t)(area.w * area.h);
 	}
 
 	// Destructor to clean up the loaded texture
 	~TextureAtlas() {
 		if (atlas) {
-			SDL_DestroyTexture(atlas);
+			MemoryTracker::destroyTexture(atlas);
+		}
+	}
+
+private:
+	// Sets render_intPos and render_Pos for drawing the trimmed subtexture over dest. False if there's nothing to draw.
+	bool placeSubTexture(int textureID, const SDL_Rect& dest) {
+		auto it = subTextures.find(textureID);
+		if (it == subTextures.end()) return false;
+
+		SDL_Rect trim = getTrim(it->second);
+		if (trim.w <= 0 || trim.h <= 0) return false;
+		render_intPos = { it->second.x * subTextureSize.x + trim.x, it->second.y * subTextureSize.y + trim.y, trim.w, trim.h };
+		if (trim.w == subTextureSize.x && trim.h == subTextureSize.y) {
+			render_Pos = dest;
+		}
+		else {
+			//Scale the trimmed rect into dest, rounding both edges like Camera::worldToScreenRect.
+			float sx = (float)dest.w / subTextureSize.x, sy = (float)dest.h / subTextureSize.y;
+			int x0 = dest.x + (int)std::floor(trim.x * sx + 0.5f), x1 = dest.x + (int)std::floor((trim.x + trim.w) * sx + 0.5f);
+			int y0 = dest.y + (int)std::floor(trim.y * sy + 0.5f), y1 = dest.y + (int)std::floor((trim.y + trim.h) * sy + 0.5f);
+			render_Pos = { x0, y0, x1 - x0, y1 - y0 };
+		}
+		return true;
+	}
+
+	// Finds the bounding rect of the non transparent pixels in every cell, once, while the pixels are at hand.
+	void trimCells(const std::vector<uint8_t>& alpha) {
+		if (subTextureSize.x <= 0 || subTextureSize.y <= 0 || alpha.size() != (size_t)atlasSize.x * atlasSize.y) return;
+
+		int columns = atlasSize.x / subTextureSize.x, rows = atlasSize.y / subTextureSize.y;
+		m_cellTrims.assign((size_t)columns * rows, { 0, 0, 0, 0 });
+		for (int cy = 0; cy < rows; cy++) {
+			for (int cx = 0; cx < columns; cx++) {
+				int minX = subTextureSize.x, minY = subTextureSize.y, maxX = -1, maxY = -1;
+				for (int y = 0; y < subTextureSize.y; y++) {
+					const uint8_t* row = alpha.data() + (size_t)(cy * subTextureSize.y + y) * atlasSize.x + cx * subTextureSize.x;
+					for (int x = 0; x < subTextureSize.x; x++) {
+						if (row[x] == 0) continue;
+						minX = std::min(minX, x); maxX = std::max(maxX, x);
+						minY = std::min(minY, y); maxY = std::max(maxY, y);
+					}
+				}
+				if (maxX >= 0) {
+					m_cellTrims[(size_t)cy * columns + cx] = { minX, minY, maxX - minX + 1, maxY - minY + 1 };
+				}
+			}
+		}
+		trackMemory();
+	}
+
+	// Summed area table of the fully opaque pixels, so isOpaque() is four lookups whatever the size of the area.
+	void buildOpacity(const std::vector<uint8_t>& alpha) {
+		if (alpha.size() != (size_t)atlasSize.x * atlasSize.y) return;
+
+		size_t stride = (size_t)atlasSize.x + 1;
+		m_opaqueSums.assign(stride * (atlasSize.y + 1), 0);
+		for (int y = 0; y < atlasSize.y; y++) {
+			uint32_t rowSum = 0;
+			for (int x = 0; x < atlasSize.x; x++) {
+				rowSum += alpha[(size_t)y * atlasSize.x + x] == 255 ? 1 : 0;
+				m_opaqueSums[(y + 1) * stride + x + 1] = m_opaqueSums[y * stride + x + 1] + rowSum;
+			}
 		}
+		trackMemory();
+	}
+
+	void trackMemory() {
+		m_memory.set(MemoryTracker::mapHeap(subTextures) + MemoryTracker::vectorHeap(m_cellTrims) + MemoryTracker::vectorHeap(m_opaqueSums));
 	}
 
+	std::vector<SDL_Rect> m_cellTrims; // Opaque bounds of every cell, row by row. Empty if the atlas couldn't be scanned
+	std::vector<uint32_t> m_opaqueSums; // (atlasSize.x + 1) * (atlasSize.y + 1), empty if the atlas couldn't be scanned
+	TrackedBytes m_memory{ MEM_ASSET_DATA };
+
 public:
 	std::unordered_map<int, SDL_Point> subTextures;
 
@@ -120,16 +279,21 @@ class animatedSprite {
 public:
 	//Loads an animated sprite from a texture atlas.
 	animatedSprite(SDL_Renderer* renderer, std::string texturePath, SDL_Point frameSize, float timeBetweenFrame) : m_frameSize(frameSize), renderer(renderer), m_frameTime(timeBetweenFrame) {
-		texImg = loadTexture(renderer, texturePath, &m_texSize.x, &m_texSize.y);
+		//Without a renderer (headless replays) there's nothing to draw into, so don't load the texture either.
+		if (renderer != nullptr) {
+			texImg = loadTexture(renderer, texturePath, &m_texSize.x, &m_texSize.y);
+		}
 
 		//Calculate amx frame ticks:
 		m_maxFrameTick = m_texSize.x / m_frameSize.x; // Divides the texture width by the horiz size of the frame.
+		trackMemory();
 	}
 
 	void addSequence(std::string seqName, std::vector<int> seqArr) {
 		if (Sequences.find(seqName) == Sequences.end()) {
 			//No key of that value exists, create a new one.
 			Sequences.insert_or_assign(seqName, seqArr);
+			trackMemory();
 		}
 		else {
 			std::printf("%s is already a valid sequence for this animated object.\n", seqName.c_str());
@@ -157,11 +321,16 @@ public:
 			m_frameTick = 0;
 		}
 
-		if (flipHorix) {
-			SDL_RenderCopyExF(renderer, texImg, &m_subPos, &m_pos, 0, NULL, SDL_FLIP_HORIZONTAL);
+		//m_pos is in world space when there's a camera.
+		SDL_FRect dest = camera ? camera->worldToScreen(m_pos) : m_pos;
+		if (recorder != nullptr) {
+			recorder->copy(LAYER_ENTITIES, RenderQueue::depthOf(m_pos.y + m_pos.h), texImg, &m_subPos, dest, { 255, 255, 255, 255 }, flipHorix ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
+		}
+		else if (flipHorix) {
+			SDL_RenderCopyExF(renderer, texImg, &m_subPos, &dest, 0, NULL, SDL_FLIP_HORIZONTAL);
 		}
 		else {
-			SDL_RenderCopyF(renderer, texImg, &m_subPos, &m_pos);
+			SDL_RenderCopyF(renderer, texImg, &m_subPos, &dest);
 		}
 
 		if (frameTimeOverride != NULL) {
@@ -172,11 +341,13 @@ public:
 	
 
 	SDL_FRect m_pos; // The position of the rendererd texture
+	const Camera* camera = nullptr; // Set to draw through a camera instead of at m_pos on screen
+	RenderRecorder* recorder = nullptr; // Set to record into a render queue instead of drawing straight away
 private:
 	SDL_Renderer* renderer;
-	SDL_Texture* texImg;
+	SDL_Texture* texImg = nullptr;
 	SDL_Point m_frameSize; // the size of the individual frames.
-	SDL_FPoint m_texSize; // The size of the overall texture atlas.
+	SDL_FPoint m_texSize = { 0, 0 }; // The size of the overall texture atlas.
 	SDL_Rect m_subPos; // The internal size of the frame texture.
 
 	float m_frameTime;
@@ -187,6 +358,16 @@ private:
 	Timer clock;
 
 	std::unordered_map<std::string, std::vector<int>> Sequences;
+
+	void trackMemory() {
+		int64_t bytes = sizeof(animatedSprite) + MemoryTracker::mapHeap(Sequences);
+		for (const auto& seq : Sequences) {
+			bytes += MemoryTracker::stringHeap(seq.first) + MemoryTracker::vectorHeap(seq.second);
+		}
+		m_memory.set(bytes);
+	}
+
+	TrackedBytes m_memory{ MEM_ANIMATION };
 };
 
 class Player {
@@ -206,6 +387,32 @@ public:
 		return SDL_FPoint{ sprite->m_pos.x, sprite->m_pos.y };
 	}
 
+	SDL_FPoint getVelocity() {
+		return velocity;
+	}
+
+	Direction getFacing() {
+		return lookingAt;
+	}
+
+	//Draws the player through camera from now on (nullptr draws at its position on screen).
+	void setCamera(const Camera* camera) {
+		sprite->camera = camera;
+	}
+
+	//Records the player's sprite into out from now on, sorted in with the other entities by its feet.
+	void setRenderQueue(RenderRecorder* out) {
+		sprite->recorder = out;
+	}
+
+	//Puts the player back into a saved state, eg. after loading a save game.
+	void setState(SDL_FPoint pos, SDL_FPoint vel, Direction facing) {
+		sprite->m_pos.x = pos.x;
+		sprite->m_pos.y = pos.y;
+		velocity = vel;
+		lookingAt = facing;
+	}
+
 	/*
 	void Update() {
 		SDL_Point movement{ 0, 0 };
@@ -354,7 +561,9 @@ public:
 		sprite->m_pos.x += velocity.x * dt;
 		sprite->m_pos.y += velocity.y * dt;
 
-		m_Render();
+		if (win->renderer != nullptr) {
+			m_Render();
+		}
 	}
 
 private:
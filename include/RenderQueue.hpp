@@ -0,0 +1,377 @@
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include "SDL.h"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//Draws are recorded as small commands with a 64 bit sort key instead of going straight to SDL, then sorted and drawn in
+//one go. The key is, from the top bits down: layer (8 bits), depth (24), blend mode (4) and texture (28), so everything is
+//drawn layer by layer, back to front inside a layer, and commands at the same depth are grouped by blend mode and
+//texture. The sort is stable, so commands with equal keys keep the order they were recorded in.
+//Commands live in a per-frame bump allocator that's rewound after every flush, and the sort buffers are kept between
+//frames, so once they've grown to fit a frame nothing is allocated at all.
+
+//Layers, drawn bottom to top.
+enum RenderLayer : uint8_t {
+	LAYER_GROUND = 0, // Depth is usually 0, so tiles just group by texture
+	LAYER_ENTITIES = 1, // Depth is the bottom edge in world pixels (see RenderQueue::depthOf), so lower things go in front
+	LAYER_PARTICLES = 2,
+	LAYER_OVERLAY = 3
+};
+
+//Hands out memory for one frame by bumping an offset through a list of blocks. reset() rewinds to the first block and
+//keeps them all, so a frame that fits in what earlier frames needed never touches the heap. Only for trivial types,
+//nothing allocated from it is ever destroyed.
+class FrameArena {
+public:
+	explicit FrameArena(size_t blockSize = 64 * 1024) : m_blockSize(blockSize) {}
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+		while (m_block < m_blocks.size()) {
+			Block& block = m_blocks[m_block];
+			uintptr_t base = (uintptr_t)block.data.get();
+			size_t offset = ((base + m_offset + align - 1) & ~(uintptr_t)(align - 1)) - base;
+			if (offset + size <= block.size) {
+				m_offset = offset + size;
+				m_used += size;
+				return block.data.get() + offset;
+			}
+			m_block++;
+			m_offset = 0;
+		}
+
+		//Out of blocks, add one big enough (aligned blocks come from new[], which is aligned for max_align_t).
+		Block block;
+		block.size = std::max(m_blockSize, size + align);
+		block.data.reset(new uint8_t[block.size]);
+		m_blocks.push_back(std::move(block));
+		m_heapAllocations++;
+		m_block = m_blocks.size() - 1;
+		m_offset = 0;
+		return allocate(size, align);
+	}
+
+	template <typename T>
+	T* allocate(size_t count = 1) {
+		return (T*)allocate(sizeof(T) * count, alignof(T));
+	}
+
+	void reset() {
+		m_block = 0;
+		m_offset = 0;
+		m_used = 0;
+	}
+
+	// Bytes handed out since the last reset.
+	size_t getUsed() const {
+		return m_used;
+	}
+
+	size_t getCapacity() const {
+		size_t bytes = 0;
+		for (const Block& block : m_blocks) bytes += block.size;
+		return bytes;
+	}
+
+	// Blocks ever allocated, the difference across a frame is how many times it went to the heap.
+	size_t getHeapAllocations() const {
+		return m_heapAllocations;
+	}
+
+private:
+	struct Block {
+		std::unique_ptr<uint8_t[]> data;
+		size_t size = 0;
+	};
+
+	size_t m_blockSize;
+	std::vector<Block> m_blocks;
+	size_t m_block = 0; // Block being bumped through
+	size_t m_offset = 0; // Into that block
+	size_t m_used = 0;
+	size_t m_heapAllocations = 0;
+};
+
+enum RenderCommandType : uint8_t {
+	RENDER_COPY,
+	RENDER_GEOMETRY
+};
+
+struct RenderCommand {
+	uint64_t key;
+	SDL_Texture* texture;
+	union {
+		struct {
+			SDL_Rect src;
+			SDL_FRect dest;
+		} copy;
+		struct {
+			const SDL_Vertex* vertices; // Not copied, they have to stay put until the flush
+			const int* indices;
+			int vertexCount;
+			int indexCount;
+		} geometry;
+	};
+	SDL_Color tint;
+	uint8_t type;
+	uint8_t flip; // SDL_RendererFlip
+	bool hasSrc;
+};
+
+//Records commands for one thread. Each thread drawing into a RenderQueue gets its own recorder from it, recorders never
+//share anything so recording takes no locks.
+class RenderRecorder {
+public:
+	RenderRecorder() {}
+
+	RenderRecorder(const RenderRecorder&) = delete;
+	RenderRecorder& operator=(const RenderRecorder&) = delete;
+
+	// Copies src of texture (all of it if src is null) over dest, modulated by tint.
+	void copy(RenderLayer layer, uint32_t depth, SDL_Texture* texture, const SDL_Rect* src, const SDL_FRect& dest,
+		SDL_Color tint = { 255, 255, 255, 255 }, SDL_RendererFlip flip = SDL_FLIP_NONE, SDL_BlendMode blend = SDL_BLENDMODE_BLEND) {
+		if (texture == nullptr) return;
+		RenderCommand* command = next();
+		command->key = makeKey(layer, depth, blend, texture);
+		command->texture = texture;
+		command->type = RENDER_COPY;
+		command->hasSrc = src != nullptr;
+		if (src != nullptr) command->copy.src = *src;
+		command->copy.dest = dest;
+		command->tint = tint;
+		command->flip = (uint8_t)flip;
+	}
+
+	void copy(RenderLayer layer, uint32_t depth, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect& dest,
+		SDL_Color tint = { 255, 255, 255, 255 }, SDL_RendererFlip flip = SDL_FLIP_NONE, SDL_BlendMode blend = SDL_BLENDMODE_BLEND) {
+		copy(layer, depth, texture, src, SDL_FRect{ (float)dest.x, (float)dest.y, (float)dest.w, (float)dest.h }, tint, flip, blend);
+	}
+
+	// Triangles from vertices/indices, which aren't copied and have to stay valid until the queue is flushed.
+	void geometry(RenderLayer layer, uint32_t depth, SDL_Texture* texture, const SDL_Vertex* vertices, int vertexCount,
+		const int* indices, int indexCount, SDL_BlendMode blend = SDL_BLENDMODE_BLEND) {
+		if (vertexCount <= 0) return;
+		RenderCommand* command = next();
+		command->key = makeKey(layer, depth, blend, texture);
+		command->texture = texture;
+		command->type = RENDER_GEOMETRY;
+		command->hasSrc = false;
+		command->geometry.vertices = vertices;
+		command->geometry.indices = indices;
+		command->geometry.vertexCount = vertexCount;
+		command->geometry.indexCount = indexCount;
+		command->tint = { 255, 255, 255, 255 };
+		command->flip = SDL_FLIP_NONE;
+	}
+
+	// Commands recorded since the last flush.
+	size_t getCount() const {
+		return m_count;
+	}
+
+	static uint64_t makeKey(RenderLayer layer, uint32_t depth, SDL_BlendMode blend, SDL_Texture* texture) {
+		uint64_t textureBits = ((uint64_t)(uintptr_t)texture >> 4) & 0xFFFFFFF; // Only has to tell textures apart
+		return ((uint64_t)layer << 56) | ((uint64_t)(depth & 0xFFFFFF) << 32) | ((uint64_t)(blend & 0xF) << 28) | textureBits;
+	}
+
+private:
+	friend class RenderQueue;
+
+	//Commands are handed out a page at a time, pages are chained so the queue can walk them in order.
+	static constexpr size_t pageSize = 256;
+	struct Page {
+		Page* next;
+		size_t count;
+		RenderCommand commands[pageSize];
+	};
+
+	RenderCommand* next() {
+		if (m_last == nullptr || m_last->count == pageSize) {
+			Page* page = m_arena.allocate<Page>();
+			page->next = nullptr;
+			page->count = 0;
+			if (m_last != nullptr) m_last->next = page;
+			else m_first = page;
+			m_last = page;
+		}
+		m_count++;
+		return &m_last->commands[m_last->count++];
+	}
+
+	void reset() {
+		m_arena.reset();
+		m_first = m_last = nullptr;
+		m_count = 0;
+	}
+
+	FrameArena m_arena{ sizeof(Page) * 16 };
+	Page* m_first = nullptr;
+	Page* m_last = nullptr;
+	size_t m_count = 0;
+};
+
+struct RenderStats {
+	size_t commands = 0;
+	size_t textureChanges = 0; // Times the flush moved on to another texture
+	size_t stateChanges = 0; // Blend and colour/alpha mod changes
+	size_t heapAllocations = 0; // Made by the queue since the flush before, 0 once it has warmed up
+};
+
+class RenderQueue {
+public:
+	// recorders is how many threads can record at once, each uses getRecorder() with its own index.
+	RenderQueue(SDL_Renderer* renderer, int recorders = 1) : renderer(renderer) {
+		for (int i = 0; i < std::max(recorders, 1); i++) {
+			m_recorders.push_back(std::unique_ptr<RenderRecorder>(new RenderRecorder()));
+		}
+	}
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	RenderRecorder& getRecorder(int index = 0) {
+		return *m_recorders[index];
+	}
+
+	// Sorts everything recorded since the last flush, draws it and rewinds the recorders for the next frame.
+	// Call on the thread that owns the renderer once every recorder is done with the frame. Without a renderer (headless
+	// replays) it still gathers and sorts the frame, but draws nothing.
+	void flush() {
+		m_stats = RenderStats();
+
+		size_t count = 0;
+		for (const auto& recorder : m_recorders) count += recorder->getCount();
+		if (m_items.size() < count) {
+			m_items.resize(count);
+			m_scratch.resize(count);
+			m_sortAllocations++;
+		}
+
+		size_t at = 0;
+		for (const auto& recorder : m_recorders) {
+			for (const RenderRecorder::Page* page = recorder->m_first; page != nullptr; page = page->next) {
+				for (size_t i = 0; i < page->count; i++) {
+					m_items[at++] = { page->commands[i].key, &page->commands[i] };
+				}
+			}
+		}
+		const SortItem* sorted = radixSort(count);
+
+		SDL_Texture* texture = nullptr;
+		SDL_BlendMode blend = SDL_BLENDMODE_NONE;
+		SDL_Color tint = { 0, 0, 0, 0 };
+		for (size_t i = 0; i < count && renderer != nullptr; i++) {
+			const RenderCommand& command = *sorted[i].command;
+			//The modulation and blend mode belong to the texture, so after switching they're set whatever they were.
+			bool switched = command.texture != texture || i == 0;
+			if (switched) {
+				texture = command.texture;
+				m_stats.textureChanges++;
+			}
+			SDL_BlendMode commandBlend = (SDL_BlendMode)((command.key >> 28) & 0xF);
+			if (texture != nullptr && (switched || commandBlend != blend)) {
+				SDL_SetTextureBlendMode(texture, commandBlend);
+				blend = commandBlend;
+				m_stats.stateChanges++;
+			}
+			if (texture != nullptr && (switched || std::memcmp(&command.tint, &tint, sizeof(SDL_Color)) != 0)) {
+				SDL_SetTextureColorMod(texture, command.tint.r, command.tint.g, command.tint.b);
+				SDL_SetTextureAlphaMod(texture, command.tint.a);
+				tint = command.tint;
+				m_stats.stateChanges++;
+			}
+
+			if (command.type == RENDER_COPY) {
+				const SDL_Rect* src = command.hasSrc ? &command.copy.src : NULL;
+				if (command.flip != SDL_FLIP_NONE) {
+					SDL_RenderCopyExF(renderer, texture, src, &command.copy.dest, 0, NULL, (SDL_RendererFlip)command.flip);
+				}
+				else {
+					SDL_RenderCopyF(renderer, texture, src, &command.copy.dest);
+				}
+			}
+			else {
+				SDL_RenderGeometry(renderer, texture, command.geometry.vertices, command.geometry.vertexCount, command.geometry.indices, command.geometry.indexCount);
+			}
+		}
+		m_stats.commands = count;
+
+		for (const auto& recorder : m_recorders) recorder->reset();
+		size_t heap = heapAllocations();
+		m_stats.heapAllocations = heap - m_heapAtFlush;
+		m_heapAtFlush = heap;
+	}
+
+	// Stats of the last flush.
+	const RenderStats& getStats() const {
+		return m_stats;
+	}
+
+	// Maps a world y (eg. the bottom of a sprite) to a depth in LAYER_ENTITIES, in quarter pixels.
+	static uint32_t depthOf(float worldY) {
+		int64_t depth = (int64_t)std::floor(worldY * 4.0f) + (1 << 22);
+		return (uint32_t)std::min<int64_t>(std::max<int64_t>(depth, 0), 0xFFFFFF);
+	}
+
+	SDL_Renderer* renderer;
+
+private:
+	struct SortItem {
+		uint64_t key;
+		const RenderCommand* command;
+	};
+
+	// Stable LSD radix sort of the first count items, a byte at a time. Bytes every key shares (most of them usually) are
+	// skipped. Returns whichever buffer the result ended up in.
+	SortItem* radixSort(size_t count) {
+		size_t histograms[8][256] = {};
+		for (size_t i = 0; i < count; i++) {
+			uint64_t key = m_items[i].key;
+			for (int b = 0; b < 8; b++) histograms[b][(key >> (b * 8)) & 0xFF]++;
+		}
+
+		SortItem* from = m_items.data();
+		SortItem* to = m_scratch.data();
+		for (int b = 0; b < 8; b++) {
+			size_t* histogram = histograms[b];
+			if (count == 0 || histogram[(from[0].key >> (b * 8)) & 0xFF] == count) continue;
+
+			size_t offset = 0;
+			for (int d = 0; d < 256; d++) {
+				size_t n = histogram[d];
+				histogram[d] = offset;
+				offset += n;
+			}
+			for (size_t i = 0; i < count; i++) {
+				to[histogram[(from[i].key >> (b * 8)) & 0xFF]++] = from[i];
+			}
+			std::swap(from, to);
+		}
+		return from;
+	}
+
+	size_t heapAllocations() const {
+		size_t n = m_sortAllocations;
+		for (const auto& recorder : m_recorders) n += recorder->m_arena.getHeapAllocations();
+		return n;
+	}
+
+	std::vector<std::unique_ptr<RenderRecorder>> m_recorders; // Pointers so recorders never move while threads hold them
+	std::vector<SortItem> m_items; // Grown to the biggest frame so far, never shrunk
+	std::vector<SortItem> m_scratch;
+	size_t m_sortAllocations = 0;
+	size_t m_heapAtFlush = 0;
+	RenderStats m_stats;
+};
+
+#endif
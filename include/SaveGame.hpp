@@ -0,0 +1,469 @@
+#ifndef SAVEGAME_HPP
+#define SAVEGAME_HPP
+
+#include "mapReader.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+//Binary save games.
+//A full save stores every chunk of the map, the entities and the player. An autosave is a delta against the last full
+//save: only chunks flagged by Map::markEdited() since then, plus the (small) entity list and the player.
+//The game thread only copies the data it needs into a WorldSnapshot. Encoding and writing happens on a worker thread,
+//into a temp file that replaces the old save once it's complete, so a crash mid write never corrupts the previous save.
+
+struct PlayerState {
+	SDL_FPoint pos = { 0, 0 };
+	SDL_FPoint velocity = { 0, 0 };
+	Direction facing = SOUTH;
+};
+
+//Tile data without the strings, names live in the snapshot's name table.
+struct SavedTile {
+	uint16_t name;
+	int32_t textureID;
+	uint8_t flags;
+	int32_t x, y; // In pixels, only used for entities
+};
+
+struct SavedChunk {
+	uint16_t chunkX, chunkY;
+	std::vector<SavedTile> cells; // Map::chunkSize * Map::chunkSize, row major, clipped chunks pad with empty cells
+};
+
+struct WorldSnapshot {
+	bool full = true;
+	uint32_t saveID = 0;
+	uint32_t baseSaveID = 0; // For deltas, the full save they apply to
+	SDL_Point mapSize = { 0, 0 };
+	SDL_Point tileSize = { 0, 0 };
+	PlayerState player;
+	std::vector<std::string> names;
+	std::vector<SavedChunk> chunks;
+	std::vector<SavedTile> entities;
+	std::string path;
+};
+
+class SaveGame {
+public:
+	SaveGame(std::string fullSavePath, std::string autosavePath) : m_fullPath(fullSavePath), m_autosavePath(autosavePath) {
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::path(fullSavePath).parent_path(), ec);
+		std::filesystem::create_directories(std::filesystem::path(autosavePath).parent_path(), ec);
+
+		m_worker = std::thread(&SaveGame::workerLoop, this);
+	}
+
+	~SaveGame() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_one();
+		m_worker.join();
+	}
+
+	SaveGame(const SaveGame&) = delete;
+	SaveGame& operator=(const SaveGame&) = delete;
+
+	// Queues a full save and clears the map's edited chunk flags, later autosaves are deltas against it.
+	void saveFull(Map& map, const PlayerState& player) {
+		WorldSnapshot snapshot = takeSnapshot(map, player, true);
+		snapshot.path = m_fullPath;
+		m_lastFullID = snapshot.saveID;
+		map.clearEditedChunks();
+		queue(std::move(snapshot));
+	}
+
+	// Queues a delta save with only the chunks edited since the last full save. Falls back to a full save if there isn't one
+	// yet, which copies the whole map on the calling thread: new games should saveFull() while loading so that never happens.
+	void autosave(Map& map, const PlayerState& player) {
+		if (m_lastFullID == 0) {
+			saveFull(map, player);
+			return;
+		}
+		WorldSnapshot snapshot = takeSnapshot(map, player, false);
+		snapshot.path = m_autosavePath;
+		queue(std::move(snapshot));
+	}
+
+	// True while a queued save hasn't been written yet.
+	bool isBusy() const {
+		return m_pending.load() > 0;
+	}
+
+	// True once there's a full save for autosaves to be deltas against (loaded or queued).
+	bool hasBase() const {
+		return m_lastFullID != 0;
+	}
+
+	bool hasSave() const {
+		return std::filesystem::exists(m_fullPath);
+	}
+
+	// Restores the map and player from the full save and, if it matches, the autosave on top of it.
+	// Doesn't touch the text map at all. Returns false if there is no readable full save.
+	bool load(Map& outMap, PlayerState& outPlayer) {
+		WorldSnapshot full;
+		if (!readSnapshot(m_fullPath, full) || !full.full) {
+			return false;
+		}
+
+		outMap = Map(full.mapSize, full.tileSize);
+		applySnapshot(full, outMap, outPlayer);
+		outMap.clearEditedChunks();
+		m_lastFullID = full.saveID;
+
+		WorldSnapshot delta;
+		if (std::filesystem::exists(m_autosavePath) && readSnapshot(m_autosavePath, delta)) {
+			if (!delta.full && delta.baseSaveID == full.saveID && delta.mapSize.x == full.mapSize.x && delta.mapSize.y == full.mapSize.y) {
+				applySnapshot(delta, outMap, outPlayer); // Re-flags its chunks so the next autosave still carries them
+			}
+			else {
+				std::printf("Autosave %s doesn't belong to %s, ignoring it\n", m_autosavePath.c_str(), m_fullPath.c_str());
+			}
+		}
+		return true;
+	}
+
+private:
+	enum SavedTileFlags : uint8_t {
+		SAVED_PRESENT = 1,
+		SAVED_ATLAS = 2,
+		SAVED_AUTOTILED = 4
+	};
+
+	static constexpr uint32_t saveMagic = 0x56534754; // "TGSV"
+	static constexpr uint32_t saveVersion = 1;
+	static constexpr int maxMapSide = 8192; // In tiles, anything bigger in a save is taken as corruption
+
+	WorldSnapshot takeSnapshot(const Map& map, const PlayerState& player, bool full) {
+		WorldSnapshot snapshot;
+		snapshot.full = full;
+		snapshot.saveID = full ? newSaveID() : 0;
+		snapshot.baseSaveID = full ? 0 : m_lastFullID;
+		snapshot.mapSize = map.getMapSize();
+		snapshot.tileSize = map.getTileSize();
+		snapshot.player = player;
+
+		std::unordered_map<std::string, uint16_t> nameIDs;
+		const std::string* lastName = nullptr;
+		uint16_t lastID = 0;
+		auto nameID = [&](const std::string& name) {
+			if (lastName == nullptr || name != *lastName) {
+				auto it = nameIDs.find(name);
+				if (it == nameIDs.end()) {
+					it = nameIDs.emplace(name, (uint16_t)snapshot.names.size()).first;
+					snapshot.names.push_back(name);
+				}
+				lastID = it->second;
+				lastName = &name;
+			}
+			return lastID;
+		};
+		auto flagsOf = [](const Tile& t) {
+			return (uint8_t)(SAVED_PRESENT | (t.usingTextureAtlas ? SAVED_ATLAS : 0) | (t.autoTiled ? SAVED_AUTOTILED : 0));
+		};
+
+		SDL_Point chunks = map.getChunkCount();
+		for (int cy = 0; cy < chunks.y; cy++) {
+			for (int cx = 0; cx < chunks.x; cx++) {
+				if (!full && !map.isChunkEdited(cx, cy)) continue;
+
+				SavedChunk chunk;
+				chunk.chunkX = (uint16_t)cx;
+				chunk.chunkY = (uint16_t)cy;
+				chunk.cells.resize(Map::chunkSize * Map::chunkSize, { 0, 0, 0, 0, 0 });
+				for (int y = 0; y < Map::chunkSize; y++) {
+					for (int x = 0; x < Map::chunkSize; x++) {
+						int index = map.getGroundTile(cx * Map::chunkSize + x, cy * Map::chunkSize + y);
+						if (index < 0) continue;
+						const Tile& tile = map.tileMap[index];
+						chunk.cells[y * Map::chunkSize + x] = { nameID(tile.textureName), tile.textureID, flagsOf(tile), 0, 0 };
+					}
+				}
+				snapshot.chunks.push_back(std::move(chunk));
+			}
+		}
+
+		//From the per chunk lists rather than a pass over every tile.
+		for (int cy = 0; cy < chunks.y; cy++) {
+			for (int cx = 0; cx < chunks.x; cx++) {
+				for (int index : map.getChunkEntities(cx, cy)) {
+					const Tile& tile = map.tileMap[index];
+					snapshot.entities.push_back({ nameID(tile.textureName), tile.textureID, flagsOf(tile), tile.pos.x, tile.pos.y });
+				}
+			}
+		}
+		return snapshot;
+	}
+
+	static void applySnapshot(const WorldSnapshot& snapshot, Map& map, PlayerState& player) {
+		player = snapshot.player;
+
+		for (const SavedChunk& chunk : snapshot.chunks) {
+			for (int y = 0; y < Map::chunkSize; y++) {
+				for (int x = 0; x < Map::chunkSize; x++) {
+					int gx = chunk.chunkX * Map::chunkSize + x, gy = chunk.chunkY * Map::chunkSize + y;
+					if (gx >= snapshot.mapSize.x || gy >= snapshot.mapSize.y) continue;
+
+					const SavedTile& cell = chunk.cells[y * Map::chunkSize + x];
+					if (!(cell.flags & SAVED_PRESENT)) {
+						map.clearGroundTile(gx, gy);
+						continue;
+					}
+					Tile tile;
+					tile.textureName = snapshot.names[cell.name];
+					tile.textureID = cell.textureID;
+					tile.usingTextureAtlas = (cell.flags & SAVED_ATLAS) != 0;
+					tile.autoTiled = (cell.flags & SAVED_AUTOTILED) != 0;
+					map.setGroundTile(gx, gy, tile);
+				}
+			}
+		}
+
+		map.removeEntities();
+		for (const SavedTile& saved : snapshot.entities) {
+			Tile tile;
+			tile.textureName = snapshot.names[saved.name];
+			tile.textureID = saved.textureID;
+			tile.usingTextureAtlas = (saved.flags & SAVED_ATLAS) != 0;
+			tile.pos = { saved.x, saved.y };
+			map.addEntity(tile);
+		}
+	}
+
+	uint32_t newSaveID() {
+		uint32_t id = (uint32_t)std::chrono::system_clock::now().time_since_epoch().count();
+		if (id == 0 || id == m_lastFullID) id = m_lastFullID + 1;
+		return id;
+	}
+
+	void queue(WorldSnapshot&& snapshot) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			//A newer autosave makes an unwritten older one pointless.
+			if (!snapshot.full && !m_jobs.empty() && !m_jobs.back().full) {
+				m_jobs.back() = std::move(snapshot);
+			}
+			else {
+				m_jobs.push_back(std::move(snapshot));
+				m_pending++;
+			}
+		}
+		m_wake.notify_one();
+	}
+
+	void workerLoop() {
+		while (true) {
+			WorldSnapshot job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+				if (m_jobs.empty()) return; // Quit once everything queued is written
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			writeSnapshot(job);
+			m_pending--;
+		}
+	}
+
+	//Little endian writer/reader for the save format.
+	struct ByteWriter {
+		std::vector<uint8_t> data;
+		void u8(uint8_t v) { data.push_back(v); }
+		void u16(uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); }
+		void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+		void i32(int32_t v) { u32((uint32_t)v); }
+		void f32(float v) { uint32_t bits; std::memcpy(&bits, &v, 4); u32(bits); }
+		void str(const std::string& s) { u16((uint16_t)s.size()); data.insert(data.end(), s.begin(), s.end()); }
+	};
+
+	struct ByteReader {
+		const std::vector<uint8_t>& data;
+		size_t at = 0;
+		bool ok = true;
+		bool need(size_t n) { if (at + n > data.size()) ok = false; return ok; }
+		uint8_t u8() { if (!need(1)) return 0; return data[at++]; }
+		uint16_t u16() { uint16_t lo = u8(); return (uint16_t)(lo | (u8() << 8)); }
+		uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+		int32_t i32() { return (int32_t)u32(); }
+		float f32() { uint32_t bits = u32(); float v; std::memcpy(&v, &bits, 4); return v; }
+		std::string str() { uint16_t n = u16(); if (!need(n)) return ""; std::string s((const char*)&data[at], n); at += n; return s; }
+	};
+
+	static void writeSnapshot(const WorldSnapshot& snapshot) {
+		ByteWriter w;
+		w.u32(saveMagic);
+		w.u32(saveVersion);
+		w.u8(snapshot.full ? 1 : 0);
+		w.u32(snapshot.saveID);
+		w.u32(snapshot.baseSaveID);
+		w.i32(snapshot.mapSize.x); w.i32(snapshot.mapSize.y);
+		w.i32(snapshot.tileSize.x); w.i32(snapshot.tileSize.y);
+
+		w.f32(snapshot.player.pos.x); w.f32(snapshot.player.pos.y);
+		w.f32(snapshot.player.velocity.x); w.f32(snapshot.player.velocity.y);
+		w.u8((uint8_t)snapshot.player.facing);
+
+		w.u16((uint16_t)snapshot.names.size());
+		for (const std::string& name : snapshot.names) {
+			w.str(name);
+		}
+
+		//Chunks are mostly runs of the same tile, so cells are run length encoded.
+		w.u32((uint32_t)snapshot.chunks.size());
+		for (const SavedChunk& chunk : snapshot.chunks) {
+			w.u16(chunk.chunkX);
+			w.u16(chunk.chunkY);
+			size_t i = 0;
+			while (i < chunk.cells.size()) {
+				const SavedTile& cell = chunk.cells[i];
+				size_t run = 1;
+				while (i + run < chunk.cells.size() && run < 255) {
+					const SavedTile& next = chunk.cells[i + run];
+					if (next.name != cell.name || next.textureID != cell.textureID || next.flags != cell.flags) break;
+					run++;
+				}
+				w.u8((uint8_t)run);
+				w.u8(cell.flags);
+				if (cell.flags & SAVED_PRESENT) {
+					w.u16(cell.name);
+					w.i32(cell.textureID);
+				}
+				i += run;
+			}
+		}
+
+		w.u32((uint32_t)snapshot.entities.size());
+		for (const SavedTile& e : snapshot.entities) {
+			w.u16(e.name);
+			w.i32(e.textureID);
+			w.u8(e.flags);
+			w.i32(e.x); w.i32(e.y);
+		}
+
+		std::string tempPath = snapshot.path + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				std::printf("Failed to open %s for saving\n", tempPath.c_str());
+				return;
+			}
+			out.write((const char*)w.data.data(), (std::streamsize)w.data.size());
+			if (!out) {
+				std::printf("Failed to write save %s\n", tempPath.c_str());
+				return;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, snapshot.path, ec);
+		if (ec) {
+			std::printf("Failed to replace save %s: %s\n", snapshot.path.c_str(), ec.message().c_str());
+		}
+	}
+
+	static bool readSnapshot(const std::string& path, WorldSnapshot& snapshot) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			return false;
+		}
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+		ByteReader r{ data };
+		if (r.u32() != saveMagic || r.u32() != saveVersion) {
+			std::printf("%s is not a save this version can read\n", path.c_str());
+			return false;
+		}
+
+		snapshot.full = r.u8() != 0;
+		snapshot.saveID = r.u32();
+		snapshot.baseSaveID = r.u32();
+		snapshot.mapSize.x = r.i32(); snapshot.mapSize.y = r.i32();
+		snapshot.tileSize.x = r.i32(); snapshot.tileSize.y = r.i32();
+		if (snapshot.mapSize.x <= 0 || snapshot.mapSize.y <= 0 || snapshot.mapSize.x > maxMapSide || snapshot.mapSize.y > maxMapSide
+			|| snapshot.tileSize.x <= 0 || snapshot.tileSize.y <= 0) {
+			std::printf("The save %s has a bad map size (%d x %d)\n", path.c_str(), snapshot.mapSize.x, snapshot.mapSize.y);
+			return false;
+		}
+		int chunksX = (snapshot.mapSize.x + Map::chunkSize - 1) / Map::chunkSize, chunksY = (snapshot.mapSize.y + Map::chunkSize - 1) / Map::chunkSize;
+
+		snapshot.player.pos.x = r.f32(); snapshot.player.pos.y = r.f32();
+		snapshot.player.velocity.x = r.f32(); snapshot.player.velocity.y = r.f32();
+		snapshot.player.facing = (Direction)r.u8();
+
+		uint16_t nameCount = r.u16();
+		for (uint16_t i = 0; i < nameCount && r.ok; i++) {
+			snapshot.names.push_back(r.str());
+		}
+
+		//A full save holds every chunk, and every chunk takes at least 6 bytes (its position and one run), so a map size
+		//the file is too short for is caught before anything gets allocated for it.
+		uint32_t chunkCount = r.u32();
+		if ((snapshot.full && chunkCount != (uint32_t)(chunksX * chunksY)) || (uint64_t)chunkCount * 6 > data.size() - std::min(r.at, data.size())) {
+			r.ok = false;
+		}
+		for (uint32_t c = 0; c < chunkCount && r.ok; c++) {
+			SavedChunk chunk;
+			chunk.chunkX = r.u16();
+			chunk.chunkY = r.u16();
+			if (chunk.chunkX >= chunksX || chunk.chunkY >= chunksY) r.ok = false;
+			while (chunk.cells.size() < (size_t)(Map::chunkSize * Map::chunkSize) && r.ok) {
+				uint8_t run = r.u8();
+				SavedTile cell = { 0, 0, r.u8(), 0, 0 };
+				if (cell.flags & SAVED_PRESENT) {
+					cell.name = r.u16();
+					cell.textureID = r.i32();
+					if (cell.name >= snapshot.names.size()) r.ok = false;
+				}
+				if (run == 0 || chunk.cells.size() + run > (size_t)(Map::chunkSize * Map::chunkSize)) r.ok = false;
+				chunk.cells.insert(chunk.cells.end(), run, cell);
+			}
+			snapshot.chunks.push_back(std::move(chunk));
+		}
+
+		uint32_t entityCount = r.u32();
+		for (uint32_t i = 0; i < entityCount && r.ok; i++) {
+			SavedTile e;
+			e.name = r.u16();
+			e.textureID = r.i32();
+			e.flags = r.u8();
+			e.x = r.i32(); e.y = r.i32();
+			if (e.name >= snapshot.names.size()) r.ok = false;
+			snapshot.entities.push_back(e);
+		}
+
+		if (!r.ok) {
+			std::printf("The save %s is truncated or corrupt\n", path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::string m_fullPath;
+	std::string m_autosavePath;
+	uint32_t m_lastFullID = 0;
+
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<WorldSnapshot> m_jobs;
+	std::atomic<int> m_pending{ 0 };
+	bool m_quit = false;
+};
+
+#endif
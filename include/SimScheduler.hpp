@@ -0,0 +1,240 @@
+#ifndef SIMSCHEDULER_HPP
+#define SIMSCHEDULER_HPP
+
+#include "SDL.h"
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+
+//Level of detail scheduling for anything simulated in bulk (villagers...).
+//Entities are put in tiers by their distance from a focus point (the camera centre). The full tier is updated every
+//frame, further tiers only once their interval has passed, with the whole time since their last update so they catch
+//up in one bigger step. Every tier is walked round robin from where it stopped last frame and the walk ends when the
+//frame's budget runs out, so the cost stays put however many entities there are. Each tier still gets at least one
+//update a frame so nothing starves.
+//Tiers are reassigned a slice at a time, except for entities inside the view: they're found through a coarse grid and
+//re-tiered every frame, so nothing walks into view still stuck in a tier that isn't drawn.
+
+enum SimTier {
+	SIM_TIER_FULL, // Near the camera: movement and animation every frame
+	SIM_TIER_NEAR, // Movement at a reduced rate
+	SIM_TIER_FAR, // Movement at a low rate
+	SIM_TIER_ABSTRACT, // No movement, only the schedule advances
+	SIM_TIER_COUNT
+};
+
+class SimScheduler {
+public:
+	SimScheduler() {
+		setTier(SIM_TIER_FULL, 400.0f, 0.0);
+		setTier(SIM_TIER_NEAR, 900.0f, 100.0);
+		setTier(SIM_TIER_FAR, 1800.0f, 500.0);
+		setTier(SIM_TIER_ABSTRACT, FLT_MAX, 2000.0);
+	}
+
+	// maxDistance is in world pixels from the focus (the last tier takes everything past the others), intervalMs is the
+	// time between updates (0 for every frame).
+	void setTier(SimTier tier, float maxDistance, double intervalMs) {
+		m_tiers[tier].maxDistance = maxDistance;
+		m_tiers[tier].interval = intervalMs;
+	}
+
+	// Registers an entity, returns its ID (IDs count up from 0). New entities start in the abstract tier and are
+	// placed properly as they get classified.
+	int add(SDL_FPoint pos) {
+		int id = (int)m_entities.size();
+		m_entities.push_back({ pos, m_time, SIM_TIER_ABSTRACT, 0, cellKey(pos), 0 });
+		join(id, SIM_TIER_ABSTRACT);
+		enterCell(id);
+		return id;
+	}
+
+	// Entities report where they are after moving, the tier is worked out from it.
+	void setPosition(int id, SDL_FPoint pos) {
+		Entity& entity = m_entities[id];
+		entity.pos = pos;
+		uint64_t cell = cellKey(pos);
+		if (cell != entity.cell) {
+			leaveCell(id);
+			entity.cell = cell;
+			enterCell(id);
+		}
+	}
+
+	SimTier getTier(int id) const {
+		return m_entities[id].tier;
+	}
+
+	const std::vector<int>& getMembers(SimTier tier) const {
+		return m_tiers[tier].members;
+	}
+
+	size_t getCount() const {
+		return m_entities.size();
+	}
+
+	int getUpdatesLastFrame() const {
+		return m_updatesLastFrame;
+	}
+
+	// Reclassifies everything inside view and a slice of the rest around focus, then updates what's due within budgetMs.
+	// updateEntity(int id, SimTier tier, double elapsedMs) is called for each update.
+	template <typename F>
+	void update(SDL_FPoint focus, const SDL_FRect& view, double deltaMs, double budgetMs, F&& updateEntity) {
+		m_time += deltaMs;
+		classify(focus, view);
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		Uint64 budgetTicks = (Uint64)(budgetMs * SDL_GetPerformanceFrequency() / 1000.0);
+		m_updatesLastFrame = 0;
+
+		auto serve = [&](int id, int t) {
+			Entity& entity = m_entities[id];
+			double elapsed = m_time - entity.lastUpdate;
+			entity.lastUpdate = m_time;
+			updateEntity(id, (SimTier)t, elapsed);
+			m_updatesLastFrame++;
+		};
+
+		for (int t = 0; t < SIM_TIER_COUNT; t++) {
+			Tier& tier = m_tiers[t];
+			size_t count = tier.members.size();
+			bool servedOne = false, outOfTime = false;
+			int mostOverdue = -1;
+			double mostOverdueElapsed = -1.0;
+			for (size_t visited = 0; visited < count; visited++) {
+				//Checking the clock every entity would cost more than some of the updates.
+				if (visited > 0 && (visited & 15) == 0 && SDL_GetPerformanceCounter() - start >= budgetTicks) {
+					outOfTime = true;
+					break;
+				}
+
+				if (tier.cursor >= tier.members.size()) tier.cursor = 0;
+				int id = tier.members[tier.cursor++];
+				double elapsed = m_time - m_entities[id].lastUpdate;
+				if (elapsed < tier.interval) {
+					if (elapsed > mostOverdueElapsed) {
+						mostOverdue = id;
+						mostOverdueElapsed = elapsed;
+					}
+					continue;
+				}
+
+				serve(id, t);
+				servedOne = true;
+			}
+			//Out of time before anything here was due: the one that has waited longest goes a little early instead.
+			if (outOfTime && !servedOne && mostOverdue != -1) {
+				serve(mostOverdue, t);
+			}
+		}
+	}
+
+	int classifyPerFrame = 512; // Entities outside the view re-tiered per frame, round robin
+	static constexpr float cellSize = 256.0f; // World pixels per side of a grid cell used to find the entities in view
+
+private:
+	struct Entity {
+		SDL_FPoint pos;
+		double lastUpdate; // Scheduler time (ms) of the last update
+		SimTier tier;
+		size_t slot; // Index in its tier's members
+		uint64_t cell; // Key into m_cells
+		size_t cellSlot; // Index in its cell's list
+	};
+
+	struct Tier {
+		float maxDistance = FLT_MAX;
+		double interval = 0.0;
+		std::vector<int> members;
+		size_t cursor = 0; // Round robin position
+	};
+
+	void classify(SDL_FPoint focus, const SDL_FRect& view) {
+		int cx0 = (int)std::floor(view.x / cellSize), cx1 = (int)std::floor((view.x + view.w) / cellSize);
+		int cy0 = (int)std::floor(view.y / cellSize), cy1 = (int)std::floor((view.y + view.h) / cellSize);
+		for (int cy = cy0; cy <= cy1; cy++) {
+			for (int cx = cx0; cx <= cx1; cx++) {
+				auto it = m_cells.find(cellKey(cx, cy));
+				if (it == m_cells.end()) continue;
+				for (int id : it->second) retier(id, focus);
+			}
+		}
+
+		size_t n = std::min(m_entities.size(), (size_t)std::max(classifyPerFrame, 0));
+		for (size_t i = 0; i < n; i++) {
+			if (m_classifyCursor >= m_entities.size()) m_classifyCursor = 0;
+			retier((int)m_classifyCursor++, focus);
+		}
+	}
+
+	void retier(int id, SDL_FPoint focus) {
+		Entity& entity = m_entities[id];
+		float dx = entity.pos.x - focus.x, dy = entity.pos.y - focus.y;
+		float distance = std::sqrt(dx * dx + dy * dy);
+
+		int tier = 0;
+		while (tier < SIM_TIER_COUNT - 1 && distance > m_tiers[tier].maxDistance) tier++;
+		//A little slack before moving out a tier, so walking along a boundary doesn't flip it every frame.
+		if (tier == entity.tier + 1 && distance <= m_tiers[entity.tier].maxDistance * 1.1f) tier = entity.tier;
+		if (tier != entity.tier) {
+			leave(id);
+			join(id, (SimTier)tier);
+		}
+	}
+
+	static uint64_t cellKey(int cx, int cy) {
+		return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+	}
+
+	static uint64_t cellKey(SDL_FPoint pos) {
+		return cellKey((int)std::floor(pos.x / cellSize), (int)std::floor(pos.y / cellSize));
+	}
+
+	void enterCell(int id) {
+		Entity& entity = m_entities[id];
+		std::vector<int>& list = m_cells[entity.cell];
+		entity.cellSlot = list.size();
+		list.push_back(id);
+	}
+
+	// Swap and pop, like leave().
+	void leaveCell(int id) {
+		Entity& entity = m_entities[id];
+		std::vector<int>& list = m_cells[entity.cell];
+		int last = list.back();
+		list[entity.cellSlot] = last;
+		m_entities[last].cellSlot = entity.cellSlot;
+		list.pop_back();
+	}
+
+	void join(int id, SimTier tier) {
+		Entity& entity = m_entities[id];
+		entity.tier = tier;
+		entity.slot = m_tiers[tier].members.size();
+		m_tiers[tier].members.push_back(id);
+	}
+
+	// Swap and pop out of the current tier.
+	void leave(int id) {
+		Entity& entity = m_entities[id];
+		std::vector<int>& members = m_tiers[entity.tier].members;
+		int last = members.back();
+		members[entity.slot] = last;
+		m_entities[last].slot = entity.slot;
+		members.pop_back();
+	}
+
+	std::vector<Entity> m_entities;
+	Tier m_tiers[SIM_TIER_COUNT];
+	std::unordered_map<uint64_t, std::vector<int>> m_cells; // Entity IDs per grid cell, lists are kept when they empty
+	size_t m_classifyCursor = 0;
+	double m_time = 0.0;
+	int m_updatesLastFrame = 0;
+};
+
+#endif
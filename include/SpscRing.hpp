@@ -0,0 +1,105 @@
+#ifndef SPSCRING_HPP
+#define SPSCRING_HPP
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+//Fixed size ring buffer for exactly one producer thread and one consumer thread, no locks.
+//Storage is allocated once up front (rounded up to a power of two), so neither side ever allocates. The read and write
+//counters only ever grow and are masked into the buffer; each side only writes its own counter.
+
+template <typename T>
+class SpscRing {
+public:
+	explicit SpscRing(size_t capacity) {
+		size_t size = 1;
+		while (size < capacity) size <<= 1;
+		m_items.resize(size);
+		m_mask = size - 1;
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// Producer. False if the ring is full.
+	bool push(const T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= m_items.size()) return false;
+		m_items[head & m_mask] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer. False if the ring is empty.
+	bool pop(T& item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire)) return false;
+		item = m_items[tail & m_mask];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Producer. Copies in as many items as fit, returns how many.
+	size_t write(const T* items, size_t count) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		count = std::min(count, m_items.size() - (head - m_tail.load(std::memory_order_acquire)));
+		for (size_t i = 0; i < count; i++) {
+			m_items[(head + i) & m_mask] = items[i];
+		}
+		m_head.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+	// Consumer. Copies out up to count items, returns how many.
+	size_t read(T* out, size_t count) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		count = std::min(count, m_head.load(std::memory_order_acquire) - tail);
+		for (size_t i = 0; i < count; i++) {
+			out[i] = m_items[(tail + i) & m_mask];
+		}
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	// Consumer. Drops up to count items without reading them, returns how many.
+	size_t skip(size_t count) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		count = std::min(count, m_head.load(std::memory_order_acquire) - tail);
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	// Items waiting to be read. Exact on the consumer side, a lower bound anywhere else.
+	size_t readAvailable() const {
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+	// Free slots. Exact on the producer side, a lower bound anywhere else.
+	size_t writeAvailable() const {
+		return m_items.size() - (m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire));
+	}
+
+	// Total items ever written, eg. to mark a point in the stream for the consumer.
+	size_t getWriteCount() const {
+		return m_head.load(std::memory_order_acquire);
+	}
+
+	// Total items ever read or skipped.
+	size_t getReadCount() const {
+		return m_tail.load(std::memory_order_acquire);
+	}
+
+	size_t getCapacity() const {
+		return m_items.size();
+	}
+
+private:
+	std::vector<T> m_items;
+	size_t m_mask;
+	alignas(64) std::atomic<size_t> m_head{ 0 }; // Written by the producer
+	alignas(64) std::atomic<size_t> m_tail{ 0 }; // Written by the consumer
+};
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef TEXTRENDERER_HPP
+#define TEXTRENDERER_HPP
+
+#include "SDL.h"
+#include "SDL_ttf.h"
+
+#include "FileSystem.hpp"
+#include "MemoryTracker.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+//Text drawing through a glyph atlas.
+//Glyphs are rasterized with SDL_ttf the first time they are used and packed into one shared atlas texture. A string's
+//quads are laid out once and cached as a run, so unchanged strings cost a vertex copy per frame. Everything drawn
+//between two flush() calls goes out in a single SDL_RenderGeometry call.
+
+class TextRenderer {
+public:
+	TextRenderer(SDL_Renderer* renderer, std::string fontPath, int ptSize, int atlasSize = 512) : renderer(renderer), m_atlasSize(atlasSize) {
+		if (TTF_Init() != 0) {
+			std::printf("Failed to initiate SDL_ttf: %s\n", TTF_GetError());
+			return;
+		}
+		m_ttfStarted = true;
+
+		SDL_RWops* fontFile = FileSystem::openAsset(fontPath);
+		m_font = fontFile ? TTF_OpenFontRW(fontFile, 1, ptSize) : nullptr;
+		if (m_font == nullptr) {
+			std::printf("Unable to load font from path: %s\n", fontPath.c_str());
+			return;
+		}
+		m_lineHeight = TTF_FontLineSkip(m_font);
+
+		m_atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, atlasSize, atlasSize);
+		if (m_atlas == nullptr) {
+			std::printf("Failed to create the glyph atlas: %s\n", SDL_GetError());
+			return;
+		}
+		SDL_SetTextureBlendMode(m_atlas, SDL_BLENDMODE_BLEND);
+		MemoryTracker::trackTexture(m_atlas);
+	}
+
+	~TextRenderer() {
+		if (m_atlas) MemoryTracker::destroyTexture(m_atlas);
+		if (m_font) TTF_CloseFont(m_font);
+		if (m_ttfStarted) TTF_Quit();
+	}
+
+	TextRenderer(const TextRenderer&) = delete;
+	TextRenderer& operator=(const TextRenderer&) = delete;
+
+	// Queues text with its top left corner at pos. '\n' starts a new line.
+	void drawText(const std::string& text, SDL_Point pos, SDL_Color colour = { 255, 255, 255, 255 }) {
+		if (m_font == nullptr || m_atlas == nullptr || text.empty()) return;
+
+		const TextRun& run = getRun(text);
+		size_t first = m_vertices.size();
+		m_vertices.insert(m_vertices.end(), run.vertices.begin(), run.vertices.end());
+		for (size_t i = first; i < m_vertices.size(); i++) {
+			m_vertices[i].position.x += pos.x;
+			m_vertices[i].position.y += pos.y;
+			m_vertices[i].color = colour;
+		}
+	}
+
+	// Size in pixels the text would take up.
+	SDL_Point measureText(const std::string& text) {
+		if (m_font == nullptr || m_atlas == nullptr || text.empty()) return { 0, 0 };
+		return getRun(text).size;
+	}
+
+	// Draws everything queued since the last flush in one call, then drops runs that haven't been used for a while.
+	void flush() {
+		drawQueued();
+
+		m_frame++;
+		if (m_frame % 120 == 0) {
+			for (auto it = m_runs.begin(); it != m_runs.end();) {
+				it = (m_frame - it->second.lastUsed > 120) ? m_runs.erase(it) : std::next(it);
+			}
+			trackMemory();
+		}
+	}
+
+	int getLineHeight() const {
+		return m_lineHeight;
+	}
+
+	SDL_Renderer* renderer;
+
+private:
+	struct Glyph {
+		SDL_Rect atlasRect; // Where the rasterized glyph sits in the atlas
+		int advance;
+	};
+
+	struct TextRun {
+		std::vector<SDL_Vertex> vertices; // Relative to the text origin, 4 per glyph
+		SDL_Point size;
+		uint64_t lastUsed;
+		uint32_t atlasGeneration;
+	};
+
+	void trackMemory() {
+		int64_t bytes = MemoryTracker::mapHeap(m_glyphs) + MemoryTracker::mapHeap(m_runs)
+			+ MemoryTracker::vectorHeap(m_vertices) + MemoryTracker::vectorHeap(m_indices);
+		for (const auto& run : m_runs) {
+			bytes += MemoryTracker::stringHeap(run.first) + MemoryTracker::vectorHeap(run.second.vertices);
+		}
+		m_memory.set(bytes);
+	}
+
+	void drawQueued() {
+		if (m_vertices.empty()) return;
+
+		//Quads are 4 vertices each, the index pattern is shared and only grows.
+		size_t quads = m_vertices.size() / 4;
+		while (m_indices.size() < quads * 6) {
+			int base = (int)(m_indices.size() / 6) * 4;
+			m_indices.insert(m_indices.end(), { base, base + 1, base + 2, base + 2, base + 3, base });
+		}
+		SDL_RenderGeometry(renderer, m_atlas, m_vertices.data(), (int)m_vertices.size(), m_indices.data(), (int)(quads * 6));
+		m_vertices.clear();
+	}
+
+	const TextRun& getRun(const std::string& text) {
+		auto it = m_runs.find(text);
+		if (it == m_runs.end() || it->second.atlasGeneration != m_atlasGeneration) {
+			TextRun run;
+			layout(text, run);
+			//A layout that filled the atlas may have reset it part way through, so lay it out again on the fresh atlas.
+			if (run.atlasGeneration != m_atlasGeneration) {
+				run = TextRun();
+				layout(text, run);
+			}
+			it = m_runs.insert_or_assign(text, std::move(run)).first;
+		}
+		it->second.lastUsed = m_frame;
+		return it->second;
+	}
+
+	void layout(const std::string& text, TextRun& run) {
+		run.atlasGeneration = m_atlasGeneration;
+		run.size = { 0, m_lineHeight };
+
+		float penX = 0, penY = 0;
+		Uint32 previous = 0;
+		size_t i = 0;
+		while (i < text.size()) {
+			Uint32 codepoint = nextCodepoint(text, i);
+			if (codepoint == '\n') {
+				penX = 0;
+				penY += m_lineHeight;
+				run.size.y += m_lineHeight;
+				previous = 0;
+				continue;
+			}
+
+			const Glyph* glyph = getGlyph(codepoint);
+			if (glyph == nullptr) continue;
+
+			if (previous != 0) {
+				penX += TTF_GetFontKerningSizeGlyphs32(m_font, previous, codepoint);
+			}
+			previous = codepoint;
+
+			if (glyph->atlasRect.w > 0) {
+				const SDL_Rect& r = glyph->atlasRect;
+				float u0 = (float)r.x / m_atlasSize, v0 = (float)r.y / m_atlasSize;
+				float u1 = (float)(r.x + r.w) / m_atlasSize, v1 = (float)(r.y + r.h) / m_atlasSize;
+				SDL_Color white = { 255, 255, 255, 255 };
+				run.vertices.push_back({ { penX, penY }, white, { u0, v0 } });
+				run.vertices.push_back({ { penX + r.w, penY }, white, { u1, v0 } });
+				run.vertices.push_back({ { penX + r.w, penY + r.h }, white, { u1, v1 } });
+				run.vertices.push_back({ { penX, penY + r.h }, white, { u0, v1 } });
+			}
+			penX += glyph->advance;
+			run.size.x = std::max(run.size.x, (int)penX);
+		}
+	}
+
+	// Returns the cached glyph, rasterizing it into the atlas on first use.
+	const Glyph* getGlyph(Uint32 codepoint) {
+		auto it = m_glyphs.find(codepoint);
+		if (it != m_glyphs.end()) return &it->second;
+
+		int minX, maxX, minY, maxY, advance;
+		if (TTF_GlyphMetrics32(m_font, codepoint, &minX, &maxX, &minY, &maxY, &advance) != 0) {
+			return nullptr;
+		}
+
+		Glyph glyph = { { 0, 0, 0, 0 }, advance };
+		if (codepoint != ' ') {
+			SDL_Surface* surface = TTF_RenderGlyph32_Blended(m_font, codepoint, { 255, 255, 255, 255 });
+			if (surface == nullptr) {
+				return nullptr;
+			}
+			SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+			SDL_FreeSurface(surface);
+			if (converted == nullptr) {
+				return nullptr;
+			}
+
+			if (!packGlyph(converted->w, converted->h, glyph.atlasRect)) {
+				SDL_FreeSurface(converted);
+				return nullptr;
+			}
+			SDL_UpdateTexture(m_atlas, &glyph.atlasRect, converted->pixels, converted->pitch);
+			SDL_FreeSurface(converted);
+		}
+		return &m_glyphs.insert_or_assign(codepoint, glyph).first->second;
+	}
+
+	// Shelf packing, left to right in rows. A full atlas is wiped and every glyph and run is rebuilt on demand,
+	// which only happens if a lot of different characters get used.
+	bool packGlyph(int w, int h, SDL_Rect& out) {
+		if (w + 1 > m_atlasSize || h + 1 > m_atlasSize) {
+			return false;
+		}
+		if (m_shelfX + w + 1 > m_atlasSize) {
+			m_shelfX = 0;
+			m_shelfY += m_shelfHeight + 1;
+			m_shelfHeight = 0;
+		}
+		if (m_shelfY + h + 1 > m_atlasSize) {
+			std::printf("Glyph atlas is full, rebuilding it\n");
+			drawQueued(); // Queued text still points at the old atlas layout
+			m_glyphs.clear();
+			m_shelfX = m_shelfY = m_shelfHeight = 0;
+			m_atlasGeneration++;
+		}
+		out = { m_shelfX, m_shelfY, w, h };
+		m_shelfX += w + 1;
+		m_shelfHeight = std::max(m_shelfHeight, h);
+		return true;
+	}
+
+	// Decodes one UTF-8 codepoint starting at text[i] and moves i past it. Bad bytes come out as '?'.
+	static Uint32 nextCodepoint(const std::string& text, size_t& i) {
+		unsigned char c = (unsigned char)text[i++];
+		if (c < 0x80) return c;
+
+		int extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : -1;
+		if (extra < 0 || i + extra > text.size()) return '?';
+
+		Uint32 codepoint = c & (0x3F >> extra);
+		for (int n = 0; n < extra; n++) {
+			codepoint = (codepoint << 6) | ((unsigned char)text[i++] & 0x3F);
+		}
+		return codepoint;
+	}
+
+private:
+	TTF_Font* m_font = nullptr;
+	SDL_Texture* m_atlas = nullptr;
+	bool m_ttfStarted = false;
+	int m_atlasSize;
+	int m_lineHeight = 0;
+
+	std::unordered_map<Uint32, Glyph> m_glyphs;
+	int m_shelfX = 0, m_shelfY = 0, m_shelfHeight = 0;
+	uint32_t m_atlasGeneration = 0;
+
+	std::unordered_map<std::string, TextRun> m_runs;
+	uint64_t m_frame = 0;
+
+	std::vector<SDL_Vertex> m_vertices; // This frame's quads
+	std::vector<int> m_indices;
+
+	TrackedBytes m_memory{ MEM_ASSET_DATA }; // Glyph and run caches, recounted when old runs are dropped
+};
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef TEXTURECACHE_HPP
+#define TEXTURECACHE_HPP
+
+#include "SDL.h"
+#include "SDL_image.h"
+
+#include "FileSystem.hpp"
+#include "Compression.hpp"
+#include "MemoryTracker.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+
+//On disk cache of decoded textures, so a launch doesn't have to inflate every PNG again.
+//Each entry holds the pixels already converted to the texture format (LZ4 compressed) plus the size, modification
+//time and content hash of the source image. A changed mtime alone only costs a hash of the source, the image is
+//decoded (and the entry rewritten) only when the content really changed.
+
+class TextureCache {
+public:
+	// Turns the cache on, entries are kept in dir. Until this is called loadTexture() decodes every image.
+	static void setDirectory(const std::string& dir) {
+		std::error_code ec;
+		std::filesystem::create_directories(dir, ec);
+		if (ec) {
+			std::printf("Unable to create the texture cache at %s, textures won't be cached\n", dir.c_str());
+			return;
+		}
+		directory() = dir;
+	}
+
+	static bool isEnabled() {
+		return !directory().empty();
+	}
+
+	// Loads a texture through the cache, decoding and caching it on a miss. Returns nullptr if the image can't be loaded.
+	// If alpha isn't null it gets the image's alpha channel, one byte per pixel, row by row.
+	static SDL_Texture* load(SDL_Renderer* renderer, const std::string& texturePath, int* texW, int* texH, std::vector<uint8_t>* alpha = nullptr) {
+		SourceImage source;
+		if (!describeSource(texturePath, source)) {
+			std::printf("Unable to load image from path: %s\n", texturePath.c_str());
+			return nullptr;
+		}
+
+		std::string cachePath = (std::filesystem::path(directory()) / (hexHash(AssetPack::normalizePath(texturePath)) + ".tex")).string();
+
+		SDL_Texture* tex = loadCached(renderer, cachePath, source, texW, texH, alpha);
+		if (tex != nullptr) {
+			return tex;
+		}
+		return decodeAndCache(renderer, texturePath, cachePath, source, texW, texH, alpha);
+	}
+
+	static constexpr Uint32 cachedFormat = SDL_PIXELFORMAT_ARGB8888;
+
+	// Copies the alpha channel out of cachedFormat pixels.
+	static void copyAlpha(const void* pixels, int w, int h, int pitch, std::vector<uint8_t>& alpha) {
+		alpha.resize((size_t)w * h);
+		for (int y = 0; y < h; y++) {
+			const Uint32* row = (const Uint32*)((const uint8_t*)pixels + (size_t)y * pitch);
+			uint8_t* out = alpha.data() + (size_t)y * w;
+			for (int x = 0; x < w; x++) {
+				out[x] = (uint8_t)(row[x] >> 24);
+			}
+		}
+	}
+
+private:
+	struct CacheHeader {
+		char magic[4]; // "TGTC"
+		uint32_t version;
+		uint64_t sourceSize;
+		int64_t sourceTime; // 0 for images that come from the asset pack
+		uint64_t sourceHash;
+		int32_t width, height, pitch;
+		uint32_t format;
+		uint64_t pixelBytes;
+		uint64_t compressedBytes;
+	};
+
+	static constexpr uint32_t cacheVersion = 1;
+
+	//Where the source image comes from. The pack hands out its bytes directly, loose files are only read if the hash is needed.
+	struct SourceImage {
+		std::string path;
+		const void* packedData = nullptr;
+		std::vector<uint8_t> fileData;
+		uint64_t size = 0;
+		int64_t time = 0;
+		bool hashed = false;
+		uint64_t contentHash = 0;
+
+		const void* data() {
+			if (packedData == nullptr && fileData.empty() && size > 0) {
+				std::ifstream in(FileSystem::nativePath(path), std::ios::binary);
+				fileData.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+				if (fileData.size() != size) {
+					fileData.clear(); // Changed under us, treat as unreadable
+				}
+			}
+			return packedData ? packedData : (fileData.empty() ? nullptr : fileData.data());
+		}
+
+		uint64_t hash() {
+			if (!hashed) {
+				const void* bytes = data();
+				contentHash = bytes ? AssetPack::hashBytes(bytes, (size_t)size) : 0;
+				hashed = true;
+			}
+			return contentHash;
+		}
+	};
+
+	static std::string& directory() {
+		static std::string dir;
+		return dir;
+	}
+
+	static bool describeSource(const std::string& texturePath, SourceImage& source) {
+		source.path = texturePath;
+
+		size_t packedSize;
+		if (FileSystem::findPackedAsset(texturePath, &source.packedData, &packedSize)) {
+			source.size = packedSize;
+			return true;
+		}
+
+		std::error_code ec;
+		std::filesystem::path file(FileSystem::nativePath(texturePath));
+		source.size = std::filesystem::file_size(file, ec);
+		if (ec) return false;
+		source.time = (int64_t)std::filesystem::last_write_time(file, ec).time_since_epoch().count();
+		return !ec;
+	}
+
+	static SDL_Texture* loadCached(SDL_Renderer* renderer, const std::string& cachePath, SourceImage& source, int* texW, int* texH, std::vector<uint8_t>* alpha) {
+		std::ifstream in(cachePath, std::ios::binary);
+		if (!in) return nullptr;
+
+		CacheHeader header;
+		if (!in.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, "TGTC", 4) != 0 || header.version != cacheVersion
+			|| header.format != cachedFormat || header.sourceSize != source.size) {
+			return nullptr;
+		}
+		bool sameTime = source.time != 0 && header.sourceTime == source.time;
+		if (!sameTime && header.sourceHash != source.hash()) {
+			return nullptr;
+		}
+
+		if (header.width <= 0 || header.height <= 0 || header.pitch < header.width * 4 || header.pixelBytes != (uint64_t)header.pitch * header.height) {
+			return nullptr;
+		}
+
+		std::vector<uint8_t> compressed((size_t)header.compressedBytes);
+		if (!in.read((char*)compressed.data(), (std::streamsize)compressed.size())) {
+			return nullptr;
+		}
+		std::vector<uint8_t> pixels((size_t)header.pixelBytes);
+		TrackedBytes buffers(MEM_PARSE_BUFFERS, (int64_t)(compressed.size() + pixels.size()));
+		if (!LZ4Block::decompress(compressed.data(), compressed.size(), pixels.data(), pixels.size())) {
+			std::printf("Texture cache entry %s is corrupt, decoding the source again\n", cachePath.c_str());
+			return nullptr;
+		}
+
+		SDL_Texture* tex = createTexture(renderer, header.width, header.height, pixels.data(), header.pitch);
+		if (tex != nullptr) {
+			*texW = header.width;
+			*texH = header.height;
+			if (alpha) copyAlpha(pixels.data(), header.width, header.height, header.pitch, *alpha);
+		}
+		return tex;
+	}
+
+	static SDL_Texture* decodeAndCache(SDL_Renderer* renderer, const std::string& texturePath, const std::string& cachePath, SourceImage& source, int* texW, int* texH, std::vector<uint8_t>* alpha) {
+		const void* bytes = source.data();
+		SDL_Surface* img = bytes ? IMG_Load_RW(SDL_RWFromConstMem(bytes, (int)source.size), 1) : nullptr;
+		if (img == nullptr) {
+			std::printf("Unable to load image from path: %s\n", texturePath.c_str());
+			return nullptr;
+		}
+
+		SDL_Surface* converted = SDL_ConvertSurfaceFormat(img, cachedFormat, 0);
+		SDL_FreeSurface(img);
+		if (converted == nullptr) {
+			std::printf("Failed to convert image (%s) to a texture\n", texturePath.c_str());
+			return nullptr;
+		}
+
+		TrackedBytes buffers(MEM_PARSE_BUFFERS, (int64_t)source.fileData.size() + (int64_t)converted->pitch * converted->h);
+		SDL_LockSurface(converted);
+		SDL_Texture* tex = createTexture(renderer, converted->w, converted->h, converted->pixels, converted->pitch);
+		if (tex != nullptr) {
+			*texW = converted->w;
+			*texH = converted->h;
+			if (alpha) copyAlpha(converted->pixels, converted->w, converted->h, converted->pitch, *alpha);
+			writeEntry(cachePath, source, converted);
+		}
+		SDL_UnlockSurface(converted);
+		SDL_FreeSurface(converted);
+		return tex;
+	}
+
+	static SDL_Texture* createTexture(SDL_Renderer* renderer, int w, int h, const void* pixels, int pitch) {
+		SDL_Texture* tex = SDL_CreateTexture(renderer, cachedFormat, SDL_TEXTUREACCESS_STATIC, w, h);
+		if (tex == nullptr) {
+			std::printf("Failed to create a %dx%d texture: %s\n", w, h, SDL_GetError());
+			return nullptr;
+		}
+		SDL_UpdateTexture(tex, NULL, pixels, pitch);
+		SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND); // SDL_CreateTextureFromSurface did this for images with alpha
+		return tex;
+	}
+
+	static void writeEntry(const std::string& cachePath, SourceImage& source, SDL_Surface* surface) {
+		size_t pixelBytes = (size_t)surface->pitch * surface->h;
+		std::vector<uint8_t> compressed = LZ4Block::compress((const uint8_t*)surface->pixels, pixelBytes);
+
+		CacheHeader header = {};
+		std::memcpy(header.magic, "TGTC", 4);
+		header.version = cacheVersion;
+		header.sourceSize = source.size;
+		header.sourceTime = source.time;
+		header.sourceHash = source.hash();
+		header.width = surface->w;
+		header.height = surface->h;
+		header.pitch = surface->pitch;
+		header.format = cachedFormat;
+		header.pixelBytes = pixelBytes;
+		header.compressedBytes = compressed.size();
+
+		std::string tempPath = cachePath + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			out.write((const char*)&header, sizeof(header));
+			out.write((const char*)compressed.data(), (std::streamsize)compressed.size());
+			if (!out) {
+				std::printf("Failed to write texture cache entry %s\n", tempPath.c_str());
+				return;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::rename(tempPath, cachePath, ec);
+	}
+
+	static std::string hexHash(const std::string& normalizedPath) {
+		char text[17];
+		std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)AssetPack::hashPath(normalizedPath));
+		return text;
+	}
+};
+
+#endif
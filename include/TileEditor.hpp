@@ -0,0 +1,330 @@
+#ifndef TILEEDITOR_HPP
+#define TILEEDITOR_HPP
+
+#ifdef IMPL_IMGUI
+
+#include "SDL.h"
+#include "imgui.h"
+
+#include "window.hpp"
+#include "Player.hpp"
+#include "mapReader.hpp"
+#include "Camera.hpp"
+#include "PixelCanvas.hpp"
+#include "EditJournal.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+//Paints ground tiles with the mouse. Tiles are picked in an ImGui window from any TextureAtlas added to it, or from plain
+//textures (which the auto tiler gives their edges). The brush paints a square of cells while the left button is held,
+//fill replaces the connected area of whatever tile was clicked. Every change goes through the EditJournal, a stroke is
+//recorded when the button comes up, and ctrl+Z / ctrl+Y undo and redo.
+//Only the cells under the brush are looked at and only ones that really change are set, so painting costs the same on
+//any size of map. Fills are capped at maxFillCells.
+
+enum EditorTool {
+	TOOL_BRUSH,
+	TOOL_FILL
+};
+
+class TileEditor {
+public:
+	TileEditor(Map& map, EditJournal& journal) : m_map(map), m_journal(journal) {}
+
+	// Lists every subtexture of atlas in the palette. name is what tiles painted from it are called in the map.
+	void addAtlas(const std::string& name, TextureAtlas* atlas) {
+		if (atlas == nullptr || atlas->atlas == nullptr) return;
+		std::vector<int> ids;
+		for (const auto& sub : atlas->subTextures) ids.push_back(sub.first);
+		std::sort(ids.begin(), ids.end());
+		m_palettes.push_back({ name, atlas, nullptr, ids });
+	}
+
+	// A texture painted as a plain tile, eg. "grass" which the auto tiler turns into edge pieces.
+	void addTexture(const std::string& name, SDL_Texture* texture) {
+		if (texture == nullptr) return;
+		m_palettes.push_back({ name, nullptr, texture, {} });
+	}
+
+	// Paints with the mouse and handles the undo/redo keys. Cells that changed are added to changes, for the caches built
+	// from the map (auto tiling, navigation...) to be updated before the stroke ends.
+	void update(Window& window, const Camera& camera, const PixelCanvas& canvas, std::vector<TileChange>& changes) {
+		changes.clear();
+		if (!enabled) {
+			if (m_journal.isStroking()) m_journal.endStroke(m_map);
+			return;
+		}
+
+		ImGuiIO& io = ImGui::GetIO();
+		bool ctrl = window.Keys[SDL_SCANCODE_LCTRL] || window.Keys[SDL_SCANCODE_RCTRL];
+		bool undoKey = ctrl && window.Keys[SDL_SCANCODE_Z], redoKey = ctrl && window.Keys[SDL_SCANCODE_Y];
+		if (!io.WantCaptureKeyboard) {
+			if (undoKey && !m_undoHeld) undoRequested = true;
+			if (redoKey && !m_redoHeld) redoRequested = true;
+		}
+		m_undoHeld = undoKey;
+		m_redoHeld = redoKey;
+		if (undoRequested) m_journal.undo(m_map, changes);
+		if (redoRequested) m_journal.redo(m_map, changes);
+		undoRequested = redoRequested = false;
+
+		SDL_Point screen = canvas.windowToCanvas(window.MousePos);
+		SDL_FPoint world = camera.screenToWorld({ (float)screen.x, (float)screen.y });
+		SDL_Point tileSize = m_map.getTileSize();
+		m_hoverCell = { (int)std::floor(world.x / tileSize.x), (int)std::floor(world.y / tileSize.y) };
+
+		bool painting = window.mouse_LeftClick && !io.WantCaptureMouse && m_selected >= 0;
+		if (!painting) {
+			if (m_journal.isStroking()) m_journal.endStroke(m_map);
+			m_lastCell = { -1, -1 };
+			return;
+		}
+
+		if (tool == TOOL_FILL) {
+			if (!m_journal.isStroking()) {
+				m_journal.beginStroke();
+				fill(m_hoverCell, changes);
+			}
+			return;
+		}
+
+		//Stamps along the line from last frame's cell, so fast strokes don't leave gaps.
+		if (!m_journal.isStroking()) {
+			m_journal.beginStroke();
+			m_lastCell = m_hoverCell;
+		}
+		SDL_Point from = m_lastCell, to = m_hoverCell;
+		int dx = std::abs(to.x - from.x), dy = -std::abs(to.y - from.y);
+		int sx = from.x < to.x ? 1 : -1, sy = from.y < to.y ? 1 : -1;
+		int error = dx + dy;
+		while (true) {
+			stamp(from, changes);
+			if (from.x == to.x && from.y == to.y) break;
+			int e2 = 2 * error;
+			if (e2 >= dy) { error += dy; from.x += sx; }
+			if (e2 <= dx) { error += dx; from.y += sy; }
+		}
+		m_lastCell = m_hoverCell;
+	}
+
+	// Outlines the cells the brush covers. Drawn with the world, before the canvas is scaled up.
+	void drawCursor(SDL_Renderer* renderer, const Camera& camera) {
+		if (!enabled || renderer == nullptr) return;
+		SDL_Point tileSize = m_map.getTileSize();
+		int size = tool == TOOL_BRUSH ? brushSize : 1;
+		int half = (size - 1) / 2;
+		SDL_FRect world = { (float)(m_hoverCell.x - half) * tileSize.x, (float)(m_hoverCell.y - half) * tileSize.y, (float)size * tileSize.x, (float)size * tileSize.y };
+		SDL_Rect outline = camera.worldToScreenRect(world);
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		SDL_RenderDrawRect(renderer, &outline);
+	}
+
+	// The editor's window, called from inside the ImGui frame (see Window::setRenderCallback).
+	void drawGUI() {
+		if (!enabled) return;
+
+		ImGui::Begin("Tile Editor");
+		int toolIndex = tool;
+		ImGui::RadioButton("Brush", &toolIndex, TOOL_BRUSH);
+		ImGui::SameLine();
+		ImGui::RadioButton("Fill", &toolIndex, TOOL_FILL);
+		tool = (EditorTool)toolIndex;
+		if (tool == TOOL_BRUSH) {
+			ImGui::SliderInt("Size", &brushSize, 1, 16);
+		}
+
+		ImGui::BeginDisabled(!m_journal.canUndo());
+		if (ImGui::Button("Undo")) undoRequested = true;
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		ImGui::BeginDisabled(!m_journal.canRedo());
+		if (ImGui::Button("Redo")) redoRequested = true;
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		ImGui::BeginDisabled(compacting);
+		if (ImGui::Button(compacting ? "Saving..." : "Save map")) saveRequested = true;
+		ImGui::EndDisabled();
+		ImGui::Text("Journal: %zu strokes, %.1f KB", m_journal.getStrokeCount(), m_journal.getFileSize() / 1024.0);
+
+		if (m_selected >= 0) {
+			const Palette& palette = m_palettes[m_selected];
+			if (palette.atlas != nullptr) ImGui::Text("Painting %s %d", palette.name.c_str(), m_selectedID);
+			else ImGui::Text("Painting %s", palette.name.c_str());
+		}
+		else {
+			ImGui::TextDisabled("Pick a tile to paint");
+		}
+		ImGui::Separator();
+
+		const float buttonSize = 32.0f;
+		for (int p = 0; p < (int)m_palettes.size(); p++) {
+			const Palette& palette = m_palettes[p];
+			std::string header = palette.atlas != nullptr ? palette.name : palette.name + " (auto tiled)";
+			if (!ImGui::CollapsingHeader(header.c_str(), ImGuiTreeNodeFlags_DefaultOpen)) continue;
+
+			float spacing = ImGui::GetStyle().ItemSpacing.x;
+			int perRow = std::max(1, (int)((ImGui::GetContentRegionAvail().x + spacing) / (buttonSize + spacing + 2.0f * ImGui::GetStyle().FramePadding.x)));
+			char id[96];
+			if (palette.atlas == nullptr) {
+				std::snprintf(id, sizeof(id), "##%s_plain", palette.name.c_str());
+				if (ImGui::ImageButton(id, (ImTextureID)(intptr_t)palette.texture, ImVec2(buttonSize, buttonSize), ImVec2(0, 0), ImVec2(1, 1), selectedColour(p, 0))) {
+					select(p, 0);
+				}
+				continue;
+			}
+
+			const TextureAtlas& atlas = *palette.atlas;
+			for (size_t i = 0; i < palette.ids.size(); i++) {
+				SDL_Point cell = atlas.subTextures.at(palette.ids[i]);
+				ImVec2 uv0((float)cell.x * atlas.subTextureSize.x / atlas.atlasSize.x, (float)cell.y * atlas.subTextureSize.y / atlas.atlasSize.y);
+				ImVec2 uv1((float)(cell.x + 1) * atlas.subTextureSize.x / atlas.atlasSize.x, (float)(cell.y + 1) * atlas.subTextureSize.y / atlas.atlasSize.y);
+				//Keeps the cell's aspect ratio, eg. the 96x48 trees.
+				ImVec2 size(buttonSize, buttonSize);
+				if (atlas.subTextureSize.x > atlas.subTextureSize.y) size.y = buttonSize * atlas.subTextureSize.y / atlas.subTextureSize.x;
+				else size.x = buttonSize * atlas.subTextureSize.x / atlas.subTextureSize.y;
+
+				if (i % perRow != 0) ImGui::SameLine();
+				std::snprintf(id, sizeof(id), "##%s%d", palette.name.c_str(), palette.ids[i]);
+				if (ImGui::ImageButton(id, (ImTextureID)(intptr_t)atlas.atlas, size, uv0, uv1, selectedColour(p, palette.ids[i]))) {
+					select(p, palette.ids[i]);
+				}
+			}
+		}
+		ImGui::End();
+	}
+
+	bool enabled = false;
+	EditorTool tool = TOOL_BRUSH;
+	int brushSize = 1; // Cells across
+	size_t maxFillCells = 1 << 18;
+
+	//Set by the GUI (or anyone else) and acted on in update(), except saveRequested which whoever owns the MapCompactor
+	//clears. compacting greys the save button out.
+	bool undoRequested = false;
+	bool redoRequested = false;
+	bool saveRequested = false;
+	bool compacting = false;
+
+private:
+	struct Palette {
+		std::string name;
+		TextureAtlas* atlas; // Either an atlas
+		SDL_Texture* texture; // or a plain texture
+		std::vector<int> ids; // The atlas' subtexture IDs in order
+	};
+
+	void select(int palette, int textureID) {
+		m_selected = palette;
+		m_selectedID = textureID;
+		m_brush = Tile();
+		m_brush.textureName = m_palettes[palette].name;
+		m_brush.textureID = textureID;
+		m_brush.usingTextureAtlas = m_palettes[palette].atlas != nullptr;
+		m_brush.isEntity = false;
+		m_brush.autoTiled = false;
+	}
+
+	ImVec4 selectedColour(int palette, int textureID) const {
+		bool selected = palette == m_selected && textureID == m_selectedID;
+		return selected ? ImVec4(1.0f, 0.8f, 0.2f, 1.0f) : ImVec4(0, 0, 0, 0);
+	}
+
+	// Whether the cell already holds what the brush paints. A plain tile the auto tiler has resolved still counts.
+	bool matchesBrush(int x, int y) const {
+		int index = m_map.getGroundTile(x, y);
+		if (index < 0) return false;
+		const Tile& tile = m_map.tileMap[index];
+		if (tile.textureName != m_brush.textureName) return false;
+		if (!m_brush.usingTextureAtlas) return !tile.usingTextureAtlas || tile.autoTiled;
+		return tile.usingTextureAtlas && !tile.autoTiled && tile.textureID == m_brush.textureID;
+	}
+
+	void stamp(SDL_Point centre, std::vector<TileChange>& changes) {
+		SDL_Point mapSize = m_map.getMapSize();
+		int half = (brushSize - 1) / 2;
+		for (int y = std::max(centre.y - half, 0); y < std::min(centre.y - half + brushSize, mapSize.y); y++) {
+			for (int x = std::max(centre.x - half, 0); x < std::min(centre.x - half + brushSize, mapSize.x); x++) {
+				if (matchesBrush(x, y)) continue;
+				m_journal.set(m_map, x, y, &m_brush, changes);
+			}
+		}
+	}
+
+	// Whether two cells are the same kind of tile for filling. Auto tiled cells match on their terrain alone, so a fill
+	// doesn't stop at the edge pieces.
+	bool sameKind(int index, const Tile* start) const {
+		if (index < 0 || start == nullptr) return index < 0 && start == nullptr;
+		const Tile& tile = m_map.tileMap[index];
+		if (tile.textureName != start->textureName || tile.autoTiled != start->autoTiled) return false;
+		return tile.autoTiled || (tile.usingTextureAtlas == start->usingTextureAtlas && tile.textureID == start->textureID);
+	}
+
+	// Scanline flood fill from cell over every connected cell of the same kind.
+	void fill(SDL_Point cell, std::vector<TileChange>& changes) {
+		SDL_Point mapSize = m_map.getMapSize();
+		if (cell.x < 0 || cell.y < 0 || cell.x >= mapSize.x || cell.y >= mapSize.y || matchesBrush(cell.x, cell.y)) return;
+
+		int startIndex = m_map.getGroundTile(cell.x, cell.y);
+		Tile start;
+		bool startPresent = startIndex >= 0;
+		if (startPresent) start = m_map.tileMap[startIndex];
+		auto matches = [&](int x, int y) {
+			return sameKind(m_map.getGroundTile(x, y), startPresent ? &start : nullptr);
+		};
+
+		//Painted cells stop matching the start tile, so they don't need a visited set.
+		std::vector<SDL_Point> stack = { cell };
+		size_t filled = 0;
+		while (!stack.empty() && filled < maxFillCells) {
+			SDL_Point seed = stack.back();
+			stack.pop_back();
+			if (!matches(seed.x, seed.y)) continue;
+
+			int x0 = seed.x, x1 = seed.x;
+			while (x0 > 0 && matches(x0 - 1, seed.y)) x0--;
+			while (x1 < mapSize.x - 1 && matches(x1 + 1, seed.y)) x1++;
+			x1 = std::min(x1, x0 + (int)(maxFillCells - filled) - 1);
+			for (int x = x0; x <= x1; x++) {
+				m_journal.set(m_map, x, seed.y, &m_brush, changes);
+			}
+			filled += x1 - x0 + 1;
+
+			//One seed per run of matching cells above and below.
+			for (int ny = seed.y - 1; ny <= seed.y + 1; ny += 2) {
+				if (ny < 0 || ny >= mapSize.y) continue;
+				bool inRun = false;
+				for (int x = x0; x <= x1; x++) {
+					bool match = matches(x, ny);
+					if (match && !inRun) stack.push_back({ x, ny });
+					inRun = match;
+				}
+			}
+		}
+		if (filled >= maxFillCells) {
+			std::printf("Fill stopped after %zu cells\n", filled);
+		}
+	}
+
+	Map& m_map;
+	EditJournal& m_journal;
+
+	std::vector<Palette> m_palettes;
+	int m_selected = -1; // Index into m_palettes
+	int m_selectedID = 0;
+	Tile m_brush;
+
+	SDL_Point m_hoverCell = { 0, 0 };
+	SDL_Point m_lastCell = { -1, -1 };
+	bool m_undoHeld = false;
+	bool m_redoHeld = false;
+};
+
+#endif // IMPL_IMGUI
+
+#endif
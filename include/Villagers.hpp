@@ -0,0 +1,251 @@
+#ifndef VILLAGERS_HPP
+#define VILLAGERS_HPP
+
+#include "SDL.h"
+
+#include "Player.hpp"
+#include "Navigation.hpp"
+#include "Camera.hpp"
+#include "SimScheduler.hpp"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+//Townsfolk walking a daily round: home -> work -> market -> home, waiting a while at each stop.
+//Updates go through a SimScheduler. Villagers near the camera walk their path and animate every frame, further out they
+//walk in bigger steps less often, and the furthest ones don't move at all: the time the walk would take is counted down
+//and they turn up at the stop once it's over. Paths are only asked for by villagers that really walk, through the
+//navigation queue so they share its per frame budget.
+
+enum VillagerStop {
+	STOP_HOME,
+	STOP_WORK,
+	STOP_MARKET,
+	STOP_COUNT
+};
+
+struct Villager {
+	SDL_Point stops[STOP_COUNT]; // Tiles
+	int stop = STOP_HOME; // The stop it's at, or walking to
+	bool travelling = false;
+	double waitMs = 0; // Time left at the current stop
+	double travelMs = -1; // Walk time left when walking without moving (abstract tier), -1 if not worked out yet
+
+	SDL_FPoint pos = { 0, 0 }; // World pixels, at the feet
+	std::vector<SDL_Point> path;
+	size_t pathIndex = 0;
+	int pathRequest = -1;
+	bool staleRequest = false; // pathRequest was asked for from somewhere it has left, the result gets thrown away
+
+	//Animation, only advanced in the full tier.
+	double frameTime = 0;
+	int frame = 0;
+	int row = 0; // Sprite sheet row: 0 facing down, 1 sideways, 2 up
+	bool flip = false;
+};
+
+class VillagerSystem {
+public:
+	// sprites is a sheet of 32x32 frames laid out like the player's (6 frames per row).
+	VillagerSystem(Navigation& navigation, SDL_Point tileSize, TextureAtlas* sprites)
+		: m_navigation(navigation), m_tileSize(tileSize), m_sprites(sprites) {}
+
+	int add(SDL_Point home, SDL_Point work, SDL_Point market) {
+		Villager v;
+		v.stops[STOP_HOME] = home;
+		v.stops[STOP_WORK] = work;
+		v.stops[STOP_MARKET] = market;
+		v.pos = tileCentre(home);
+		v.waitMs = random(0.0, dwellMax[STOP_HOME]); // Staggered so they don't all leave at once
+		m_villagers.push_back(v);
+		return m_scheduler.add(v.pos);
+	}
+
+	// deltaTime is in ms, like Window::deltaTime. budgetMs caps the time spent on villager updates this frame.
+	void update(const Camera& camera, double deltaTime, double budgetMs) {
+		//The full tier reaches just past the corners of the view, so everything on screen animates.
+		SDL_FRect view = camera.getViewRect();
+		float halfDiagonal = 0.5f * std::sqrt(view.w * view.w + view.h * view.h);
+		m_scheduler.setTier(SIM_TIER_FULL, halfDiagonal + 64.0f, 0.0);
+		m_scheduler.setTier(SIM_TIER_NEAR, halfDiagonal * 2.0f + 64.0f, 100.0);
+		m_scheduler.setTier(SIM_TIER_FAR, halfDiagonal * 4.0f + 64.0f, 500.0);
+
+		//Padded by a sprite so villagers whose feet are just off screen still count as in view.
+		SDL_FRect padded = { view.x - 32.0f, view.y - 32.0f, view.w + 64.0f, view.h + 64.0f };
+		m_scheduler.update(camera.getCentre(), padded, deltaTime, budgetMs, [&](int id, SimTier tier, double elapsed) {
+			updateVillager(id, tier, elapsed);
+		});
+	}
+
+	// Only the full tier can be in view, so nothing else is looked at.
+	// Sorted in with the other entities by their feet, so they walk behind and in front of trees.
+	void draw(RenderRecorder& out, const Camera& camera) {
+		//By size rather than texture, so headless replays still record them.
+		if (m_sprites == nullptr || m_sprites->atlasSize.x <= 0) return;
+
+		for (int id : m_scheduler.getMembers(SIM_TIER_FULL)) {
+			const Villager& v = m_villagers[id];
+			SDL_FRect world = { v.pos.x - 16.0f, v.pos.y - 30.0f, 32.0f, 32.0f };
+			if (!camera.isVisible(world)) continue;
+
+			SDL_Rect src = { v.frame * 32, v.row * 32, 32, 32 };
+			SDL_FRect dest = camera.worldToScreen(world);
+			out.copy(LAYER_ENTITIES, RenderQueue::depthOf(v.pos.y + 2.0f), m_sprites->atlas, &src, dest, { 255, 255, 255, 255 }, v.flip ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE);
+		}
+	}
+
+	size_t getCount() const {
+		return m_villagers.size();
+	}
+
+	const SimScheduler& getScheduler() const {
+		return m_scheduler;
+	}
+
+	float walkSpeed = 48.0f; // Pixels a second
+	double dwellMin[STOP_COUNT] = { 20000.0, 30000.0, 8000.0 }; // ms spent at each stop
+	double dwellMax[STOP_COUNT] = { 40000.0, 60000.0, 20000.0 };
+
+private:
+	void updateVillager(int id, SimTier tier, double elapsed) {
+		Villager& v = m_villagers[id];
+
+		if (!v.travelling) {
+			v.waitMs -= elapsed;
+			if (v.waitMs > 0) {
+				v.frame = 0;
+				return;
+			}
+			v.stop = (v.stop + 1) % STOP_COUNT;
+			v.travelling = true;
+			v.travelMs = -1;
+			elapsed = -v.waitMs; // Whatever was left over goes into the walk
+		}
+
+		SDL_Point goal = v.stops[v.stop];
+		if (tier == SIM_TIER_ABSTRACT) {
+			//No path, no movement, just the time it would take.
+			if (v.travelMs < 0) {
+				SDL_FPoint target = tileCentre(goal);
+				float dx = target.x - v.pos.x, dy = target.y - v.pos.y;
+				v.travelMs = std::sqrt(dx * dx + dy * dy) / walkSpeed * 1000.0;
+				v.path.clear();
+				v.staleRequest = v.pathRequest >= 0;
+			}
+			//A request still queued has to be collected or its result would sit in the navigation forever.
+			if (v.pathRequest >= 0 && m_navigation.getPath(v.pathRequest, v.path) != PATH_PENDING) {
+				v.pathRequest = -1;
+				v.staleRequest = false;
+				v.path.clear();
+			}
+			v.travelMs -= elapsed;
+			if (v.travelMs <= 0) arrive(id, v);
+			return;
+		}
+
+		//Walking for real. Villagers coming out of the abstract tier mid walk ask for a path from where they stand.
+		if (v.path.empty()) {
+			if (v.pathRequest < 0) {
+				v.pathRequest = m_navigation.requestPath(toTile(v.pos), goal);
+				v.travelMs = -1;
+				return;
+			}
+			PathStatus status = m_navigation.getPath(v.pathRequest, v.path);
+			if (status == PATH_PENDING) return;
+			v.pathRequest = -1;
+			v.pathIndex = 0;
+			if (v.staleRequest) {
+				v.staleRequest = false;
+				v.path.clear();
+				return; // Asked again from here next update
+			}
+			if (status != PATH_FOUND || v.path.empty()) {
+				//Nowhere to walk (eg. the stop got built over), skip this stop.
+				v.path.clear();
+				arrive(id, v);
+				return;
+			}
+		}
+
+		float step = walkSpeed * (float)(elapsed / 1000.0);
+		SDL_FPoint moved = { 0, 0 };
+		while (step > 0 && v.pathIndex < v.path.size()) {
+			SDL_FPoint target = tileCentre(v.path[v.pathIndex]);
+			float dx = target.x - v.pos.x, dy = target.y - v.pos.y;
+			float distance = std::sqrt(dx * dx + dy * dy);
+			if (distance <= step) {
+				v.pos = target;
+				v.pathIndex++;
+				step -= distance;
+			}
+			else {
+				v.pos.x += dx / distance * step;
+				v.pos.y += dy / distance * step;
+				step = 0;
+			}
+			moved.x += dx;
+			moved.y += dy;
+		}
+		m_scheduler.setPosition(id, v.pos);
+
+		if (tier == SIM_TIER_FULL) {
+			animate(v, moved, elapsed);
+		}
+		if (v.pathIndex >= v.path.size()) {
+			v.path.clear();
+			arrive(id, v);
+		}
+	}
+
+	void arrive(int id, Villager& v) {
+		v.pos = tileCentre(v.stops[v.stop]);
+		m_scheduler.setPosition(id, v.pos);
+		v.travelling = false;
+		v.travelMs = -1;
+		v.waitMs = random(dwellMin[v.stop], dwellMax[v.stop]);
+	}
+
+	void animate(Villager& v, SDL_FPoint moved, double elapsed) {
+		if (std::fabs(moved.x) > std::fabs(moved.y)) {
+			v.row = 1;
+			v.flip = moved.x < 0;
+		}
+		else if (moved.y != 0) {
+			v.row = moved.y < 0 ? 2 : 0;
+			v.flip = false;
+		}
+		v.frameTime += elapsed;
+		while (v.frameTime >= 150.0) {
+			v.frameTime -= 150.0;
+			v.frame = (v.frame + 1) % 6;
+		}
+	}
+
+	SDL_FPoint tileCentre(SDL_Point tile) const {
+		return { (tile.x + 0.5f) * m_tileSize.x, (tile.y + 0.5f) * m_tileSize.y };
+	}
+
+	SDL_Point toTile(SDL_FPoint pos) const {
+		return { (int)(pos.x / m_tileSize.x), (int)(pos.y / m_tileSize.y) };
+	}
+
+	// xorshift32, like the particles.
+	double random(double min, double max) {
+		m_rng ^= m_rng << 13;
+		m_rng ^= m_rng >> 17;
+		m_rng ^= m_rng << 5;
+		return min + (max - min) * ((m_rng >> 8) * (1.0 / 16777216.0));
+	}
+
+	Navigation& m_navigation;
+	SDL_Point m_tileSize;
+	TextureAtlas* m_sprites;
+
+	std::vector<Villager> m_villagers; // Indexed by scheduler ID
+	SimScheduler m_scheduler;
+	uint32_t m_rng = 0x2545F491u;
+};
+
+#endif
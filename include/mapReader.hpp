@@ -8,6 +8,8 @@
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <algorithm>
+#include <unordered_map>
 #include <regex> //Note: There are faster regular expression libs out in the wild tahn regex. Loading maps with regex will have a noticable delay.
 
 std::string find_strip(std::string findStr, std::string operStr) {
@@ -35,22 +37,58 @@ struct Tile {
 
 	bool usingTextureAtlas;
 	bool isEntity; //If the tile is an entity, it will become a rigidBody
+	bool autoTiled = false; //Set when the textureID was resolved from neighbours by an AutoTiler rather than read from the map. textureName is still the terrain's then.
 	SDL_Point pos;
 };
 
+//A grid cell patched by Map::hotReload().
+struct TileChange {
+	SDL_Point cell;
+	bool hadGround; // Whether the cell had a ground tile before the reload
+	bool hasGround; // and after it
+};
+
+//Chunks whose revision went up since their owner last looked, so caches don't have to compare every chunk each frame.
+//Registered with Map::trackChunks(), the owner clears it once it has caught up.
+struct DirtyChunks {
+	std::vector<int> chunks; // Chunk indices (chunkY * chunkCount.x + chunkX), each listed once
+	std::vector<uint8_t> flagged; // Per chunk, set while it's in chunks
+
+	void clear() {
+		for (int chunk : chunks) flagged[chunk] = 0;
+		chunks.clear();
+	}
+};
+
 class Map {
 public:
-	Map(std::string pathToMap, std::string breakTileOnChar) {
-		//Attempt to open map:
-		std::ifstream mapFile(pathToMap.c_str());
-		if (!mapFile.is_open()) {
+	Map() {}
+
+	//An empty map of mapSize tiles, to be filled in with setGroundTile() (eg. when restoring a save).
+	Map(SDL_Point mapSize, SDL_Point tileSize) : m_tileSize(tileSize), m_mapSize(mapSize) {
+		tileGrid.assign((size_t)m_mapSize.x * m_mapSize.y, -1);
+		SDL_Point chunks = getChunkCount();
+		m_editedChunks.assign((size_t)chunks.x * chunks.y, 0);
+		m_chunkRevisions.assign((size_t)chunks.x * chunks.y, 0);
+		m_chunkEntities.assign((size_t)chunks.x * chunks.y, {});
+		trackMemory();
+	}
+
+	Map(std::string pathToMap, std::string breakTileOnChar) : m_path(pathToMap) {
+		//Attempt to open map (from the asset pack if it's mounted):
+		SDL_RWops* mapFile = FileSystem::openAsset(pathToMap);
+		if (mapFile == NULL) {
 			std::printf("Failed to open the map: %s.\n Aborting Map Creation...\n", pathToMap.c_str());
 			return;
 		}
 
-		std::stringstream buffer;
-		buffer << mapFile.rdbuf();
-		std::string fileContents = buffer.str();
+		Sint64 mapSize = SDL_RWsize(mapFile);
+		std::string fileContents(mapSize > 0 ? (size_t)mapSize : 0, '\0');
+		if (!fileContents.empty()) {
+			SDL_RWread(mapFile, &fileContents[0], 1, fileContents.size());
+		}
+		SDL_RWclose(mapFile);
+		TrackedBytes parseBuffer(MEM_PARSE_BUFFERS, (int64_t)fileContents.capacity());
 
 		//Splits the file into respective lines:
 		std::istringstream lineStream(fileContents);
@@ -76,158 +114,583 @@ public:
 					}
 					else {
 						//Only raw tile rows should be left ;(
-						std::vector<std::string> rawTiles;
-						size_t startPos = 0;
-						size_t endPos = trimmedLine.find("), ");
-						while (endPos != std::string::npos) {
-							rawTiles.push_back(trimmedLine.substr(startPos, endPos + 2 - startPos));
-
-							//Move start pos for next search:
-							startPos = endPos + 3; //Skips apst the "), " delim
-							endPos = line.find("), ", startPos); //Finds next delim
-						}
-						//Adds last tile
-						rawTiles.push_back(trimmedLine.substr(startPos));
-
-						std::string rwTile;
-						for (auto& tile : rawTiles) {
-							//std::cout << tile << std::endl;
-							//Identify the tile types here:
-
-							///Special Tile Filters here
-							if (tile.find("(entity):") != std::string::npos) {
-								//Tile is an entity:
-								std::regex entityWAtlas(R"re(^\(entity\):\s*(\w+)->\((\d+)\)\((\d+),(\d+),(\d+x\d+)\)$)re"); // Entity pattern for entties using a texture atlas
-								std::regex entityTexture(R"re(^\(entity\):\s*"([^"]+)"\((\d+),(\d+)\)\?$)re");					//Entity pattern without a texture atlas, instead uses double qoutes to sshow the texture name
-								std::smatch matches;
-
-								//Entity wiht a textureAtlas
-								if (std::regex_search(tile, matches, entityWAtlas)) {
-									//Create a new entity witha  texture atlas.
-									Tile new_tile;
-									new_tile.isEntity = true;
-									new_tile.usingTextureAtlas = true;
-									new_tile.textureID = std::stoi(matches[2]); //Internal textureID.
-									new_tile.textureName = matches[1]; //Texture Atlas name
-									new_tile.pos.x = std::stoi(matches[3]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[4]) * m_tileSize.y;
-									//matches[5], matches[6] -> width & height of internal texture.
-									tileMap.push_back(new_tile);
-									continue;
-								}
-								//Entity without a textureAtlas.
-								if (std::regex_search(tile, matches, entityTexture)) {
-									Tile new_tile;
-									new_tile.isEntity = true;
-									new_tile.usingTextureAtlas = false;
-									new_tile.textureName = matches[1];
-									new_tile.pos.x = std::stoi(matches[2]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[3]) * m_tileSize.y;
-									tileMap.push_back(new_tile);
-									continue;
-								}
-							}
-							else {
-								//All other tiles filtered here:
-
-								std::regex tileWAtlas(R"((\w+)->\((\d+)\)\((\d+),(\d+)\))");
-								std::smatch matches;
-
-								//A standard tile with a textureAtlas.
-								if (std::regex_search(tile, matches, tileWAtlas)) {
-									Tile new_tile;
-									new_tile.isEntity = false;
-									new_tile.usingTextureAtlas = true;
-									new_tile.textureName = matches[1];
-									new_tile.textureID = std::stoi(matches[2]);
-									new_tile.pos.x = std::stoi(matches[3]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[4]) * m_tileSize.y;
-									tileMap.push_back(new_tile);
-									continue;
-								}
-
-								//A standard tile with a standard texture (no textureAtlas)
-								std::regex tilePattern(R"(^(\w+)\((\d+),\s*(\d+)\),?\s*$)");
-								if (std::regex_search(tile, matches, tilePattern)) {
-									Tile new_tile;
-									new_tile.isEntity = false;
-									new_tile.usingTextureAtlas = false;
-									new_tile.textureName = matches[1];
-									new_tile.pos.x = std::stoi(matches[2]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[3]) * m_tileSize.y;
-									tileMap.push_back(new_tile);
-									continue;
-								}
-								else {
-									std::cout << "This tile does not match any known pattern: " << tile << std::endl;
-								}
-							}
-
-							/*
-							//If the tile is using a textureAtlas:
-							if (tile.find("->") != std::string::npos) {
-								std::regex pattern(R"((\w+)->\((\d+)\)\((\d+),(\d+)\))");
-								std::smatch matches;
-
-								// Search for the pattern in the input string
-								if (std::regex_search(tile, matches, pattern)) {
-									//Extract the components usign the captured groups
-									Tile new_tile;
-									new_tile.textureName = matches[1];	//the atlasID
-									new_tile.textureID = std::stoi(matches[2]);	//The internal textureID
-									new_tile.pos.x = std::stoi(matches[3]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[4]) * m_tileSize.x; //pos of tile
-									new_tile.usingTextureAtlas = true;
-									tileMap.push_back(new_tile);
-								}
-								else {
-									std::cout << tile << " does not match the texture atlas pattern" << std::endl;
-								}
-							}
-							else if (tile.find("(entity): ") != std::string::npos) {
-								std::regex pattern(R"re(^(\w+):\s*"([^"]+)"\((\d+),(\d+)\)$)re");
-								std::smatch matches;
-								std::cout << tile << std::endl;
-								if (std::regex_search(tile, matches, pattern)) {
-									Tile new_tile;
-									new_tile.textureName = matches[2];
-									new_tile.pos = { std::stoi(matches[3]) * m_tileSize.x, std::stoi(matches[4]) * m_tileSize.x };
-
-									new_tile.isEntity = true;
-									new_tile.usingTextureAtlas = false; // Need to add further code, to account for an entity that uses a texture atlas.
-									tileMap.push_back(new_tile);
-								}
-								else {
-									std::cout << "Entity: " << tile << " does not match the filter" << std::endl;
-								}
-							}
-							else {
-								std::regex pattern(R"(^(\w+)\((\d+),\s*(\d+)\),?\s*$)");
-								std::smatch matches;
-
-								if (std::regex_match(tile, matches, pattern)) {
-									Tile new_tile;
-									new_tile.textureName = matches[1]; // Any string before the paranthesis
-									new_tile.pos.x = std::stoi(matches[2]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[3]) * m_tileSize.y;
-
-									new_tile.isEntity = false;
-									new_tile.usingTextureAtlas = false;
-									tileMap.push_back(new_tile);
-								}
-								else {
-									std::cout << "This tile has no filter: " << tile << std::endl;
-								}
-							}*/
-						}
+						size_t firstTile = tileMap.size();
+						parseRow(trimmedLine, tileMap);
+						m_rows.push_back(makeRow(trimmedLine, tileMap.data() + firstTile, tileMap.size() - firstTile));
 					}
 				}
 			}
 		}
-		mapFile.close();
+		buildTileGrid();
+		trackMemory();
+	}
+
+	//Re-reads the map file this map was parsed from and patches the ground tiles in place. Rows are matched by a hash of
+	//their text, so only rows that are new or changed get parsed, and only the cells of changed rows are touched.
+	//Entities and anything outside the map's current size are left alone (they need a restart). The patched cells are
+	//returned in changes so caches built from the map (auto tiling, navigation...) can be updated.
+	bool hotReload(std::vector<TileChange>& changes) {
+		changes.clear();
+		if (m_path.empty()) return false;
+
+		//Always the loose file, the asset pack is what shipped rather than what's being edited.
+		std::ifstream file(FileSystem::nativePath(m_path), std::ios::binary);
+		if (!file) {
+			std::printf("Failed to open the map %s for reloading\n", m_path.c_str());
+			return false;
+		}
+		std::string fileContents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		TrackedBytes parseBuffer(MEM_PARSE_BUFFERS, (int64_t)fileContents.capacity());
+
+		std::unordered_multimap<uint64_t, size_t> oldRows; // Row hash -> index in m_rows, removed once matched
+		for (size_t i = 0; i < m_rows.size(); i++) {
+			oldRows.emplace(m_rows[i].hash, i);
+		}
+
+		std::vector<MapRow> rows;
+		std::vector<Tile> addedTiles;
+		int entityRows = 0;
+
+		std::istringstream lineStream(fileContents);
+		std::string line;
+		while (std::getline(lineStream, line)) {
+			std::string trimmedLine = trimWhitespace(line);
+			if (trimmedLine.empty() || trimmedLine[0] == '#') continue;
+
+			if (trimmedLine.find("Tile Size:") != std::string::npos) {
+				std::string tileSize = find_strip("Tile Size: ", trimmedLine);
+				size_t tPos = tileSize.find('x');
+				if (tPos != std::string::npos && (std::stoi(tileSize.substr(0, tPos)) != m_tileSize.x || std::stoi(tileSize.substr(tPos + 1)) != m_tileSize.y)) {
+					std::printf("The tile size of %s changed, restart to load it\n", m_path.c_str());
+					return false;
+				}
+				continue;
+			}
+
+			uint64_t hash = AssetPack::hashBytes(trimmedLine.data(), trimmedLine.size());
+			auto match = oldRows.find(hash);
+			if (match != oldRows.end()) {
+				rows.push_back(std::move(m_rows[match->second]));
+				oldRows.erase(match);
+				continue;
+			}
+
+			std::vector<Tile> tiles;
+			parseRow(trimmedLine, tiles);
+			rows.push_back(makeRow(trimmedLine, tiles.data(), tiles.size()));
+			if (rows.back().entities > 0) entityRows++;
+			for (Tile& tile : tiles) {
+				if (!tile.isEntity) addedTiles.push_back(std::move(tile));
+			}
+		}
+
+		//Whatever wasn't matched was removed or changed.
+		std::vector<SDL_Point> removedCells;
+		for (const auto& old : oldRows) {
+			const MapRow& row = m_rows[old.second];
+			removedCells.insert(removedCells.end(), row.cells.begin(), row.cells.end());
+			if (row.entities > 0) entityRows++;
+		}
+		m_rows = std::move(rows);
+
+		if (entityRows > 0) {
+			std::printf("%d rows with entities changed in %s, entities are only loaded at start up\n", entityRows, m_path.c_str());
+		}
+		if (removedCells.empty() && addedTiles.empty()) {
+			trackMemory();
+			return true;
+		}
+
+		//Remember which cells had ground before anything is patched.
+		std::vector<int> touched;
+		for (const SDL_Point& cell : removedCells) touched.push_back(cell.y * m_mapSize.x + cell.x);
+		for (const Tile& tile : addedTiles) {
+			int x = tile.pos.x / m_tileSize.x, y = tile.pos.y / m_tileSize.y;
+			if (x < m_mapSize.x && y < m_mapSize.y) touched.push_back(y * m_mapSize.x + x);
+		}
+		std::sort(touched.begin(), touched.end());
+		touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+		for (int index : touched) {
+			changes.push_back({ { index % m_mapSize.x, index / m_mapSize.x }, tileGrid[index] >= 0, false });
+		}
+
+		//Removed first, so a changed row that still has a tile in a cell puts it back.
+		for (const SDL_Point& cell : removedCells) {
+			clearGroundTile(cell.x, cell.y);
+		}
+		int outside = 0;
+		for (const Tile& tile : addedTiles) {
+			int x = tile.pos.x / m_tileSize.x, y = tile.pos.y / m_tileSize.y;
+			if (x >= m_mapSize.x || y >= m_mapSize.y) {
+				outside++;
+				continue;
+			}
+			setGroundTile(x, y, tile);
+		}
+		if (outside > 0) {
+			std::printf("%d tiles are outside the map's current size, restart to grow the map\n", outside);
+		}
+
+		for (TileChange& change : changes) {
+			change.hasGround = getGroundTile(change.cell.x, change.cell.y) >= 0;
+		}
+		trackMemory();
+		return true;
+	}
+
+	//The map file this map was parsed from, empty for maps built another way (eg. restored from a save).
+	const std::string& getPath() const {
+		return m_path;
+	}
+
+	//Re-bases hotReload() on a map file this map was just written out to (see MapCompactor), so it doesn't reload its own
+	//write and later reloads only patch rows changed after it. groundRows[y] is the hash of the line holding grid row y
+	//(0 if it was left out), entityRows the hashes of the entity lines after them. The cells come from the grid as it is now.
+	void rebaseRows(const std::vector<uint64_t>& groundRows, const std::vector<uint64_t>& entityRows) {
+		m_rows.clear();
+		for (int y = 0; y < (int)groundRows.size() && y < m_mapSize.y; y++) {
+			if (groundRows[y] == 0) continue;
+			MapRow row;
+			row.hash = groundRows[y];
+			for (int x = 0; x < m_mapSize.x; x++) {
+				if (tileGrid[y * m_mapSize.x + x] >= 0) row.cells.push_back({ x, y });
+			}
+			m_rows.push_back(std::move(row));
+		}
+		for (uint64_t hash : entityRows) {
+			MapRow row;
+			row.hash = hash;
+			row.entities = 1;
+			m_rows.push_back(std::move(row));
+		}
+		trackMemory();
+	}
+
+	//Returns the index into tileMap of the ground (non-entity) tile at grid pos (x, y), or -1 if the cell is empty.
+	int getGroundTile(int x, int y) const {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) {
+			return -1;
+		}
+		return tileGrid[y * m_mapSize.x + x];
+	}
+
+	SDL_Point getMapSize() const { return m_mapSize; } // In tiles
+	SDL_Point getTileSize() const { return m_tileSize; } // In pixels
+
+	//Maps are split into square chunks of chunkSize x chunkSize tiles for anything that works on regions of the map.
+	static constexpr int chunkSize = 16;
+	SDL_Point getChunkCount() const { return { (m_mapSize.x + chunkSize - 1) / chunkSize, (m_mapSize.y + chunkSize - 1) / chunkSize }; }
+
+	//Places (or replaces) the ground tile at grid pos (x, y). The tile's pos is set from the grid pos.
+	void setGroundTile(int x, int y, const Tile& tile) {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return;
+
+		int& index = tileGrid[y * m_mapSize.x + x];
+		bool grew = false;
+		if (index < 0) {
+			index = (int)tileMap.size();
+			size_t capacity = tileMap.capacity();
+			tileMap.push_back(tile);
+			grew = tileMap.capacity() != capacity;
+		}
+		else {
+			m_nameBytes -= MemoryTracker::stringHeap(tileMap[index].textureName);
+			tileMap[index] = tile;
+		}
+		m_nameBytes += MemoryTracker::stringHeap(tileMap[index].textureName); // After the copy, it may have kept a bigger buffer
+		if (grew) trackMemory(); // Only recount when the storage actually grew
+		tileMap[index].isEntity = false;
+		tileMap[index].pos = { x * m_tileSize.x, y * m_tileSize.y };
+		markEdited(x, y);
+	}
+
+	//Removes the ground tile at grid pos (x, y) by swapping the last tile into its slot.
+	void clearGroundTile(int x, int y) {
+		int index = getGroundTile(x, y);
+		if (index < 0) return;
+
+		int last = (int)tileMap.size() - 1;
+		m_nameBytes -= MemoryTracker::stringHeap(tileMap[index].textureName);
+		if (index != last) {
+			m_nameBytes -= MemoryTracker::stringHeap(tileMap[last].textureName);
+			tileMap[index] = std::move(tileMap[last]);
+			m_nameBytes += MemoryTracker::stringHeap(tileMap[index].textureName);
+			if (!tileMap[index].isEntity) {
+				tileGrid[(tileMap[index].pos.y / m_tileSize.y) * m_mapSize.x + tileMap[index].pos.x / m_tileSize.x] = index;
+			}
+		}
+		tileMap.pop_back();
+		tileGrid[y * m_mapSize.x + x] = -1;
+		if (index != last && tileMap[index].isEntity) {
+			std::vector<int>& list = m_chunkEntities[entityChunk(tileMap[index].pos)];
+			std::replace(list.begin(), list.end(), last, index);
+		}
+		markEdited(x, y);
+	}
+
+	//Adds an entity tile at its pos (in pixels) and returns its index in tileMap.
+	int addEntity(const Tile& tile) {
+		int index = (int)tileMap.size();
+		tileMap.push_back(tile);
+		m_nameBytes += MemoryTracker::stringHeap(tileMap[index].textureName);
+		tileMap[index].isEntity = true;
+		tileMap[index].autoTiled = false;
+		size_t chunk = entityChunk(tile.pos);
+		m_chunkEntities[chunk].push_back(index);
+		bumpRevision(chunk);
+		return index;
+	}
+
+	//tileMap indices of the entities whose top left corner is in a chunk. Entities off the map count in the nearest one.
+	const std::vector<int>& getChunkEntities(int chunkX, int chunkY) const {
+		return m_chunkEntities[chunkY * getChunkCount().x + chunkX];
+	}
+
+	//Starts listing every chunk whose revision goes up into dirty. The list has to stay alive until untrackChunks().
+	void trackChunks(DirtyChunks& dirty) const {
+		SDL_Point chunks = getChunkCount();
+		dirty.flagged.assign((size_t)chunks.x * chunks.y, 0);
+		dirty.chunks.clear();
+		m_dirtyLists.push_back(&dirty);
+	}
+
+	void untrackChunks(DirtyChunks& dirty) const {
+		m_dirtyLists.erase(std::remove(m_dirtyLists.begin(), m_dirtyLists.end(), &dirty), m_dirtyLists.end());
+	}
+
+	//Re-estimates the memory behind the tiles and grids (MEM_MAP_TILES). Done after loads and whenever tileMap grows.
+	//The tiles' names are kept count of as they're set and cleared, so this never walks tileMap.
+	void trackMemory() {
+		int64_t bytes = MemoryTracker::vectorHeap(tileMap) + MemoryTracker::vectorHeap(tileGrid)
+			+ MemoryTracker::vectorHeap(m_editedChunks) + MemoryTracker::vectorHeap(m_chunkRevisions) + MemoryTracker::vectorHeap(m_rows);
+		bytes += m_nameBytes;
+		for (const MapRow& row : m_rows) {
+			bytes += MemoryTracker::vectorHeap(row.cells);
+		}
+		bytes += MemoryTracker::vectorHeap(m_chunkEntities);
+		for (const std::vector<int>& list : m_chunkEntities) {
+			bytes += MemoryTracker::vectorHeap(list);
+		}
+		m_memory.set(bytes);
+	}
+
+	//Removes every entity tile, keeping the ground tiles.
+	void removeEntities() {
+		//Caches of what's drawn over those chunks are out of date, but nothing was edited as far as saving goes.
+		for (size_t chunk = 0; chunk < m_chunkEntities.size(); chunk++) {
+			if (!m_chunkEntities[chunk].empty()) bumpRevision(chunk);
+			m_chunkEntities[chunk].clear();
+		}
+		tileMap.erase(std::remove_if(tileMap.begin(), tileMap.end(), [](const Tile& t) { return t.isEntity; }), tileMap.end());
+		indexGroundTiles(); // Recounts the names too, the tiles all moved
+	}
+
+	//Flags the chunk holding grid pos (x, y) as changed since the last full save. Anything that edits tiles in place should call this.
+	void markEdited(int x, int y) {
+		if (x < 0 || y < 0 || x >= m_mapSize.x || y >= m_mapSize.y) return;
+		size_t chunk = (size_t)(y / chunkSize) * getChunkCount().x + x / chunkSize;
+		m_editedChunks[chunk] = 1;
+		bumpRevision(chunk);
+	}
+
+	//Counts every edit to a chunk, never reset. Caches built from a chunk compare it to tell if they're out of date.
+	uint32_t getChunkRevision(int chunkX, int chunkY) const {
+		return m_chunkRevisions[chunkY * getChunkCount().x + chunkX];
+	}
+
+	bool isChunkEdited(int chunkX, int chunkY) const {
+		return m_editedChunks[chunkY * getChunkCount().x + chunkX] != 0;
+	}
+
+	void clearEditedChunks() {
+		std::fill(m_editedChunks.begin(), m_editedChunks.end(), 0);
 	}
 
 	std::vector<Tile> tileMap;
 
+	//Grid of tileMap indices for ground tiles, row major, m_mapSize.x * m_mapSize.y. -1 marks an empty cell.
+	std::vector<int> tileGrid;
+
 private:
+	//What a row of the map file produced, so a reload can tell which rows changed and which cells they cover.
+	struct MapRow {
+		uint64_t hash; // Of the trimmed row text
+		std::vector<SDL_Point> cells; // Grid cells of its ground tiles
+		int entities = 0;
+	};
+
+	MapRow makeRow(const std::string& trimmedLine, const Tile* tiles, size_t count) const {
+		MapRow row;
+		row.hash = AssetPack::hashBytes(trimmedLine.data(), trimmedLine.size());
+		for (size_t i = 0; i < count; i++) {
+			if (tiles[i].isEntity) {
+				row.entities++;
+			}
+			else {
+				row.cells.push_back({ tiles[i].pos.x / m_tileSize.x, tiles[i].pos.y / m_tileSize.y });
+			}
+		}
+		return row;
+	}
+
+	//Reads the two forms nearly every ground tile is written in, name(x, y) and name->(id)(x,y), without a regex.
+	//False for anything else, which then goes through the patterns in parseRow().
+	static bool scanGroundTile(const std::string& tile, Tile& out) {
+		size_t i = 0;
+		while (i < tile.size() && (std::isalnum((unsigned char)tile[i]) || tile[i] == '_')) i++;
+		if (i == 0) return false;
+		size_t nameEnd = i;
+
+		//Up to 9 digits, so it always fits in an int.
+		auto readInt = [&](int& value) {
+			size_t start = i;
+			value = 0;
+			while (i < tile.size() && std::isdigit((unsigned char)tile[i]) && i - start < 9) value = value * 10 + (tile[i++] - '0');
+			return i > start && (i >= tile.size() || !std::isdigit((unsigned char)tile[i]));
+		};
+		auto expect = [&](const char* text) {
+			for (; *text; text++, i++) {
+				if (i >= tile.size() || tile[i] != *text) return false;
+			}
+			return true;
+		};
+
+		bool atlas = tile.compare(i, 3, "->(") == 0;
+		int id = 0, x = 0, y = 0;
+		if (atlas) {
+			i += 3;
+			if (!readInt(id) || !expect(")(") || !readInt(x) || !expect(",") || !readInt(y) || !expect(")")) return false;
+		}
+		else {
+			if (!expect("(") || !readInt(x) || !expect(",")) return false;
+			while (i < tile.size() && std::isspace((unsigned char)tile[i])) i++;
+			if (!readInt(y) || !expect(")")) return false;
+		}
+		if (i < tile.size() && tile[i] == ',') i++;
+		while (i < tile.size() && std::isspace((unsigned char)tile[i])) i++;
+		if (i != tile.size()) return false;
+
+		out.textureName.assign(tile, 0, nameEnd);
+		out.textureID = id;
+		out.usingTextureAtlas = atlas;
+		out.isEntity = false;
+		out.pos = { x, y }; // In tiles, the caller scales it
+		return true;
+	}
+
+	//Parses one row of the map file, appending its tiles to out.
+	void parseRow(const std::string& trimmedLine, std::vector<Tile>& out) {
+		//Built once, building a std::regex costs far more than matching one.
+		static const std::regex entityWAtlas(R"re(^\(entity\):\s*(\w+)->\((\d+)\)\((\d+),(\d+),(\d+x\d+)\)$)re"); // Entity pattern for entties using a texture atlas
+		static const std::regex entityTexture(R"re(^\(entity\):\s*"([^"]+)"\((\d+),(\d+)\)\?$)re");					//Entity pattern without a texture atlas, instead uses double qoutes to sshow the texture name
+		static const std::regex tileWAtlas(R"((\w+)->\((\d+)\)\((\d+),(\d+)\))");
+		static const std::regex tilePattern(R"(^(\w+)\((\d+),\s*(\d+)\),?\s*$)");
+
+		std::vector<std::string> rawTiles;
+		size_t startPos = 0;
+		size_t endPos = trimmedLine.find("), ");
+		while (endPos != std::string::npos) {
+			rawTiles.push_back(trimmedLine.substr(startPos, endPos + 2 - startPos));
+
+			//Move start pos for next search:
+			startPos = endPos + 3; //Skips apst the "), " delim
+			endPos = trimmedLine.find("), ", startPos); //Finds next delim
+		}
+		//Adds last tile
+		rawTiles.push_back(trimmedLine.substr(startPos));
+
+		std::string rwTile;
+		for (auto& tile : rawTiles) {
+			//std::cout << tile << std::endl;
+			//Identify the tile types here:
+
+			///Special Tile Filters here
+			if (tile.find("(entity):") != std::string::npos) {
+				//Tile is an entity:
+				std::smatch matches;
+
+				//Entity wiht a textureAtlas
+				if (std::regex_search(tile, matches, entityWAtlas)) {
+					//Create a new entity witha  texture atlas.
+					Tile new_tile;
+					new_tile.isEntity = true;
+					new_tile.usingTextureAtlas = true;
+					new_tile.textureID = std::stoi(matches[2]); //Internal textureID.
+					new_tile.textureName = matches[1]; //Texture Atlas name
+					new_tile.pos.x = std::stoi(matches[3]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[4]) * m_tileSize.y;
+					//matches[5], matches[6] -> width & height of internal texture.
+					out.push_back(new_tile);
+					continue;
+				}
+				//Entity without a textureAtlas.
+				if (std::regex_search(tile, matches, entityTexture)) {
+					Tile new_tile;
+					new_tile.isEntity = true;
+					new_tile.usingTextureAtlas = false;
+					new_tile.textureName = matches[1];
+					new_tile.pos.x = std::stoi(matches[2]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[3]) * m_tileSize.y;
+					out.push_back(new_tile);
+					continue;
+				}
+			}
+			else {
+				//All other tiles filtered here:
+				Tile new_tile;
+				if (scanGroundTile(tile, new_tile)) {
+					new_tile.pos.x *= m_tileSize.x; new_tile.pos.y *= m_tileSize.y;
+					out.push_back(std::move(new_tile));
+					continue;
+				}
+
+				std::smatch matches;
+
+				//A standard tile with a textureAtlas.
+				if (std::regex_search(tile, matches, tileWAtlas)) {
+					Tile new_tile;
+					new_tile.isEntity = false;
+					new_tile.usingTextureAtlas = true;
+					new_tile.textureName = matches[1];
+					new_tile.textureID = std::stoi(matches[2]);
+					new_tile.pos.x = std::stoi(matches[3]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[4]) * m_tileSize.y;
+					out.push_back(new_tile);
+					continue;
+				}
+
+				//A standard tile with a standard texture (no textureAtlas)
+				if (std::regex_search(tile, matches, tilePattern)) {
+					Tile new_tile;
+					new_tile.isEntity = false;
+					new_tile.usingTextureAtlas = false;
+					new_tile.textureName = matches[1];
+					new_tile.pos.x = std::stoi(matches[2]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[3]) * m_tileSize.y;
+					out.push_back(new_tile);
+					continue;
+				}
+				else {
+					std::cout << "This tile does not match any known pattern: " << tile << std::endl;
+				}
+			}
+
+			/*
+			//If the tile is using a textureAtlas:
+			if (tile.find("->") != std::string::npos) {
+				std::regex pattern(R"((\w+)->\((\d+)\)\((\d+),(\d+)\))");
+				std::smatch matches;
+
+				// Search for the pattern in the input string
+				if (std::regex_search(tile, matches, pattern)) {
+					//Extract the components usign the captured groups
+					Tile new_tile;
+					new_tile.textureName = matches[1];	//the atlasID
+					new_tile.textureID = std::stoi(matches[2]);	//The internal textureID
+					new_tile.pos.x = std::stoi(matches[3]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[4]) * m_tileSize.x; //pos of tile
+					new_tile.usingTextureAtlas = true;
+					out.push_back(new_tile);
+				}
+				else {
+					std::cout << tile << " does not match the texture atlas pattern" << std::endl;
+				}
+			}
+			else if (tile.find("(entity): ") != std::string::npos) {
+				std::regex pattern(R"re(^(\w+):\s*"([^"]+)"\((\d+),(\d+)\)$)re");
+				std::smatch matches;
+				std::cout << tile << std::endl;
+				if (std::regex_search(tile, matches, pattern)) {
+					Tile new_tile;
+					new_tile.textureName = matches[2];
+					new_tile.pos = { std::stoi(matches[3]) * m_tileSize.x, std::stoi(matches[4]) * m_tileSize.x };
+
+					new_tile.isEntity = true;
+					new_tile.usingTextureAtlas = false; // Need to add further code, to account for an entity that uses a texture atlas.
+					out.push_back(new_tile);
+				}
+				else {
+					std::cout << "Entity: " << tile << " does not match the filter" << std::endl;
+				}
+			}
+			else {
+				std::regex pattern(R"(^(\w+)\((\d+),\s*(\d+)\),?\s*$)");
+				std::smatch matches;
+
+				if (std::regex_match(tile, matches, pattern)) {
+					Tile new_tile;
+					new_tile.textureName = matches[1]; // Any string before the paranthesis
+					new_tile.pos.x = std::stoi(matches[2]) * m_tileSize.x; new_tile.pos.y = std::stoi(matches[3]) * m_tileSize.y;
+
+					new_tile.isEntity = false;
+					new_tile.usingTextureAtlas = false;
+					out.push_back(new_tile);
+				}
+				else {
+					std::cout << "This tile has no filter: " << tile << std::endl;
+				}
+			}*/
+		}
+	}
+
+	//Works out the map dimensions from the parsed tiles and indexes every ground tile by its grid position.
+	void buildTileGrid() {
+		m_mapSize = { 0, 0 };
+		for (const auto& tile : tileMap) {
+			m_mapSize.x = std::max(m_mapSize.x, tile.pos.x / m_tileSize.x + 1);
+			m_mapSize.y = std::max(m_mapSize.y, tile.pos.y / m_tileSize.y + 1);
+		}
+
+		SDL_Point chunks = getChunkCount();
+		m_editedChunks.assign((size_t)chunks.x * chunks.y, 0);
+		m_chunkRevisions.assign((size_t)chunks.x * chunks.y, 0);
+
+		indexGroundTiles();
+		m_chunkEntities.assign((size_t)chunks.x * chunks.y, {});
+		for (size_t i = 0; i < tileMap.size(); i++) {
+			if (tileMap[i].isEntity) m_chunkEntities[entityChunk(tileMap[i].pos)].push_back((int)i);
+		}
+	}
+
+	// The chunk an entity at pixel pos is listed in, clamped onto the map.
+	size_t entityChunk(SDL_Point pos) const {
+		SDL_Point chunks = getChunkCount();
+		int cx = std::min(std::max(pos.x / m_tileSize.x / chunkSize, 0), std::max(chunks.x - 1, 0));
+		int cy = std::min(std::max(pos.y / m_tileSize.y / chunkSize, 0), std::max(chunks.y - 1, 0));
+		return (size_t)cy * chunks.x + cx;
+	}
+
+	void bumpRevision(size_t chunk) {
+		m_chunkRevisions[chunk]++;
+		for (DirtyChunks* dirty : m_dirtyLists) {
+			if (chunk >= dirty->flagged.size() || dirty->flagged[chunk]) continue;
+			dirty->flagged[chunk] = 1;
+			dirty->chunks.push_back((int)chunk);
+		}
+	}
+
+	//Rebuilds tileGrid from tileMap, and the count of the names' heap while it's walking them anyway.
+	void indexGroundTiles() {
+		tileGrid.assign((size_t)m_mapSize.x * m_mapSize.y, -1);
+		m_nameBytes = 0;
+		for (size_t i = 0; i < tileMap.size(); i++) {
+			m_nameBytes += MemoryTracker::stringHeap(tileMap[i].textureName);
+			if (tileMap[i].isEntity) continue;
+			int x = tileMap[i].pos.x / m_tileSize.x;
+			int y = tileMap[i].pos.y / m_tileSize.y;
+			tileGrid[y * m_mapSize.x + x] = (int)i;
+		}
+	}
+
+	std::string m_path;
+	std::vector<MapRow> m_rows; // Tile rows of the map file in file order
+	TrackedBytes m_memory{ MEM_MAP_TILES };
+	int64_t m_nameBytes = 0; // Heap behind the tiles' textureNames, see trackMemory()
+
 	std::string breakChar; // The string that tells the reader when to stop reading that tile. So if the tile input in the map ends in '),', the break on char should be that.
 
 	int errorCode = 0;
-	SDL_Point m_tileSize;
+	SDL_Point m_tileSize = { 16, 16 };
+	SDL_Point m_mapSize = { 0, 0 };
+	std::vector<uint8_t> m_editedChunks; // One flag per chunk, set when it changed since the last full save
+	std::vector<uint32_t> m_chunkRevisions; // One edit counter per chunk
+	std::vector<std::vector<int>> m_chunkEntities; // tileMap indices of the entities in each chunk
+	mutable std::vector<DirtyChunks*> m_dirtyLists; // Registered through trackChunks(), caches only watch so it works on a const Map
 };
 
 #endif
\ No newline at end of file
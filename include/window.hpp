@@ -7,6 +7,7 @@
 #include "SDL_image.h"
 
 #include "FileSystem.hpp"
+#include "Input.hpp"
 
 
 #include <iostream>
@@ -109,8 +110,18 @@ namespace ImGui {
 
 class Window {
 public:
-    Window(const char* title, int windowWidth, int windowHeight, Uint32 windowFlags)
-        : width(windowWidth), height(windowHeight) {
+    // A headless window creates no SDL window or renderer (renderer stays NULL) and can only be driven by an input replay.
+    Window(const char* title, int windowWidth, int windowHeight, Uint32 windowFlags, bool headless = false)
+        : width(windowWidth), height(windowHeight), headless(headless) {
+
+        if (headless) {
+            if (SDL_Init(SDL_INIT_TIMER) != 0) {
+                std::cout << "Failed to initiate SDL. Aborting" << std::endl;
+                return;
+            }
+            appState = true;
+            return;
+        }
 
         if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
             std::cout << "Failed to initiate SDL. Aborting" << std::endl;
@@ -164,7 +175,30 @@ public:
 #endif
     }
 
+    // Starts writing every frame's input to path until the window closes.
+    bool startRecording(const std::string& path) {
+        return m_recorder.open(path);
+    }
+
+    // Drives the window from a recording instead of the keyboard, mouse and clock. appState goes false when it ends.
+    bool startReplay(const std::string& path) {
+        if (!m_replay.open(path)) {
+            return false;
+        }
+        Keys = m_replayKeys;
+        return true;
+    }
+
+    bool isReplaying() {
+        return m_replay.isOpen();
+    }
+
     void update() {
+        if (m_replay.isOpen() || headless) {
+            replayFrame();
+            return;
+        }
+
         while (SDL_PollEvent(&event)) {
 #ifdef IMPL_IMGUI
             ImGui_ImplSDL2_ProcessEvent(&event);
@@ -174,15 +208,46 @@ public:
                 appState = false;
             }
 
-            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED) {
                 SDL_GetWindowSize(window, &width, &height);
                 windowResized = true;
             }
+
+            // Render target textures lose their contents, anything drawn into them has to be redrawn.
+            if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET) {
+                renderTargetsReset = true;
+            }
         }
 
         Keys = SDL_GetKeyboardState(NULL);
 
         Uint32 mouseData = SDL_GetMouseState(&MousePos.x, &MousePos.y);
+        setMouseButtons(mouseData);
+
+        // Update deltaTime
+        LAST = NOW;
+        NOW = SDL_GetPerformanceCounter();
+        deltaTime = ((NOW - LAST) * 1000) / SDL_GetPerformanceFrequency();
+
+        if (m_recorder.isOpen()) {
+            m_frameInput.deltaTime = deltaTime;
+            m_frameInput.mousePos = MousePos;
+            m_frameInput.mouseButtons = mouseData;
+            m_frameInput.keysDown.clear();
+            for (int i = 0; i < SDL_NUM_SCANCODES; i++) {
+                if (Keys[i]) m_frameInput.keysDown.push_back((Uint16)i);
+            }
+            m_recorder.record(m_frameInput);
+        }
+
+#ifdef IMPL_IMGUI
+        updateImGui();
+#endif
+
+        SDL_RenderPresent(renderer);
+    }
+
+    void setMouseButtons(Uint32 mouseData) {
         switch (mouseData) {
         case 1:
             mouse_LeftClick = true;
@@ -198,17 +263,27 @@ public:
             mouse_RightClick = false;
             break;
         }
+    }
 
-        // Update deltaTime
-        LAST = NOW;
-        NOW = SDL_GetPerformanceCounter();
-        deltaTime = ((NOW - LAST) * 1000) / SDL_GetPerformanceFrequency();
+    // Loads the next recorded frame into Keys, the mouse state and deltaTime.
+    void replayFrame() {
+        if (!m_replay.next(m_frameInput)) {
+            appState = false;
+            return;
+        }
 
-#ifdef IMPL_IMGUI
-        updateImGui();
-#endif
+        std::memset(m_replayKeys, 0, sizeof(m_replayKeys));
+        for (Uint16 key : m_frameInput.keysDown) {
+            if (key < SDL_NUM_SCANCODES) m_replayKeys[key] = 1;
+        }
+        MousePos = m_frameInput.mousePos;
+        setMouseButtons(m_frameInput.mouseButtons);
+        deltaTime = m_frameInput.deltaTime;
 
-        SDL_RenderPresent(renderer);
+        // The session quit on its last frame, before the game updated with it, so the replay stops there too.
+        if (!m_replay.hasNext()) {
+            appState = false;
+        }
     }
 
 #ifdef IMPL_IMGUI
@@ -240,6 +315,11 @@ public:
 #endif
 
     ~Window() {
+        m_recorder.close();
+        if (headless) {
+            SDL_Quit();
+            return;
+        }
 #ifdef IMPL_IMGUI
         ImGui_ImplSDLRenderer2_Shutdown();
         ImGui_ImplSDL2_Shutdown();
@@ -252,8 +332,8 @@ public:
     }
 
 public:
-    SDL_Window* window;
-    SDL_Renderer* renderer;
+    SDL_Window* window = NULL;
+    SDL_Renderer* renderer = NULL;
 
     SDL_Event event;
 
@@ -262,6 +342,7 @@ public:
 
     bool appState = false;
     int width, height;
+    bool headless = false;
     double deltaTime = 0;
 
     //bool Keys[322];
@@ -275,6 +356,7 @@ public:
 
     //Window Events
     bool windowResized = false;
+    bool renderTargetsReset = false; // Cleared by whoever redraws their render targets
 
 #ifdef IMPL_IMGUI
     // Use std::function instead of function pointer for callback flexibility
@@ -284,6 +366,12 @@ public:
 private:
     double LAST;
     double NOW = SDL_GetPerformanceCounter();
+
+    // Input recording/replay
+    InputRecorder m_recorder;
+    InputReplay m_replay;
+    InputFrame m_frameInput;
+    Uint8 m_replayKeys[SDL_NUM_SCANCODES] = {};
 };
 
 #endif // WINDOW_H
@@ -1,9 +1,28 @@
 
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "window.hpp"
 #include "Player.hpp"
 #include "mapReader.hpp"
+#include "AutoTile.hpp"
+#include "Navigation.hpp"
+#include "Lighting.hpp"
+#include "SaveGame.hpp"
+#include "TextRenderer.hpp"
+#include "Particles.hpp"
+#include "Camera.hpp"
+#include "ChunkMipmaps.hpp"
+#include "FileWatcher.hpp"
+#include "MemoryTracker.hpp"
+#include "PixelCanvas.hpp"
+#include "Villagers.hpp"
+#include "AudioMixer.hpp"
+#include "Occlusion.hpp"
+#include "OverdrawMeter.hpp"
+#include "EditJournal.hpp"
+#include "TileEditor.hpp"
 
 FileSystem* fs;
 
@@ -36,8 +55,32 @@ void createFlatMap() {
 }
 
 int main(int argc, char* argv[]) {
-	Window window("Town Game 48hrs Challenge", 800, 600, 0);
+	//--record <file> writes this session's input to file. --replay <file> plays one back through the same game loop with no
+	//window, renderer or real time, then prints the final state and the frame timings and exits.
+	std::string recordPath, replayPath;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--replay" && i + 1 < argc) {
+			replayPath = argv[++i];
+		}
+		if (arg == "--record" && i + 1 < argc) {
+			recordPath = argv[++i];
+		}
+	}
+	const bool replaying = !replayPath.empty();
+
+	Window window("Town Game 48hrs Challenge", 800, 600, SDL_WINDOW_RESIZABLE, replaying);
 	fs = &window.fs;
+	if (replaying && !window.startReplay(replayPath)) {
+		return 1;
+	}
+	TextureCache::setDirectory(fs->joinToExecDir("Cache\\Textures"));
+	MemoryTracker::setBudget(MEM_MAP_TILES, 64ll * 1024 * 1024);
+	MemoryTracker::setBudget(MEM_TEXTURE_VRAM, 256ll * 1024 * 1024);
+	MemoryTracker::setBudget(MEM_ANIMATION, 8ll * 1024 * 1024);
+	if (!recordPath.empty()) {
+		window.startRecording(recordPath);
+	}
 
 	//createFlatMap();
 	
@@ -50,40 +93,467 @@ int main(int argc, char* argv[]) {
 	TextureAtlas spruceTree(window.renderer, fs->joinToExecDir("Assets\\Textures\\Trees\\Spruce_Tree_Small.png"), { 96,48 });
 	spruceTree.autoGenerateTextures(30);
 
-	SDL_Point texSize;
+	SDL_Point texSize = { 0, 0 };
 	SDL_Texture* grass_middle = loadTexture(window.renderer, fs->joinToExecDir("Assets\\Textures\\Grass\\Grass_1_Middle.png"), &texSize.x, &texSize.y);
 
-	Map map(fs->joinToExecDir("Assets\\Maps\\default.map"), "),");
+	//Restore the last save if there is one, the text map is only parsed for a new game.
+	SaveGame saveGame(fs->joinToExecDir("Saves\\world.sav"), fs->joinToExecDir("Saves\\world_autosave.sav"));
+	Map map;
+	PlayerState savedPlayer;
+	//Recordings and replays always start from a new game so they play out the same way.
+	if (recordPath.empty() && !replaying && saveGame.load(map, savedPlayer)) {
+		player.setState(savedPlayer.pos, savedPlayer.velocity, savedPlayer.facing);
+	}
+	else {
+		map = Map(fs->joinToExecDir("Assets\\Maps\\default.map"), "),");
+	}
+	auto playerState = [&]() { return PlayerState{ player.getPos(), player.getVelocity(), player.getFacing() }; };
+
+	//Plain grass(x,y) tiles get their edge pieces from the grass atlas' 3x3 set (IDs 1-3, 9-11, 17-19).
+	AutoTiler autoTiler;
+	autoTiler.addTerrain("grass", AutoTileRules::edgeSet3x3("grass", 1, grass.atlasSize.x / grass.subTextureSize.x));
+	autoTiler.resolve(map);
+
+	//A new game gets its base save straight away, while loading, so the first autosave is already a small delta.
+	//Replays never save.
+	if (!replaying && !saveGame.hasBase()) {
+		saveGame.saveFull(map, playerState());
+	}
+
+	Navigation navigation(map);
+
+	LightMap lightMap(map);
+	SDL_Point mapTileSize = map.getTileSize();
+	auto toTile = [&](SDL_FPoint pos) { return SDL_Point{ (int)pos.x / mapTileSize.x, (int)pos.y / mapTileSize.y }; };
+	int playerLight = lightMap.addLight(toTile(player.getPos()), 6);
 
-	SDL_Rect destTest = { 200,200,96,48 };
+	//Sprites are drawn from the tile's top left corner at their own size, which for the tree atlas is bigger than a tile.
+	auto spriteSize = [&](const Tile& tile) {
+		if (tile.usingTextureAtlas && tile.textureName == "grass") return grass.subTextureSize;
+		if (tile.usingTextureAtlas && tile.textureName == "spruceTree_small") return spruceTree.subTextureSize;
+		return texSize;
+	};
+	//The world is recorded into the render queue and drawn in one sorted pass: ground first, then entities back to front
+	//by their bottom edge, then particles. The HUD, minimap and heatmap still draw straight away on top.
+	RenderQueue renderQueue(window.renderer);
+	RenderRecorder& frameDraws = renderQueue.getRecorder();
+	player.setRenderQueue(&frameDraws);
+
+	//Draws one tile stretched over dest, for the normal view and when baking the chunk mip levels.
+	//With out set it's recorded into the queue instead, sorted by layer and depth. Without, it's drawn straight away.
+	//Returns the rect that was really drawn (atlas sprites are trimmed), empty if nothing was.
+	auto drawTile = [&](const Tile& tile, const SDL_Rect& dest, SDL_Color tint, RenderRecorder* out) {
+		SDL_Rect drawn = { 0, 0, 0, 0 };
+		RenderLayer layer = tile.isEntity ? LAYER_ENTITIES : LAYER_GROUND;
+		uint32_t depth = tile.isEntity ? RenderQueue::depthOf((float)(tile.pos.y + spriteSize(tile).y)) : 0;
+		if (tile.usingTextureAtlas) {
+			TextureAtlas* atlas = nullptr;
+			const std::string& atlasName = autoTiler.getAtlasName(tile);
+			if (atlasName == "grass") atlas = &grass; //Grass Atlas
+			if (atlasName == "spruceTree_small") atlas = &spruceTree;
+			if (atlas != nullptr) {
+				bool placed = out ? atlas->queueSubTexture(tile.textureID, *out, layer, depth, dest, tint) : atlas->useSubTexture(tile.textureID, window.renderer, dest, tint);
+				if (placed) drawn = atlas->render_Pos;
+			}
+		}
+		else if (tile.isEntity) {
+			//render entities here:
+		}
+		else if (out != nullptr) {
+			out->copy(layer, depth, grass_middle, nullptr, dest, tint);
+			drawn = dest;
+		}
+		else {
+			SDL_SetTextureColorMod(grass_middle, tint.r, tint.g, tint.b);
+			SDL_RenderCopy(window.renderer, grass_middle, NULL, &dest);
+			drawn = dest;
+		}
+		return drawn;
+	};
+
+	//The world is drawn at 400x300 and scaled up to the window by a whole number, F7 switches to drawing at full size.
+	PixelCanvas canvas(window.renderer, { 400, 300 });
+	canvas.fitTo(window.width, window.height);
+	bool canvasToggleHeld = false;
+
+	//The camera follows the player, -/+ zoom out and in. Zoomed out views draw the ground from pre-rendered chunk images.
+	Camera camera(canvas.getViewSize());
+	player.setCamera(&camera);
+	ChunkMipmaps groundMips(window.renderer, map, [&](const Tile& tile, const SDL_Rect& dest) { drawTile(tile, dest, { 255, 255, 255, 255 }, nullptr); });
+	groundMips.update();
+	SDL_Point mapSize = map.getMapSize();
+
+	//Ground tiles completely under the opaque part of a sprite aren't drawn. F8 shows how often each pixel gets drawn.
+	GroundOcclusion occlusion(map,
+		[&](const Tile& tile) { SDL_Point size = spriteSize(tile); return SDL_Rect{ tile.pos.x, tile.pos.y, size.x, size.y }; },
+		[&](const Tile& tile, const SDL_Rect& area) {
+			if (tile.usingTextureAtlas && tile.textureName == "spruceTree_small") return spruceTree.isOpaque(tile.textureID, area);
+			return false;
+		});
+	occlusion.update();
+	OverdrawMeter overdraw(window.renderer);
+	bool overdrawToggleHeld = false;
+
+	//Saving the map file while the game runs patches the rows that changed into the running map.
+	FileWatcher mapWatcher;
+	if (!replaying && !map.getPath().empty()) {
+		mapWatcher.watch(FileSystem::nativePath(map.getPath()));
+	}
+	std::vector<TileChange> mapChanges;
+
+	//Cells changed by a reload or the tile editor, passed on to whatever was built from the map.
+	auto applyMapChanges = [&](const std::vector<TileChange>& changes) {
+		autoTiler.refresh(map, changes);
+		for (const TileChange& change : changes) {
+			if (change.hadGround != change.hasGround) {
+				navigation.setWalkable(change.cell.x, change.cell.y, change.hasGround);
+			}
+		}
+	};
+
+	//Tile edits go into a journal next to the map file until saving compacts them into it. Whatever wasn't is replayed here.
+	//Input replays leave it alone and run on the text map as it is.
+	std::string mapPath = FileSystem::nativePath(map.getPath().empty() ? fs->joinToExecDir("Assets\\Maps\\default.map") : map.getPath());
+	EditJournal journal(mapPath + ".journal");
+	MapCompactor compactor(mapPath);
+	if (!replaying && journal.replay(map, mapChanges) > 0) {
+		applyMapChanges(mapChanges);
+		groundMips.update();
+		std::printf("Replayed %zu journaled tile edits onto %s\n", mapChanges.size(), mapPath.c_str());
+	}
+
+#ifdef IMPL_IMGUI
+	//F9 opens the tile editor.
+	TileEditor editor(map, journal);
+	editor.addTexture("grass", grass_middle);
+	editor.addAtlas("grass", &grass);
+	window.setRenderCallback([&](Window*) { editor.drawGUI(); });
+	std::vector<TileChange> editorChanges;
+	bool editorToggleHeld = false;
+#endif
+
+	//Particle sprites are 8x8: 1 = spruce needle, 2 = dust puff, 3 = ember.
+	TextureAtlas particleSprites(window.renderer, fs->joinToExecDir("Assets\\Textures\\Particles\\Particles.png"), { 8,8 });
+	particleSprites.autoGenerateTextures(3);
+
+	ParticleSystem particles;
+	ParticleType needleType;
+	needleType.atlas = &particleSprites;
+	needleType.textureID = 1;
+	needleType.capacity = 2048;
+	needleType.lifeMin = 2.0f; needleType.lifeMax = 3.5f;
+	needleType.velocityMin = { -12, 10 }; needleType.velocityMax = { 12, 25 };
+	needleType.acceleration = { 4, 6 };
+	needleType.spawnRadius = 16;
+	needleType.startSize = needleType.endSize = 8;
+	needleType.startColour = { 255, 255, 255, 255 }; needleType.endColour = { 255, 255, 255, 0 };
+	int needles = particles.addType("needles", needleType);
+
+	ParticleType dustType;
+	dustType.atlas = &particleSprites;
+	dustType.textureID = 2;
+	dustType.capacity = 512;
+	dustType.lifeMin = 0.3f; dustType.lifeMax = 0.6f;
+	dustType.velocityMin = { -20, -15 }; dustType.velocityMax = { 20, 0 };
+	dustType.drag = 4.0f;
+	dustType.spawnRadius = 4;
+	dustType.startSize = 4; dustType.endSize = 9;
+	dustType.startColour = { 196, 170, 128, 160 }; dustType.endColour = { 196, 170, 128, 0 };
+	int dust = particles.addType("dust", dustType);
+
+	ParticleType emberType;
+	emberType.atlas = &particleSprites;
+	emberType.textureID = 3;
+	emberType.capacity = 1024;
+	emberType.lifeMin = 0.6f; emberType.lifeMax = 1.2f;
+	emberType.velocityMin = { -10, -45 }; emberType.velocityMax = { 10, -25 };
+	emberType.acceleration = { 0, -10 };
+	emberType.drag = 0.5f;
+	emberType.spawnRadius = 3;
+	emberType.startSize = 4; emberType.endSize = 2;
+	emberType.startColour = { 255, 210, 90, 255 }; emberType.endColour = { 200, 40, 10, 0 };
+	int embers = particles.addType("embers", emberType);
+
+	//Needles drop from the tree tiles in turn.
+	std::vector<SDL_FPoint> treeTops;
+	for (const auto& tile : map.tileMap) {
+		if (tile.textureName == "spruceTree_small") {
+			treeTops.push_back({ tile.pos.x + 48.0f, tile.pos.y + 16.0f });
+		}
+	}
+	size_t nextTree = 0;
+	double needleTime = 0, dustTime = 0, emberTime = 0;
+
+	//Villagers share the player's sprite sheet. Their homes, workplaces and the market stalls are random walkable tiles.
+	TextureAtlas villagerSprites(window.renderer, fs->joinToExecDir("Assets\\Textures\\Player\\Player_Old\\Player.png"), { 32,32 });
+	VillagerSystem villagers(navigation, mapTileSize, &villagerSprites);
+	uint32_t townSeed = 12345;
+	auto randomWalkableTile = [&]() {
+		for (int attempt = 0; attempt < 1000; attempt++) {
+			townSeed = townSeed * 1664525u + 1013904223u;
+			SDL_Point cell = { (int)((townSeed >> 8) % (uint32_t)mapSize.x), (int)((townSeed >> 20) % (uint32_t)mapSize.y) };
+			if (navigation.isWalkable(cell.x, cell.y)) return cell;
+		}
+		return SDL_Point{ -1, -1 };
+	};
+	SDL_Point marketStalls[3];
+	for (SDL_Point& stall : marketStalls) stall = randomWalkableTile();
+	for (int i = 0; i < 300; i++) {
+		SDL_Point home = randomWalkableTile(), work = randomWalkableTile();
+		if (home.x < 0 || work.x < 0 || marketStalls[i % 3].x < 0) break;
+		villagers.add(home, work, marketStalls[i % 3]);
+	}
+
+	//Footsteps follow the player, rustles come from the trees dropping needles, panned by where they are from the player.
+	//Replays mix on the dummy driver, so they exercise the mixer without a sound card.
+	AudioMixer audio;
+	audio.open(replaying ? "dummy" : nullptr);
+	int footstepSound = audio.loadSound(fs->joinToExecDir("Assets\\Audio\\Sounds\\Footstep.wav"));
+	int rustleSound = audio.loadSound(fs->joinToExecDir("Assets\\Audio\\Sounds\\Rustle.wav"));
+	audio.playMusic(fs->joinToExecDir("Assets\\Audio\\Music\\Town.wav"));
+	double footstepTime = 0;
+	int needlesSinceRustle = 0;
+
+	TextRenderer hudText(window.renderer, fs->joinToExecDir("Assets\\Fonts\\Roboto-Regular.ttf"), 16);
+	std::string fpsText = "FPS: --";
+	std::string audioText = "Audio: --";
+	double fpsTime = 0;
+	int fpsFrames = 0;
+
+	Timer autosaveTimer;
+	autosaveTimer.start();
+	bool quickSaveHeld = false;
+	bool memoryReportHeld = false;
 
 	std::cout << spruceTree.render_Pos.x << ", " << spruceTree.render_Pos.y << std::endl;
 
-	while (window.appState) {
-		SDL_SetRenderDrawColor(window.renderer, 100, 149, 237, 255);
-		SDL_RenderClear(window.renderer);
+	//One frame of the game, everything but the window's own drawing: the world, the player and the view recorded into the
+	//render queue. The loop below and --replay both run it on the input window.update() read at the end of the frame before.
+	double gameTime = 0;
+	float ambient = 1.0f;
+	auto simulate = [&]() {
+		//A full day/night cycle every 10 minutes of game time, never fully dark so the map stays readable.
+		gameTime += window.deltaTime;
+		float dayTime = (float)(std::fmod(gameTime, 600000.0) / 600000.0);
+		ambient = 0.6f + 0.4f * std::cos(dayTime * 6.2831853f);
+		lightMap.setAmbient(ambient);
+		lightMap.moveLight(playerLight, toTile(player.getPos()));
+		lightMap.update();
 
-		for (const auto& tile : map.tileMap) {
-			if (tile.usingTextureAtlas) {
-				if (tile.textureName == "grass") {
-					//Grass Atlas:
-					grass.useSubTexture(tile.textureID, window.renderer, tile.pos);
-				}
-				if (tile.textureName == "spruceTree_small") {
-					spruceTree.useSubTexture(tile.textureID, window.renderer, tile.pos);
+		float zoomSpeed = (float)std::pow(2.0, window.deltaTime / 500.0); // Doubles every half second
+		if (window.Keys[SDL_SCANCODE_MINUS] || window.Keys[SDL_SCANCODE_KP_MINUS]) camera.setZoom(camera.zoom / zoomSpeed);
+		if (window.Keys[SDL_SCANCODE_EQUALS] || window.Keys[SDL_SCANCODE_KP_PLUS]) camera.setZoom(camera.zoom * zoomSpeed);
+		camera.viewSize = canvas.getViewSize();
+		camera.centreOn({ player.getPos().x + 16.0f, player.getPos().y + 16.0f });
+
+		occlusion.update();
+
+		int mipLevel = groundMips.levelForZoom(camera.zoom);
+		if (mipLevel == 0) {
+			//Only the tiles in view, found through the tile grid.
+			SDL_FRect view = camera.getViewRect();
+			int x0 = std::max(0, (int)std::floor(view.x / mapTileSize.x)), y0 = std::max(0, (int)std::floor(view.y / mapTileSize.y));
+			int x1 = std::min(mapSize.x - 1, (int)std::floor((view.x + view.w) / mapTileSize.x));
+			int y1 = std::min(mapSize.y - 1, (int)std::floor((view.y + view.h) / mapTileSize.y));
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					int index = map.getGroundTile(x, y);
+					if (index < 0 || occlusion.isHidden(x, y)) continue;
+					const Tile& tile = map.tileMap[index];
+					SDL_Point size = spriteSize(tile);
+					SDL_Rect dest = camera.worldToScreenRect({ (float)tile.pos.x, (float)tile.pos.y, (float)size.x, (float)size.y });
+					overdraw.add(drawTile(tile, dest, lightMap.getTint(x, y), &frameDraws));
 				}
-			} else if (tile.isEntity) {
-				//render entities here:
 			}
-			else {
-				SDL_Rect pos{ tile.pos.x, tile.pos.y, texSize.x, texSize.y };
-				SDL_RenderCopy(window.renderer, grass_middle, NULL, &pos);
+		}
+		else {
+			//The chunk images have no per tile lighting, the ambient level is applied to the whole image.
+			SDL_Color ambientTint = { (Uint8)(lightMap.ambientColour.r * ambient), (Uint8)(lightMap.ambientColour.g * ambient), (Uint8)(lightMap.ambientColour.b * ambient), 255 };
+			groundMips.draw(camera, mipLevel, ambientTint);
+			overdraw.add(camera.worldToScreenRect({ 0, 0, (float)mapSize.x * mapTileSize.x, (float)mapSize.y * mapTileSize.y }));
+		}
+
+		//Entities are listed by the chunk their top left corner is in, and sprites are smaller than a chunk, so the chunks
+		//in view and one more up and to the left hold everything that can show.
+		{
+			SDL_FRect view = camera.getViewRect();
+			SDL_Point chunks = map.getChunkCount();
+			float chunkW = (float)Map::chunkSize * mapTileSize.x, chunkH = (float)Map::chunkSize * mapTileSize.y;
+			int cx0 = std::max(0, (int)std::floor(view.x / chunkW) - 1), cy0 = std::max(0, (int)std::floor(view.y / chunkH) - 1);
+			int cx1 = std::min(chunks.x - 1, (int)std::floor((view.x + view.w) / chunkW));
+			int cy1 = std::min(chunks.y - 1, (int)std::floor((view.y + view.h) / chunkH));
+			for (int cy = cy0; cy <= cy1; cy++) {
+				for (int cx = cx0; cx <= cx1; cx++) {
+					for (int index : map.getChunkEntities(cx, cy)) {
+						const Tile& tile = map.tileMap[index];
+						SDL_Point size = spriteSize(tile);
+						SDL_FRect world = { (float)tile.pos.x, (float)tile.pos.y, (float)size.x, (float)size.y };
+						if (!camera.isVisible(world)) continue;
+						overdraw.add(drawTile(tile, camera.worldToScreenRect(world), lightMap.getTint(tile.pos.x / mapTileSize.x, tile.pos.y / mapTileSize.y), &frameDraws));
+					}
+				}
 			}
 		}
 
-		SDL_RenderCopy(window.renderer, spruceTree.atlas, NULL, &destTest);
+		//Villagers get a fixed slice of the frame however many there are, the ones far from the camera update less often.
+		villagers.update(camera, window.deltaTime, 1.0);
+		villagers.draw(frameDraws, camera);
 
 		player.Update();
+		overdraw.add(camera.worldToScreenRect({ player.getPos().x, player.getPos().y, 32.0f, 32.0f }));
+
+		//Dust kicks up behind a moving player, embers come off the torch once it gets dark.
+		SDL_FPoint playerPos = player.getPos();
+		SDL_FPoint playerVel = player.getVelocity();
+		SDL_FPoint playerFeet = { playerPos.x + 16.0f, playerPos.y + 30.0f };
+		dustTime += window.deltaTime;
+		if (dustTime >= 80.0) {
+			if (std::fabs(playerVel.x) + std::fabs(playerVel.y) > 60.0f) {
+				particles.emit(dust, playerFeet, 3);
+			}
+			dustTime = 0;
+		}
+		emberTime += window.deltaTime;
+		if (emberTime >= 60.0) {
+			if (ambient < 0.5f) {
+				particles.emit(embers, { playerPos.x + 22.0f, playerPos.y + 12.0f }, 1);
+			}
+			emberTime = 0;
+		}
+		needleTime += window.deltaTime;
+		if (needleTime >= 120.0 && !treeTops.empty()) {
+			particles.emit(needles, treeTops[nextTree], 1);
+			if (++needlesSinceRustle >= 12) {
+				audio.playAt(rustleSound, treeTops[nextTree], 0.5f);
+				needlesSinceRustle = 0;
+			}
+			nextTree = (nextTree + 1) % treeTops.size();
+			needleTime = 0;
+		}
+		particles.update(window.deltaTime);
+
+		audio.setListener(playerFeet);
+		footstepTime += window.deltaTime;
+		if (footstepTime >= 320.0) {
+			if (std::fabs(playerVel.x) + std::fabs(playerVel.y) > 60.0f) {
+				audio.play(footstepSound, 0.4f);
+			}
+			footstepTime = 0;
+		}
+		audio.update();
+		particles.draw(frameDraws, camera);
+
+		//Path requests and flow fields get a fixed slice of the frame, anything left over carries on next frame.
+		navigation.update(1.0);
+		renderQueue.flush();
+	};
+
+	std::vector<double> frameTimes; // Only kept by replays
+	double frequency = (double)SDL_GetPerformanceFrequency();
+	while (window.appState) {
+		if (window.headless) {
+			Uint64 frameStart = SDL_GetPerformanceCounter();
+			simulate();
+			frameTimes.push_back((SDL_GetPerformanceCounter() - frameStart) * 1000.0 / frequency);
+			window.update();
+			if (window.Keys[SDL_SCANCODE_ESCAPE]) {
+				window.appState = false;
+			}
+			continue;
+		}
+
+		if (window.windowResized) {
+			canvas.fitTo(window.width, window.height);
+			window.windowResized = false;
+		}
+		if (window.Keys[SDL_SCANCODE_F7] && !canvasToggleHeld) {
+			canvas.enabled = !canvas.enabled;
+		}
+		canvasToggleHeld = window.Keys[SDL_SCANCODE_F7];
+
+		canvas.begin();
+		SDL_SetRenderDrawColor(window.renderer, 100, 149, 237, 255);
+		SDL_RenderClear(window.renderer);
+
+		if (window.Keys[SDL_SCANCODE_F8] && !overdrawToggleHeld) {
+			overdraw.enabled = !overdraw.enabled;
+		}
+		overdrawToggleHeld = window.Keys[SDL_SCANCODE_F8];
+		overdraw.begin(canvas.getViewSize());
+
+#ifdef IMPL_IMGUI
+		if (window.Keys[SDL_SCANCODE_F9] && !editorToggleHeld) {
+			editor.enabled = !editor.enabled;
+		}
+		editorToggleHeld = window.Keys[SDL_SCANCODE_F9];
+		editor.update(window, camera, canvas, editorChanges);
+		applyMapChanges(editorChanges);
+		if (editor.saveRequested) {
+			compactor.start(map, journal, spriteSize);
+			editor.saveRequested = false;
+		}
+		editor.compacting = compactor.isBusy();
+#endif
+		if (compactor.update(map, journal)) {
+			mapWatcher.hasChanged(); // Our own write, the map's rows were already re-based on it
+			std::printf("Compacted the edit journal into %s\n", mapPath.c_str());
+		}
+
+		//Not while a compaction runs or its write hasn't been picked up by update() yet, the reload would race its own write.
+		if (!compactor.isBusy() && mapWatcher.hasChanged() && map.hotReload(mapChanges)) {
+			applyMapChanges(mapChanges);
+			groundMips.update(); // All of them now, so the change shows up this frame
+			std::printf("Reloaded %s, %zu tiles changed\n", map.getPath().c_str(), mapChanges.size());
+		}
+
+		//Edited chunks get their mip levels redrawn a few at a time.
+		if (window.renderTargetsReset) {
+			groundMips.invalidateAll();
+			window.renderTargetsReset = false;
+		}
+		groundMips.update(4);
+
+		simulate();
+#ifdef IMPL_IMGUI
+		editor.drawCursor(window.renderer, camera);
+#endif
+
+		overdraw.drawHeatmap();
+
+		//The UI goes on top at the window's resolution.
+		canvas.end();
+
+		//The FPS string only changes 4 times a second so its cached glyph run gets reused in between.
+		fpsTime += window.deltaTime;
+		fpsFrames++;
+		if (fpsTime >= 250.0) {
+			fpsText = "FPS: " + std::to_string((int)(fpsFrames * 1000.0 / fpsTime + 0.5));
+			AudioStats audioStats = audio.getStats();
+			char audioLine[64];
+			std::snprintf(audioLine, sizeof(audioLine), "Audio: %.2f ms, %llu underruns", audioStats.callbackMs, (unsigned long long)audioStats.underruns);
+			audioText = audioLine;
+			fpsTime = 0;
+			fpsFrames = 0;
+		}
+		hudText.drawText(fpsText, { 8, 8 });
+		hudText.drawText(audioText, { 8, 8 + hudText.getLineHeight() });
+		int hudLine = 2;
+		if (overdraw.enabled) {
+			//Rounded so the cached text only changes when the numbers really do.
+			char overdrawLine[64];
+			std::snprintf(overdrawLine, sizeof(overdrawLine), "Overdraw: %.1fx, %d ground tiles hidden", overdraw.getAverage(), occlusion.getHiddenCount());
+			hudText.drawText(overdrawLine, { 8, 8 + hudText.getLineHeight() * hudLine++ });
+			RenderStats drawStats = renderQueue.getStats();
+			char queueLine[96];
+			std::snprintf(queueLine, sizeof(queueLine), "Draws: %zu, %zu texture switches, %zu allocations", drawStats.commands, drawStats.textureChanges, drawStats.heapAllocations);
+			hudText.drawText(queueLine, { 8, 8 + hudText.getLineHeight() * hudLine++ });
+		}
+		if (saveGame.isBusy()) {
+			hudText.drawText("Saving...", { 8, 8 + hudText.getLineHeight() * hudLine++ });
+		}
+		hudText.flush();
+
+		groundMips.drawMinimap({ window.width - 168, 8, 160, 120 }, &camera);
 		
 		window.update();
 		SDL_RenderPresent(window.renderer);
@@ -91,6 +561,46 @@ int main(int argc, char* argv[]) {
 		if (window.Keys[SDL_SCANCODE_ESCAPE]) {
 			window.appState = false;
 		}
+
+		//Autosaves only carry the chunks edited since the last full save, F5 writes a full save.
+		if (autosaveTimer.getTicks() >= 30000) {
+			saveGame.autosave(map, playerState());
+			autosaveTimer.start();
+		}
+		if (window.Keys[SDL_SCANCODE_F5] && !quickSaveHeld) {
+			saveGame.saveFull(map, playerState());
+		}
+		quickSaveHeld = window.Keys[SDL_SCANCODE_F5];
+
+		//F6 dumps memory use per category next to the executable.
+		if (window.Keys[SDL_SCANCODE_F6] && !memoryReportHeld) {
+			MemoryTracker::writeJSON(fs->joinToExecDir("memory.json"));
+		}
+		memoryReportHeld = window.Keys[SDL_SCANCODE_F6];
+	}
+
+	if (replaying) {
+		if (frameTimes.empty()) {
+			std::printf("The recording %s has no frames\n", replayPath.c_str());
+			return 1;
+		}
+		double total = 0;
+		for (double t : frameTimes) total += t;
+		std::vector<double> sorted = frameTimes;
+		std::sort(sorted.begin(), sorted.end());
+
+		SDL_FPoint pos = player.getPos(), vel = player.getVelocity();
+		std::printf("Replayed %zu frames\n", frameTimes.size());
+		std::printf("Frame time ms: avg %.4f, p50 %.4f, p99 %.4f, max %.4f\n", total / frameTimes.size(),
+			sorted[sorted.size() / 2], sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)], sorted.back());
+		std::printf("Final player state: pos (%.6f, %.6f), velocity (%.6f, %.6f), facing %d\n", pos.x, pos.y, vel.x, vel.y, (int)player.getFacing());
+		AudioStats audioStats = audio.getStats();
+		std::printf("Audio: peak callback %.4f ms, %llu underruns\n", audioStats.peakCallbackMs, (unsigned long long)audioStats.underruns);
+		return 0;
 	}
+
+	//SaveGame's destructor waits for this to be written.
+	saveGame.saveFull(map, playerState());
+	MemoryTracker::writeJSON(fs->joinToExecDir("memory.json"));
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+// Builds Assets.pack from the Assets folder of a game directory.
+// Usage: AssetPacker <gameDir> [outputPack]
+// With no outputPack the pack is written next to the assets as <gameDir>/Assets.pack, where FileSystem mounts it from.
+
+#include "AssetPack.hpp"
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::printf("Usage: %s <gameDir> [outputPack]\n", argv[0]);
+		return 1;
+	}
+
+	std::string gameDir = argv[1];
+	std::string packPath = (argc > 2) ? argv[2] : (std::filesystem::path(gameDir) / "Assets.pack").string();
+
+	return AssetPack::build(gameDir, packPath) ? 0 : 1;
+}